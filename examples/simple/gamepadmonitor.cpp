@@ -30,9 +30,14 @@ GamepadMonitor::GamepadMonitor(QObject *parent)
     m_manager = new QGamepadManager(this);
     m_inputState = new QGamepadInputState(this);
 
-    connect(m_manager, SIGNAL(gamepadEvent(QGamepadInfo*,quint64,int,int,int)),
-            m_inputState, SLOT(processGamepadEvent(QGamepadInfo*,quint64,int,int,int)));
+    //Apply whole SYN_REPORT frames instead of single events
+    m_manager->setDeliveryModes(QGamepadHandler::FrameDelivery);
+    connect(m_manager, SIGNAL(gamepadFrame(QGamepadInfo*,QGamepadHandler::GamepadFrame)),
+            m_inputState, SLOT(processGamepadFrame(QGamepadInfo*,QGamepadHandler::GamepadFrame)));
+    connect(m_manager, SIGNAL(gamepadDisconnected(QGamepadInfo*)), m_inputState, SLOT(removeGamepad(QGamepadInfo*)));
 
+    //Print once per frame rather than once per event
+    m_inputState->setNotificationPolicy(QGamepadInputState::PerFrame);
     connect(m_inputState, SIGNAL(stateUpdated()), this, SLOT(printStatus()));
 }
 
@@ -1,7 +1,7 @@
 TARGET     = QtGamepad
 QT         = core
 
-LIBS += -ludev
+LIBS += -ludev -lrt
 
 load(qt_module)
 
@@ -9,12 +9,46 @@ HEADERS += \
     qtgamepadglobal.h \
     qgamepaddevicediscovery_p.h \
     qgamepadmanager.h \
+    qgamepadbackend.h \
+    qgamepadevdevbackend_p.h \
+    qgamepadinjectionbackend.h \
     qgamepadhandler.h \
+    qgamepadeventsink.h \
+    qgamepadcapabilitycache_p.h \
+    qgamepadforcefeedback_p.h \
+    qgamepadmappingdatabase.h \
+    qgamepadlatencyhistogram.h \
+    qgamepadframering_p.h \
+    qgamepadreaderthread_p.h \
+    qgamepadmultiplexer_p.h \
+    qgamepadrecorder_p.h \
+    qgamepadreplay.h \
+    qgamepadstatesnapshot.h \
+    qgamepadsharedstate.h \
+    qgamepadstreamserver.h \
+    qgamepadsnapshotbuffer_p.h \
+    qgamepadstickpipeline_p.h \
     qgamepadinputstate.h \
-    qgamepadkeybindings.h
+    qgamepadkeybindings.h \
+    qgamepadcombodetector.h
 SOURCES += \
     qgamepaddevicediscovery.cpp \
     qgamepadmanager.cpp \
+    qgamepadbackend.cpp \
+    qgamepadevdevbackend.cpp \
+    qgamepadinjectionbackend.cpp \
     qgamepadhandler.cpp \
+    qgamepadcapabilitycache.cpp \
+    qgamepadforcefeedback.cpp \
+    qgamepadmappingdatabase.cpp \
+    qgamepadlatencyhistogram.cpp \
+    qgamepadreaderthread.cpp \
+    qgamepadmultiplexer.cpp \
+    qgamepadrecorder.cpp \
+    qgamepadreplay.cpp \
+    qgamepadsharedstate.cpp \
+    qgamepadstreamserver.cpp \
+    qgamepadstickpipeline.cpp \
     qgamepadinputstate.cpp \
-    qgamepadkeybindings.cpp
+    qgamepadkeybindings.cpp \
+    qgamepadcombodetector.cpp
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADBACKEND_H
+#define QGAMEPADBACKEND_H
+
+#include <QtCore/QObject>
+#include <QtCore/QStringList>
+#include <QtGamepad/qtgamepadglobal.h>
+
+QT_BEGIN_HEADER
+
+QT_BEGIN_NAMESPACE
+
+class QGamepadHandler;
+class QGamepadDeviceDiscovery;
+
+//Source of devices for QGamepadManager. A backend enumerates devices,
+//reports hotplug through deviceDetected()/deviceRemoved() and creates the
+//handler that produces the events of each device. Ownership of handlers
+//returned from createHandler() passes to the manager.
+class Q_GAMEPAD_EXPORT QGamepadBackend : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QGamepadBackend(QObject *parent = 0);
+    ~QGamepadBackend();
+
+    virtual QStringList scanConnectedDevices() = 0;
+    virtual QGamepadHandler *createHandler(const QString &deviceNode) = 0;
+
+    //Hotplug source the manager may watch itself, see QGamepadManager::MultiplexedReading
+    virtual QGamepadDeviceDiscovery *deviceDiscovery() const { return 0; }
+
+signals:
+    void deviceDetected(const QString &deviceNode);
+    void deviceRemoved(const QString &deviceNode);
+};
+
+QT_END_NAMESPACE
+
+QT_END_HEADER
+
+#endif // QGAMEPADBACKEND_H
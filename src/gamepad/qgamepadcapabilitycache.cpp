@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "qgamepadcapabilitycache_p.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+static const quint32 QGamepadCapabilityCacheMagic = 0x51474443; // "QGDC"
+static const quint32 QGamepadCapabilityCacheVersion = 2;
+
+Q_STATIC_ASSERT(QGamepadDeviceCapabilities::RelCount == REL_CNT);
+Q_STATIC_ASSERT(QGamepadDeviceCapabilities::FfCount == FF_CNT);
+
+QGamepadDeviceCapabilities::QGamepadDeviceCapabilities()
+    : bus(0)
+    , vendor(0)
+    , product(0)
+    , version(0)
+    , effectCount(0)
+{
+    memset(keyBits, 0, sizeof(keyBits));
+    memset(absBits, 0, sizeof(absBits));
+    memset(relBits, 0, sizeof(relBits));
+    memset(ffBits, 0, sizeof(ffBits));
+    memset(absInfo, 0, sizeof(absInfo));
+}
+
+bool QGamepadDeviceCapabilities::readIdentity(int fd)
+{
+    struct input_id id;
+    if (ioctl(fd, EVIOCGID, &id) < 0)
+        return false;
+
+    bus = id.bustype;
+    vendor = id.vendor;
+    product = id.product;
+    version = id.version;
+
+    char buffer[256];
+    int length = ioctl(fd, EVIOCGNAME(sizeof(buffer)), buffer);
+    name = length > 0 ? QByteArray(buffer, qstrnlen(buffer, length)) : QByteArray();
+    return true;
+}
+
+bool QGamepadDeviceCapabilities::probe(int fd)
+{
+    if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(absBits)), absBits) < 0)
+        return false;
+    ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keyBits)), keyBits);
+    ioctl(fd, EVIOCGBIT(EV_REL, sizeof(relBits)), relBits);
+    ioctl(fd, EVIOCGBIT(EV_FF, sizeof(ffBits)), ffBits);
+    if (ioctl(fd, EVIOCGEFFECTS, &effectCount) < 0)
+        effectCount = 0;
+    readAbsInfo(fd);
+    return true;
+}
+
+void QGamepadDeviceCapabilities::readAbsInfo(int fd)
+{
+    //Only the axes the device reports
+    for (int code = 0; code < QGamepadHandler::AbsCount; ++code) {
+        if (!testBit(absBits, code))
+            continue;
+
+        struct input_absinfo info;
+        if (ioctl(fd, EVIOCGABS(code), &info) < 0)
+            continue;
+        absInfo[code].value = info.value;
+        absInfo[code].minimum = info.minimum;
+        absInfo[code].maximum = info.maximum;
+        absInfo[code].fuzz = info.fuzz;
+        absInfo[code].flat = info.flat;
+        absInfo[code].resolution = info.resolution;
+    }
+}
+
+QByteArray QGamepadDeviceCapabilities::key() const
+{
+    //Version stands in for the firmware, a device with a changed
+    //firmware reports a different version
+    QByteArray key;
+    QDataStream stream(&key, QIODevice::WriteOnly);
+    stream << bus << vendor << product << version << name;
+    return key;
+}
+
+QGamepadCapabilityCache::QGamepadCapabilityCache()
+    : m_fileName(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QLatin1String("/gamepadcapabilities.cache"))
+    , m_loaded(false)
+    , m_dirty(false)
+{
+}
+
+bool QGamepadCapabilityCache::capabilities(int fd, QGamepadDeviceCapabilities *capabilities, bool *probed)
+{
+    if (probed)
+        *probed = false;
+
+    if (!capabilities->readIdentity(fd))
+        return false;
+    QByteArray key = capabilities->key();
+
+    //Copied out, the ioctls run without holding the lock
+    QGamepadDeviceCapabilities cached;
+    bool known;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_loaded)
+            load();
+        known = m_devices.contains(key);
+        if (known)
+            cached = m_devices.value(key);
+    }
+
+    if (known) {
+        //Same identity with other axes means the driver changed
+        ulong absBits[QGamepadDeviceCapabilities::AbsWords] = { 0 };
+        if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(absBits)), absBits) >= 0
+                && memcmp(absBits, cached.absBits, sizeof(absBits)) == 0) {
+            //Values are the current stick positions and some drivers
+            //calibrate the ranges, only the bitmaps are worth caching
+            *capabilities = cached;
+            capabilities->readAbsInfo(fd);
+            return true;
+        }
+    }
+
+    if (!capabilities->probe(fd))
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    m_devices.insert(key, *capabilities);
+    m_dirty = true;
+    if (probed)
+        *probed = true;
+    return true;
+}
+
+void QGamepadCapabilityCache::load()
+{
+    m_loaded = true;
+
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic, version, count, longBits;
+    stream >> magic >> version >> longBits >> count;
+    if (stream.status() != QDataStream::Ok || magic != QGamepadCapabilityCacheMagic
+            || version != QGamepadCapabilityCacheVersion || longBits != QGamepadDeviceCapabilities::LongBits)
+        return;
+
+    //The bitmaps are stored as they are in memory
+    const int rawSize = sizeof(QGamepadDeviceCapabilities::keyBits) + sizeof(QGamepadDeviceCapabilities::absBits)
+            + sizeof(QGamepadDeviceCapabilities::relBits) + sizeof(QGamepadDeviceCapabilities::ffBits)
+            + sizeof(QGamepadDeviceCapabilities::absInfo);
+
+    QHash<QByteArray, QGamepadDeviceCapabilities> devices;
+    for (quint32 i = 0; i < count; ++i) {
+        QGamepadDeviceCapabilities capabilities;
+        stream >> capabilities.bus >> capabilities.vendor >> capabilities.product >> capabilities.version >> capabilities.name
+               >> capabilities.effectCount;
+        if (stream.status() != QDataStream::Ok)
+            return;
+
+        QByteArray raw(rawSize, Qt::Uninitialized);
+        if (stream.readRawData(raw.data(), rawSize) != rawSize)
+            return;
+
+        const char *data = raw.constData();
+        memcpy(capabilities.keyBits, data, sizeof(capabilities.keyBits));
+        data += sizeof(capabilities.keyBits);
+        memcpy(capabilities.absBits, data, sizeof(capabilities.absBits));
+        data += sizeof(capabilities.absBits);
+        memcpy(capabilities.relBits, data, sizeof(capabilities.relBits));
+        data += sizeof(capabilities.relBits);
+        memcpy(capabilities.ffBits, data, sizeof(capabilities.ffBits));
+        data += sizeof(capabilities.ffBits);
+        memcpy(capabilities.absInfo, data, sizeof(capabilities.absInfo));
+
+        devices.insert(capabilities.key(), capabilities);
+    }
+
+    //Only take the cache once it was read completely
+    m_devices = devices;
+}
+
+void QGamepadCapabilityCache::save()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_dirty)
+        return;
+    m_dirty = false;
+
+    QDir().mkpath(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+
+    QSaveFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << QGamepadCapabilityCacheMagic << QGamepadCapabilityCacheVersion
+           << quint32(QGamepadDeviceCapabilities::LongBits) << quint32(m_devices.count());
+
+    QHash<QByteArray, QGamepadDeviceCapabilities>::const_iterator it;
+    for (it = m_devices.constBegin(); it != m_devices.constEnd(); ++it) {
+        const QGamepadDeviceCapabilities &capabilities = it.value();
+        stream << capabilities.bus << capabilities.vendor << capabilities.product << capabilities.version << capabilities.name
+               << capabilities.effectCount;
+        stream.writeRawData(reinterpret_cast<const char *>(capabilities.keyBits), sizeof(capabilities.keyBits));
+        stream.writeRawData(reinterpret_cast<const char *>(capabilities.absBits), sizeof(capabilities.absBits));
+        stream.writeRawData(reinterpret_cast<const char *>(capabilities.relBits), sizeof(capabilities.relBits));
+        stream.writeRawData(reinterpret_cast<const char *>(capabilities.ffBits), sizeof(capabilities.ffBits));
+        stream.writeRawData(reinterpret_cast<const char *>(capabilities.absInfo), sizeof(capabilities.absInfo));
+    }
+    file.commit();
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADCAPABILITYCACHE_P_H
+#define QGAMEPADCAPABILITYCACHE_P_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtGamepad/qgamepadhandler.h>
+
+QT_BEGIN_NAMESPACE
+
+//Everything QGamepadHandler learns about an evdev device through ioctls
+struct QGamepadDeviceCapabilities
+{
+    enum {
+        LongBits = 8 * sizeof(ulong),
+        RelCount = 0x10,
+        FfCount = 0x80,
+        KeyWords = QGamepadHandler::KeyCount / LongBits,
+        AbsWords = QGamepadHandler::AbsCount / LongBits,
+        RelWords = (RelCount + LongBits - 1) / LongBits,
+        FfWords = FfCount / LongBits
+    };
+
+    //struct input_absinfo with a fixed layout for the cache file
+    struct AbsInfo {
+        qint32 value;
+        qint32 minimum;
+        qint32 maximum;
+        qint32 fuzz;
+        qint32 flat;
+        qint32 resolution;
+    };
+
+    QGamepadDeviceCapabilities();
+
+    //EVIOCGID and EVIOCGNAME, what the cache is keyed by
+    bool readIdentity(int fd);
+    //Bitmaps of every event type and the absinfo of the axes present
+    bool probe(int fd);
+    //EVIOCGABS of the axes in absBits
+    void readAbsInfo(int fd);
+    QByteArray key() const;
+
+    static bool testBit(const ulong *bits, int bit) { return bits[bit / LongBits] & (1UL << (bit % LongBits)); }
+
+    quint16 bus;
+    quint16 vendor;
+    quint16 product;
+    quint16 version;
+    QByteArray name;
+    ulong keyBits[KeyWords];
+    ulong absBits[AbsWords];
+    ulong relBits[RelWords];
+    ulong ffBits[FfWords];
+    //Force feedback effects the device can hold at once
+    qint32 effectCount;
+    AbsInfo absInfo[QGamepadHandler::AbsCount];
+};
+
+//Capabilities of every device seen, kept in the cache directory across
+//runs. A known device is only checked with the ioctls for its identity
+//and its axes instead of being probed again. Thread safe, so
+//several devices can be probed at once.
+class QGamepadCapabilityCache
+{
+public:
+    QGamepadCapabilityCache();
+
+    //Fills capabilities for the device open on fd, from the cache when
+    //the device still matches it. probed is set when it did not.
+    bool capabilities(int fd, QGamepadDeviceCapabilities *capabilities, bool *probed = 0);
+    //Writes the cache if devices were probed since it was read
+    void save();
+
+private:
+    void load();
+
+    QMutex m_mutex;
+    QString m_fileName;
+    QHash<QByteArray, QGamepadDeviceCapabilities> m_devices;
+    bool m_loaded;
+    bool m_dirty;
+};
+
+QT_END_NAMESPACE
+
+#endif // QGAMEPADCAPABILITYCACHE_P_H
@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "qgamepadcombodetector.h"
+#include "qgamepadinputstate.h"
+
+#include <linux/input.h>
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+static const int LongBits = 8 * sizeof(ulong);
+
+//D-pad directions reported as buttons by mapped controllers
+enum {
+    DpadUp = 0x1,
+    DpadDown = 0x2,
+    DpadLeft = 0x4,
+    DpadRight = 0x8
+};
+
+QGamepadComboDetector::QGamepadComboDetector(QObject *parent)
+    : QObject(parent)
+    , m_holdTime(300000)
+    , m_doubleTapWindow(250000)
+    , m_dirty(true)
+    , m_columnCount(0)
+{
+}
+
+QGamepadComboDetector::~QGamepadComboDetector()
+{
+    qDeleteAll(m_devices);
+}
+
+int QGamepadComboDetector::addSequence(const QString &name, const QList<QList<int> > &steps, int stepWindow, int chordWindow)
+{
+    if (steps.isEmpty() || steps.count() > MaxSteps)
+        return -1;
+
+    Pattern pattern;
+    pattern.name = name;
+    pattern.stepWindow = quint64(stepWindow) * 1000;
+
+    foreach (const QList<int> &step, steps) {
+        QVector<int> tokens;
+        foreach (int token, step) {
+            if (token < 0 || token >= TokenCount || token == Direction_Neutral)
+                return -1;
+            if (!tokens.contains(token))
+                tokens.append(token);
+        }
+        if (tokens.isEmpty())
+            return -1;
+
+        if (tokens.count() == 1) {
+            pattern.symbols.append(tokens.first());
+        } else {
+            qSort(tokens);
+            pattern.symbols.append(chordSymbol(tokens, quint64(chordWindow) * 1000));
+        }
+    }
+
+    m_patterns.append(pattern);
+    m_dirty = true;
+    return m_patterns.count() - 1;
+}
+
+int QGamepadComboDetector::addChord(const QString &name, const QList<int> &tokens, int chordWindow)
+{
+    QList<QList<int> > steps;
+    steps.append(tokens);
+    return addSequence(name, steps, 0, chordWindow);
+}
+
+int QGamepadComboDetector::chordSymbol(const QVector<int> &tokens, quint64 window)
+{
+    for (int i = 0; i < m_chords.count(); ++i) {
+        if (m_chords.at(i).tokens == tokens && m_chords.at(i).window == window)
+            return TokenCount + i;
+    }
+
+    Chord chord;
+    chord.tokens = tokens;
+    chord.window = window;
+    m_chords.append(chord);
+    return TokenCount + m_chords.count() - 1;
+}
+
+QString QGamepadComboDetector::comboName(int combo) const
+{
+    if (combo < 0 || combo >= m_patterns.count())
+        return QString();
+    return m_patterns.at(combo).name;
+}
+
+void QGamepadComboDetector::clear()
+{
+    m_patterns.clear();
+    m_chords.clear();
+    m_dirty = true;
+}
+
+void QGamepadComboDetector::compile()
+{
+    m_dirty = false;
+
+    int symbolCount = TokenCount + m_chords.count();
+    m_symbolColumns.fill(-1, symbolCount);
+    m_columnCount = 0;
+    foreach (const Pattern &pattern, m_patterns) {
+        foreach (int symbol, pattern.symbols) {
+            if (m_symbolColumns.at(symbol) < 0)
+                m_symbolColumns[symbol] = m_columnCount++;
+        }
+    }
+
+    m_tokenChords.fill(QVector<int>(), TokenCount);
+    for (int i = 0; i < m_chords.count(); ++i) {
+        foreach (int token, m_chords.at(i).tokens)
+            m_tokenChords[token].append(i);
+    }
+
+    //Trie of all patterns, -1 marks a missing edge
+    int columns = m_columnCount;
+    m_transitions.fill(-1, columns);
+    m_outputs.fill(QVector<int>(), 1);
+    for (int i = 0; i < m_patterns.count(); ++i) {
+        int state = 0;
+        foreach (int symbol, m_patterns.at(i).symbols) {
+            int edge = state * columns + m_symbolColumns.at(symbol);
+            if (m_transitions.at(edge) < 0) {
+                m_transitions[edge] = m_outputs.count();
+                m_outputs.append(QVector<int>());
+                m_transitions.resize(m_outputs.count() * columns);
+                for (int c = 0; c < columns; ++c)
+                    m_transitions[m_transitions.at(edge) * columns + c] = -1;
+            }
+            state = m_transitions.at(edge);
+        }
+        m_outputs[state].append(i);
+    }
+
+    //Breadth first over the trie, turning failure links into direct
+    //transitions so that matching never has to follow them
+    QVector<int> failure(m_outputs.count(), 0);
+    QVector<int> queue;
+    for (int c = 0; c < columns; ++c) {
+        int &next = m_transitions[c];
+        if (next < 0) {
+            next = 0;
+        } else {
+            failure[next] = 0;
+            queue.append(next);
+        }
+    }
+
+    for (int i = 0; i < queue.count(); ++i) {
+        int state = queue.at(i);
+        m_outputs[state] += m_outputs.at(failure.at(state));
+
+        for (int c = 0; c < columns; ++c) {
+            int fallback = m_transitions.at(failure.at(state) * columns + c);
+            int &next = m_transitions[state * columns + c];
+            if (next < 0) {
+                next = fallback;
+            } else {
+                failure[next] = fallback;
+                queue.append(next);
+            }
+        }
+    }
+
+    //States of the old automaton mean nothing in the new one
+    foreach (DeviceState *device, m_devices) {
+        if (device) {
+            device->state = 0;
+            device->historyCount = 0;
+        }
+    }
+}
+
+QGamepadComboDetector::DeviceState *QGamepadComboDetector::deviceState(QGamepadInfo *info)
+{
+    int id = info->id();
+    if (id >= m_devices.count())
+        m_devices.resize(id + 1);
+
+    DeviceState *device = m_devices.at(id);
+    if (!device) {
+        device = new DeviceState;
+        m_devices[id] = device;
+    } else if (device->generation == info->generation()) {
+        return device;
+    }
+
+    //New, or the slot was given to another device since
+    memset(device, 0, sizeof(DeviceState));
+    device->generation = info->generation();
+    device->direction = Direction_Neutral;
+    return device;
+}
+
+void QGamepadComboDetector::processGamepadEvent(QGamepadInfo *info, quint64 time, int type, int number, int value)
+{
+    if (m_dirty)
+        compile();
+    processEvent(deviceState(info), info->id(), time, type, number, value);
+}
+
+void QGamepadComboDetector::processGamepadFrame(QGamepadInfo *info, const QGamepadHandler::GamepadFrame &frame)
+{
+    if (m_dirty)
+        compile();
+
+    DeviceState *device = deviceState(info);
+    for (int i = 0; i < frame.count; ++i) {
+        const QGamepadHandler::GamepadEvent &event = frame.events[i];
+        processEvent(device, info->id(), frame.time, event.type, event.code, event.value);
+    }
+}
+
+void QGamepadComboDetector::processEvent(DeviceState *device, int id, quint64 time, int type, int number, int value)
+{
+    if (type == QGamepadHandler::Hat) {
+        if (number == ABS_HAT0X)
+            device->hatX = value;
+        else if (number == ABS_HAT0Y)
+            device->hatY = value;
+        else
+            return;
+        updateDirection(device, id, time);
+        return;
+    }
+
+    if (type != QGamepadHandler::Button || number < 0 || number >= QGamepadHandler::KeyCount)
+        return;
+
+    //D-pad buttons only count as directions
+    if (number >= QGamepadInputState::Gamepad_Up1 && number <= QGamepadInputState::Gamepad_Right1) {
+        int bit = 1 << (number - QGamepadInputState::Gamepad_Up1);
+        if (value)
+            device->dpadButtons |= bit;
+        else
+            device->dpadButtons &= ~bit;
+        updateDirection(device, id, time);
+        return;
+    }
+
+    bool held = device->held[number / LongBits] & (1UL << (number % LongBits));
+    if (value && !held)
+        press(device, id, number, time);
+    else if (!value && held)
+        release(device, id, number, time);
+}
+
+void QGamepadComboDetector::updateDirection(DeviceState *device, int id, quint64 time)
+{
+    int x = device->hatX;
+    int y = -device->hatY;
+    if (device->dpadButtons & DpadRight)
+        x = 1;
+    if (device->dpadButtons & DpadLeft)
+        x = -1;
+    if (device->dpadButtons & DpadUp)
+        y = 1;
+    if (device->dpadButtons & DpadDown)
+        y = -1;
+
+    int direction = Direction_Neutral + qBound(-1, x, 1) + 3 * qBound(-1, y, 1);
+    if (direction == device->direction)
+        return;
+
+    if (device->direction != Direction_Neutral)
+        release(device, id, device->direction, time);
+    device->direction = direction;
+    if (direction != Direction_Neutral)
+        press(device, id, direction, time);
+}
+
+void QGamepadComboDetector::press(DeviceState *device, int id, int token, quint64 time)
+{
+    device->held[token / LongBits] |= 1UL << (token % LongBits);
+    device->pressTime[token] = time;
+
+    feed(device, id, token, time);
+
+    //Of the chords this press completes only the largest counts
+    int completed = -1;
+    foreach (int chord, m_tokenChords.at(token)) {
+        const Chord &candidate = m_chords.at(chord);
+        bool complete = true;
+        foreach (int member, candidate.tokens) {
+            if (!(device->held[member / LongBits] & (1UL << (member % LongBits)))
+                    || time - device->pressTime[member] > candidate.window) {
+                complete = false;
+                break;
+            }
+        }
+        if (complete && (completed < 0 || candidate.tokens.count() > m_chords.at(completed).tokens.count()))
+            completed = chord;
+    }
+
+    if (completed < 0)
+        return;
+
+    //The members were fed one by one, take them back so the chord
+    //replaces them in the sequence
+    const Chord &chord = m_chords.at(completed);
+    while (device->historyCount) {
+        const HistoryEntry &last = device->history[(device->historyHead + HistorySize - 1) % HistorySize];
+        if (!chord.tokens.contains(last.symbol) || time - last.time > chord.window)
+            break;
+        device->state = last.stateBefore;
+        device->historyHead = (device->historyHead + HistorySize - 1) % HistorySize;
+        --device->historyCount;
+    }
+
+    feed(device, id, TokenCount + completed, time);
+}
+
+void QGamepadComboDetector::release(DeviceState *device, int id, int token, quint64 time)
+{
+    device->held[token / LongBits] &= ~(1UL << (token % LongBits));
+    if (token >= QGamepadHandler::KeyCount)
+        return;
+
+    quint64 duration = time - device->pressTime[token];
+    if (duration >= m_holdTime) {
+        emit buttonHeld(token, id, duration);
+    } else if (device->lastTap[token] && time - device->lastTap[token] <= m_doubleTapWindow) {
+        device->lastTap[token] = 0;
+        emit buttonDoubleTapped(token, id, time);
+    } else {
+        device->lastTap[token] = time;
+        emit buttonTapped(token, id, time);
+    }
+}
+
+void QGamepadComboDetector::feed(DeviceState *device, int id, int symbol, quint64 time)
+{
+    HistoryEntry &entry = device->history[device->historyHead];
+    entry.stateBefore = device->state;
+    entry.symbol = symbol;
+    entry.time = time;
+    device->historyHead = (device->historyHead + 1) % HistorySize;
+    if (device->historyCount < HistorySize)
+        ++device->historyCount;
+
+    //Symbols no pattern uses break every sequence in progress
+    int column = symbol < m_symbolColumns.count() ? m_symbolColumns.at(symbol) : -1;
+    device->state = column < 0 ? 0 : m_transitions.at(device->state * m_columnCount + column);
+
+    //The automaton matched the symbols, the history tells whether the
+    //steps came quickly enough
+    foreach (int combo, m_outputs.at(device->state)) {
+        const Pattern &pattern = m_patterns.at(combo);
+        int steps = pattern.symbols.count();
+        if (steps > device->historyCount)
+            continue;
+
+        bool inTime = true;
+        for (int i = 1; i < steps && inTime; ++i) {
+            const HistoryEntry &later = device->history[(device->historyHead + HistorySize - i) % HistorySize];
+            const HistoryEntry &earlier = device->history[(device->historyHead + HistorySize - i - 1) % HistorySize];
+            inTime = later.time - earlier.time <= pattern.stepWindow;
+        }
+        if (inTime)
+            emit comboDetected(combo, id, time);
+    }
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADCOMBODETECTOR_H
+#define QGAMEPADCOMBODETECTOR_H
+
+#include <QtCore/QObject>
+#include <QtCore/QList>
+#include <QtCore/QVector>
+#include <QtGamepad/qtgamepadglobal.h>
+#include <QtGamepad/qgamepadmanager.h>
+
+QT_BEGIN_HEADER
+
+QT_BEGIN_NAMESPACE
+
+//Detects chords, button sequences with timing windows, and taps, double
+//taps and holds from the timestamped events of QGamepadManager. All
+//timing is measured on the kernel timestamps of the events.
+//
+//Patterns are made of press tokens: gamepad button codes and the
+//directions of the first d-pad. Registered patterns are compiled into a
+//single Aho-Corasick automaton, so every press costs one table lookup
+//however many combos are registered.
+class Q_GAMEPAD_EXPORT QGamepadComboDetector : public QObject
+{
+    Q_OBJECT
+public:
+    //D-pad directions in numpad notation, Direction_Neutral is never a token
+    enum Direction {
+        Direction_DownLeft = QGamepadHandler::KeyCount + 1,
+        Direction_Down,
+        Direction_DownRight,
+        Direction_Left,
+        Direction_Neutral,
+        Direction_Right,
+        Direction_UpLeft,
+        Direction_Up,
+        Direction_UpRight
+    };
+
+    enum { MaxSteps = 32 };
+
+    explicit QGamepadComboDetector(QObject *parent = 0);
+    ~QGamepadComboDetector();
+
+    //Every step is a list of tokens pressed together within chordWindow
+    //ms, every step has to follow the previous one within stepWindow ms.
+    //Returns the id passed to comboDetected(), or -1 for an invalid pattern.
+    int addSequence(const QString &name, const QList<QList<int> > &steps, int stepWindow = 250, int chordWindow = 50);
+    int addChord(const QString &name, const QList<int> &tokens, int chordWindow = 50);
+    QString comboName(int combo) const;
+    int comboCount() const { return m_patterns.count(); }
+    void clear();
+
+    //Releases are classified as a hold when the button was down for at
+    //least holdTime ms, otherwise as a tap. A tap within doubleTapWindow
+    //ms of the previous tap of the same button is a double tap, the
+    //first tap has been reported as such already.
+    int holdTime() const { return m_holdTime / 1000; }
+    void setHoldTime(int msecs) { m_holdTime = quint64(msecs) * 1000; }
+    int doubleTapWindow() const { return m_doubleTapWindow / 1000; }
+    void setDoubleTapWindow(int msecs) { m_doubleTapWindow = quint64(msecs) * 1000; }
+
+public slots:
+    void processGamepadEvent(QGamepadInfo *info, quint64 time, int type, int number, int value);
+    void processGamepadFrame(QGamepadInfo *info, const QGamepadHandler::GamepadFrame &frame);
+
+signals:
+    void comboDetected(int combo, int id, quint64 time);
+    void buttonTapped(int button, int id, quint64 time);
+    void buttonDoubleTapped(int button, int id, quint64 time);
+    void buttonHeld(int button, int id, quint64 duration);
+
+private:
+    enum {
+        TokenCount = Direction_UpRight + 1,
+        TokenWords = (TokenCount + 8 * sizeof(ulong) - 1) / (8 * sizeof(ulong)),
+        HistorySize = MaxSteps
+    };
+
+    struct Pattern {
+        QString name;
+        QVector<int> symbols;
+        quint64 stepWindow;
+    };
+
+    struct Chord {
+        QVector<int> tokens;
+        quint64 window;
+    };
+
+    struct HistoryEntry {
+        int stateBefore;
+        int symbol;
+        quint64 time;
+    };
+
+    struct DeviceState {
+        quint32 generation;
+        int state;
+        HistoryEntry history[HistorySize];
+        int historyHead;
+        int historyCount;
+        ulong held[TokenWords];
+        quint64 pressTime[TokenCount];
+        quint64 lastTap[QGamepadHandler::KeyCount];
+        int hatX;
+        int hatY;
+        int dpadButtons;
+        int direction;
+    };
+
+    DeviceState *deviceState(QGamepadInfo *info);
+    void processEvent(DeviceState *device, int id, quint64 time, int type, int number, int value);
+    void updateDirection(DeviceState *device, int id, quint64 time);
+    void press(DeviceState *device, int id, int token, quint64 time);
+    void release(DeviceState *device, int id, int token, quint64 time);
+    void feed(DeviceState *device, int id, int symbol, quint64 time);
+    int chordSymbol(const QVector<int> &tokens, quint64 window);
+    void compile();
+
+    QVector<Pattern> m_patterns;
+    QVector<Chord> m_chords;
+    QVector<DeviceState*> m_devices;
+    quint64 m_holdTime;
+    quint64 m_doubleTapWindow;
+
+    //Compiled automaton, rebuilt when patterns were added. Symbols are
+    //tokens followed by chords, only those used by a pattern get a column.
+    bool m_dirty;
+    int m_columnCount;
+    QVector<int> m_symbolColumns;
+    QVector<int> m_transitions;
+    QVector<QVector<int> > m_outputs;
+    //Chords each token takes part in
+    QVector<QVector<int> > m_tokenChords;
+};
+
+QT_END_NAMESPACE
+
+QT_END_HEADER
+
+#endif // QGAMEPADCOMBODETECTOR_H
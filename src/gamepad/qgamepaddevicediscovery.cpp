@@ -78,15 +78,14 @@ QStringList QGamepadDeviceDiscovery::scanConnectedDevices()
         return devices;
     }
 
+    //Event nodes are named after their sysfs directory, so the node can be
+    //had from the path without creating a udev_device for every entry
     udev_list_entry *entry;
     udev_list_entry_foreach (entry, udev_enumerate_get_list_entry(ue)) {
-        const char *syspath = udev_list_entry_get_name(entry);
-        udev_device *udevice = udev_device_new_from_syspath(m_udev, syspath);
-        QString candidate = QString::fromUtf8(udev_device_get_devnode(udevice));
-        if (candidate.startsWith(QLatin1String("/dev/input/event")))
-            devices << candidate;
-
-        udev_device_unref(udevice);
+        QByteArray syspath(udev_list_entry_get_name(entry));
+        QByteArray name = syspath.mid(syspath.lastIndexOf('/') + 1);
+        if (name.startsWith("event"))
+            devices << QLatin1String("/dev/input/") + QString::fromLatin1(name);
     }
     udev_enumerate_unref(ue);
 
@@ -112,7 +111,15 @@ void QGamepadDeviceDiscovery::handleUDevNotification()
 
     const char *str;
     str = udev_device_get_devnode(dev);
-    if (!str)
+    if (!str || qstrncmp(str, "/dev/input/event", 16) != 0)
+        goto cleanup;
+    devNode = QString::fromUtf8(str);
+
+    //Same filter as scanConnectedDevices(), keyboards and mice are input
+    //devices too
+    const char *joystick;
+    joystick = udev_device_get_property_value(dev, "ID_INPUT_JOYSTICK");
+    if (!joystick || qstrcmp(joystick, "1") != 0)
         goto cleanup;
 
     if (qstrcmp(action, "add") == 0)
@@ -55,6 +55,8 @@ private:
     struct udev_monitor *m_udevMonitor;
     int m_udevMonitorFileDescriptor;
     QSocketNotifier *m_udevSocketNotifier;
+
+    friend class QGamepadMultiplexer;
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "qgamepadevdevbackend_p.h"
+
+#include "qgamepadhandler.h"
+#include "qgamepaddevicediscovery_p.h"
+
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <qplatformdefs.h>
+
+QT_BEGIN_NAMESPACE
+
+//Opens and probes one device on a pool thread
+class QGamepadProbeTask : public QRunnable
+{
+public:
+    QGamepadProbeTask(QGamepadCapabilityCache *cache, const QString &deviceNode)
+        : m_cache(cache)
+        , deviceNode(deviceNode)
+        , fd(-1)
+        , probed(false)
+    {
+        setAutoDelete(false);
+    }
+
+    void run()
+    {
+        fd = QGamepadHandler::openDevice(deviceNode);
+        if (fd >= 0 && !m_cache->capabilities(fd, &capabilities, &probed)) {
+            QT_CLOSE(fd);
+            fd = -1;
+        }
+    }
+
+private:
+    QGamepadCapabilityCache *m_cache;
+
+public:
+    QString deviceNode;
+    int fd;
+    bool probed;
+    QGamepadDeviceCapabilities capabilities;
+};
+
+//Writes the capability cache on a pool thread
+class QGamepadCacheSaveTask : public QRunnable
+{
+public:
+    QGamepadCacheSaveTask(QGamepadCapabilityCache *cache)
+        : m_cache(cache)
+    {
+    }
+
+    void run()
+    {
+        m_cache->save();
+    }
+
+private:
+    QGamepadCapabilityCache *m_cache;
+};
+
+QGamepadEvdevBackend::QGamepadEvdevBackend(QObject *parent)
+    : QGamepadBackend(parent)
+{
+    m_savePool.setMaxThreadCount(1);
+
+    m_deviceDiscovery = QGamepadDeviceDiscovery::create(this);
+    if (m_deviceDiscovery) {
+        connect(m_deviceDiscovery, SIGNAL(deviceDetected(QString)), this, SIGNAL(deviceDetected(QString)));
+        connect(m_deviceDiscovery, SIGNAL(deviceRemoved(QString)), this, SIGNAL(deviceRemoved(QString)));
+    }
+}
+
+QGamepadEvdevBackend::~QGamepadEvdevBackend()
+{
+    //Probed devices the manager never asked for
+    foreach (const OpenDevice &device, m_openDevices)
+        QT_CLOSE(device.fd);
+}
+
+QStringList QGamepadEvdevBackend::scanConnectedDevices()
+{
+    if (!m_deviceDiscovery)
+        return QStringList();
+    QStringList devices = m_deviceDiscovery->scanConnectedDevices();
+
+    //Devices behind slow hubs answer their ioctls one at a time, so
+    //probe them all at once
+    QList<QGamepadProbeTask*> tasks;
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMax(devices.count(), 1));
+    foreach (const QString &device, devices) {
+        if (m_openDevices.contains(device))
+            continue;
+        QGamepadProbeTask *task = new QGamepadProbeTask(&m_capabilityCache, device);
+        tasks.append(task);
+        pool.start(task);
+    }
+    pool.waitForDone();
+
+    bool probed = false;
+    foreach (QGamepadProbeTask *task, tasks) {
+        probed |= task->probed;
+        if (task->fd >= 0) {
+            OpenDevice device;
+            device.fd = task->fd;
+            device.capabilities = task->capabilities;
+            m_openDevices.insert(task->deviceNode, device);
+        }
+    }
+    qDeleteAll(tasks);
+
+    if (probed)
+        saveCapabilityCache();
+    return devices;
+}
+
+QGamepadHandler *QGamepadEvdevBackend::createHandler(const QString &deviceNode)
+{
+    if (m_openDevices.contains(deviceNode)) {
+        OpenDevice device = m_openDevices.take(deviceNode);
+        return QGamepadHandler::create(deviceNode, device.fd, device.capabilities);
+    }
+
+    int fd = QGamepadHandler::openDevice(deviceNode);
+    if (fd < 0)
+        return 0;
+
+    QGamepadDeviceCapabilities capabilities;
+    bool probed;
+    if (!m_capabilityCache.capabilities(fd, &capabilities, &probed)) {
+        QT_CLOSE(fd);
+        return 0;
+    }
+    if (probed)
+        saveCapabilityCache();
+    return QGamepadHandler::create(deviceNode, fd, capabilities);
+}
+
+void QGamepadEvdevBackend::saveCapabilityCache()
+{
+    //Writes run one after the other, one queued behind another that
+    //already wrote everything returns without touching the file
+    m_savePool.start(new QGamepadCacheSaveTask(&m_capabilityCache));
+}
+
+QT_END_NAMESPACE
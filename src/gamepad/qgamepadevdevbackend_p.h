@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADEVDEVBACKEND_P_H
+#define QGAMEPADEVDEVBACKEND_P_H
+
+#include <QtCore/QHash>
+#include <QtCore/QThreadPool>
+#include <QtGamepad/qgamepadbackend.h>
+#include "qgamepadcapabilitycache_p.h"
+
+QT_BEGIN_NAMESPACE
+
+//Linux evdev devices, discovered and hotplugged through udev.
+//Capabilities come from a QGamepadCapabilityCache, and the devices found
+//by scanConnectedDevices() are opened and probed in parallel.
+class QGamepadEvdevBackend : public QGamepadBackend
+{
+    Q_OBJECT
+public:
+    explicit QGamepadEvdevBackend(QObject *parent = 0);
+    ~QGamepadEvdevBackend();
+
+    QStringList scanConnectedDevices();
+    QGamepadHandler *createHandler(const QString &deviceNode);
+    QGamepadDeviceDiscovery *deviceDiscovery() const { return m_deviceDiscovery; }
+
+private:
+    struct OpenDevice {
+        int fd;
+        QGamepadDeviceCapabilities capabilities;
+    };
+
+    void saveCapabilityCache();
+
+    QGamepadDeviceDiscovery *m_deviceDiscovery;
+    QGamepadCapabilityCache m_capabilityCache;
+    //Writes the cache off the GUI thread, declared after the cache so a
+    //pending write finishes before the cache is destroyed
+    QThreadPool m_savePool;
+    //Probed by scanConnectedDevices(), waiting for createHandler()
+    QHash<QString, OpenDevice> m_openDevices;
+};
+
+QT_END_NAMESPACE
+
+#endif // QGAMEPADEVDEVBACKEND_P_H
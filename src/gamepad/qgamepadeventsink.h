@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADEVENTSINK_H
+#define QGAMEPADEVENTSINK_H
+
+#include <QtGamepad/qtgamepadglobal.h>
+#include <QtGamepad/qgamepadhandler.h>
+
+QT_BEGIN_HEADER
+
+QT_BEGIN_NAMESPACE
+
+//Receives decoded input through a plain virtual call, without signals,
+//queued connections or allocations. A frame holds the events between two
+//SYN_REPORTs, slot is the device's QGamepadInfo::id() or -1 for a
+//handler the manager does not own.
+//
+//Sinks are called on the thread decoding the device. In
+//QGamepadManager::ThreadedReading that is the thread calling
+//QGamepadManager::processPendingFrames().
+class Q_GAMEPAD_EXPORT QGamepadEventSink
+{
+public:
+    virtual ~QGamepadEventSink() {}
+    virtual void processGamepadFrame(int slot, const QGamepadHandler::GamepadFrame &frame) = 0;
+};
+
+QT_END_NAMESPACE
+
+QT_END_HEADER
+
+#endif // QGAMEPADEVENTSINK_H
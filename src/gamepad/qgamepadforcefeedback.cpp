@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "qgamepadforcefeedback_p.h"
+
+#include <QtCore/QMutexLocker>
+#include <qplatformdefs.h>
+
+#include <errno.h>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+//Plenty for rumble and a few periodic effects, devices may allow far more
+static const int MaxCachedEffects = 16;
+
+QGamepadForceFeedback::QGamepadForceFeedback(int fd, int effectCount)
+    : m_fd(fd)
+    , m_capacity(qBound(1, effectCount, MaxCachedEffects))
+    , m_clock(0)
+    , m_playing(-1)
+    , m_writer(0)
+    , m_hasPending(false)
+    , m_executing(false)
+{
+    memset(&m_pending, 0, sizeof(m_pending));
+    m_cache.reserve(m_capacity);
+}
+
+QGamepadForceFeedback::~QGamepadForceFeedback()
+{
+    setWriter(0);
+    foreach (const CachedEffect &cached, m_cache)
+        ioctl(m_fd, EVIOCRMFF, cached.id);
+}
+
+void QGamepadForceFeedback::setWriter(QGamepadForceFeedbackWriter *writer)
+{
+    if (m_writer)
+        m_writer->removeDevice(this);
+    m_writer = writer;
+}
+
+void QGamepadForceFeedback::submit(const Command &command)
+{
+    if (m_writer)
+        m_writer->submit(this, command);
+    else
+        execute(command);
+}
+
+void QGamepadForceFeedback::execute(const Command &command)
+{
+    //Stop and play go out together in one write
+    struct input_event events[2];
+    int count = 0;
+    memset(events, 0, sizeof(events));
+
+    int id = -1;
+    if (!command.stop) {
+        int index = -1;
+        for (int i = 0; i < m_cache.count(); ++i) {
+            if (m_cache.at(i).effect == command.effect) {
+                index = i;
+                break;
+            }
+        }
+
+        if (index < 0) {
+            if (m_cache.count() < m_capacity) {
+                CachedEffect cached;
+                cached.effect = command.effect;
+                cached.id = upload(command.effect, -1);
+                if (cached.id < 0)
+                    return;
+                m_cache.append(cached);
+                index = m_cache.count() - 1;
+            } else {
+                //Reuse the slot of the least recently played effect
+                index = 0;
+                for (int i = 1; i < m_cache.count(); ++i) {
+                    if (m_cache.at(i).lastPlayed < m_cache.at(index).lastPlayed)
+                        index = i;
+                }
+                if (m_cache.at(index).id == m_playing)
+                    m_playing = -1;
+                if (upload(command.effect, m_cache.at(index).id) < 0) {
+                    //The old effect may still hold the slot in the device
+                    ioctl(m_fd, EVIOCRMFF, m_cache.at(index).id);
+                    m_cache.remove(index);
+                    return;
+                }
+                m_cache[index].effect = command.effect;
+            }
+        }
+
+        m_cache[index].lastPlayed = ++m_clock;
+        id = m_cache.at(index).id;
+    }
+
+    if (m_playing >= 0 && m_playing != id) {
+        events[count].type = EV_FF;
+        events[count].code = m_playing;
+        events[count].value = 0;
+        ++count;
+    }
+    if (id >= 0) {
+        events[count].type = EV_FF;
+        events[count].code = id;
+        events[count].value = 1;
+        ++count;
+    }
+    m_playing = id;
+
+    if (count && QT_WRITE(m_fd, events, count * sizeof(struct input_event)) < 0)
+        qWarning("Cannot play gamepad force feedback effect: %s", strerror(errno));
+}
+
+int QGamepadForceFeedback::upload(const Effect &effect, int id)
+{
+    struct ff_effect ff;
+    memset(&ff, 0, sizeof(ff));
+    ff.type = effect.type;
+    ff.id = id;
+    ff.replay.length = effect.duration;
+
+    if (effect.type == FF_RUMBLE) {
+        ff.u.rumble.strong_magnitude = effect.strongMagnitude;
+        ff.u.rumble.weak_magnitude = effect.weakMagnitude;
+    } else {
+        ff.u.periodic.waveform = effect.waveform;
+        ff.u.periodic.period = effect.period;
+        ff.u.periodic.magnitude = effect.magnitude;
+    }
+
+    if (ioctl(m_fd, EVIOCSFF, &ff) < 0) {
+        qWarning("Cannot upload gamepad force feedback effect: %s", strerror(errno));
+        return -1;
+    }
+    return ff.id;
+}
+
+QGamepadForceFeedbackWriter::QGamepadForceFeedbackWriter(QObject *parent)
+    : QThread(parent)
+    , m_stopRequested(false)
+{
+}
+
+QGamepadForceFeedbackWriter::~QGamepadForceFeedbackWriter()
+{
+    stop();
+}
+
+void QGamepadForceFeedbackWriter::submit(QGamepadForceFeedback *device, const QGamepadForceFeedback::Command &command)
+{
+    QMutexLocker locker(&m_mutex);
+    device->m_pending = command;
+    if (!device->m_hasPending) {
+        device->m_hasPending = true;
+        m_queue.append(device);
+    }
+
+    if (!isRunning())
+        start();
+    m_wake.wakeOne();
+}
+
+void QGamepadForceFeedbackWriter::removeDevice(QGamepadForceFeedback *device)
+{
+    QMutexLocker locker(&m_mutex);
+    int index = m_queue.indexOf(device);
+    if (index >= 0)
+        m_queue.remove(index);
+    device->m_hasPending = false;
+
+    while (device->m_executing)
+        m_idle.wait(&m_mutex);
+}
+
+void QGamepadForceFeedbackWriter::stop()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopRequested = true;
+        m_wake.wakeOne();
+    }
+    wait();
+
+    QMutexLocker locker(&m_mutex);
+    m_stopRequested = false;
+}
+
+void QGamepadForceFeedbackWriter::run()
+{
+    QMutexLocker locker(&m_mutex);
+    forever {
+        while (m_queue.isEmpty() && !m_stopRequested)
+            m_wake.wait(&m_mutex);
+        if (m_stopRequested)
+            break;
+
+        QGamepadForceFeedback *device = m_queue.first();
+        m_queue.remove(0);
+        QGamepadForceFeedback::Command command = device->m_pending;
+        device->m_hasPending = false;
+        device->m_executing = true;
+
+        locker.unlock();
+        device->execute(command);
+        locker.relock();
+
+        device->m_executing = false;
+        m_idle.wakeAll();
+    }
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADFORCEFEEDBACK_P_H
+#define QGAMEPADFORCEFEEDBACK_P_H
+
+#include <QtCore/QThread>
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
+
+QT_BEGIN_NAMESPACE
+
+class QGamepadForceFeedbackWriter;
+
+//EV_FF effects of one device. Uploaded effects are cached by their
+//parameters, so playing a known effect again is a single write() of the
+//play event. When the cache is full the least recently played effect is
+//overwritten in place.
+class QGamepadForceFeedback
+{
+public:
+    struct Effect {
+        quint16 type;
+        quint16 waveform;
+        quint16 strongMagnitude;
+        quint16 weakMagnitude;
+        qint16 magnitude;
+        quint16 period;
+        quint16 duration;
+
+        bool operator==(const Effect &other) const
+        {
+            return type == other.type && waveform == other.waveform
+                && strongMagnitude == other.strongMagnitude && weakMagnitude == other.weakMagnitude
+                && magnitude == other.magnitude && period == other.period && duration == other.duration;
+        }
+    };
+
+    struct Command {
+        bool stop;
+        Effect effect;
+    };
+
+    //fd has to be open for writing and stays owned by the caller
+    QGamepadForceFeedback(int fd, int effectCount);
+    ~QGamepadForceFeedback();
+
+    //Without a writer, commands run on the calling thread
+    void setWriter(QGamepadForceFeedbackWriter *writer);
+    void submit(const Command &command);
+
+    //Only ever called by one thread at a time
+    void execute(const Command &command);
+
+private:
+    int upload(const Effect &effect, int id);
+
+    struct CachedEffect {
+        Effect effect;
+        int id;
+        quint64 lastPlayed;
+    };
+
+    int m_fd;
+    int m_capacity;
+    QVector<CachedEffect> m_cache;
+    quint64 m_clock;
+    int m_playing;
+    QGamepadForceFeedbackWriter *m_writer;
+
+    friend class QGamepadForceFeedbackWriter;
+    //Guarded by the writer's mutex
+    Command m_pending;
+    bool m_hasPending;
+    bool m_executing;
+};
+
+//One thread doing the uploads and writes of every device, so a slow
+//Bluetooth pad never blocks the caller. Only the latest command of each
+//device is kept while the thread is busy.
+class QGamepadForceFeedbackWriter : public QThread
+{
+    Q_OBJECT
+public:
+    explicit QGamepadForceFeedbackWriter(QObject *parent = 0);
+    ~QGamepadForceFeedbackWriter();
+
+    void submit(QGamepadForceFeedback *device, const QGamepadForceFeedback::Command &command);
+    //Drops pending commands and waits for one being executed
+    void removeDevice(QGamepadForceFeedback *device);
+    void stop();
+
+protected:
+    void run();
+
+private:
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    QWaitCondition m_idle;
+    QVector<QGamepadForceFeedback*> m_queue;
+    bool m_stopRequested;
+};
+
+QT_END_NAMESPACE
+
+#endif // QGAMEPADFORCEFEEDBACK_P_H
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADFRAMERING_P_H
+#define QGAMEPADFRAMERING_P_H
+
+#include <QtCore/QAtomicInt>
+#include <QtGamepad/qgamepadhandler.h>
+
+QT_BEGIN_NAMESPACE
+
+//Bounded single-producer/single-consumer queue of decoded frames.
+//push() is only called by the thread reading the device and pop() only
+//by the thread draining it, so neither side needs a lock.
+class QGamepadFrameRing
+{
+public:
+    enum { Capacity = 64 };
+
+    QGamepadFrameRing()
+        : m_head(0)
+        , m_tail(0)
+        , m_overflowCount(0)
+    {}
+
+    bool push(const QGamepadHandler::GamepadFrame &frame)
+    {
+        uint head = m_head.load();
+        uint tail = m_tail.loadAcquire();
+
+        //Full, drop the newest frame and remember we did so
+        if (head - tail == Capacity) {
+            m_overflowCount.fetchAndAddRelaxed(1);
+            return false;
+        }
+
+        copyFrame(&m_frames[head & (Capacity - 1)], frame);
+        m_head.storeRelease(head + 1);
+        return true;
+    }
+
+    bool pop(QGamepadHandler::GamepadFrame *frame)
+    {
+        uint tail = m_tail.load();
+        uint head = m_head.loadAcquire();
+
+        if (head == tail)
+            return false;
+
+        copyFrame(frame, m_frames[tail & (Capacity - 1)]);
+        m_tail.storeRelease(tail + 1);
+        return true;
+    }
+
+    int overflowCount() const { return m_overflowCount.load(); }
+
+private:
+    static void copyFrame(QGamepadHandler::GamepadFrame *to, const QGamepadHandler::GamepadFrame &from)
+    {
+        to->time = from.time;
+        to->decodeTime = from.decodeTime;
+        to->flags = from.flags;
+        to->count = from.count;
+        memcpy(to->events, from.events, from.count * sizeof(QGamepadHandler::GamepadEvent));
+    }
+
+    QAtomicInt m_head;
+    QAtomicInt m_tail;
+    QAtomicInt m_overflowCount;
+    QGamepadHandler::GamepadFrame m_frames[Capacity];
+};
+
+QT_END_NAMESPACE
+
+#endif // QGAMEPADFRAMERING_P_H
@@ -21,6 +21,12 @@
  */
 
 #include "qgamepadhandler.h"
+#include "qgamepadmappingdatabase.h"
+#include "qgamepadcapabilitycache_p.h"
+#include "qgamepadeventsink.h"
+#include "qgamepadforcefeedback_p.h"
+#include "qgamepadframering_p.h"
+#include "qgamepadrecorder_p.h"
 
 #include <QtCore/QSocketNotifier>
 #include <qplatformdefs.h>
@@ -29,69 +35,395 @@
 
 #include <linux/input.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include <QtCore/qdebug.h>
 #define NBITS(x) ((((x)-1)/(sizeof(long) * 8))+1)
+#define LONG_BITS (sizeof(long) * 8)
 
-QGamepadHandler *QGamepadHandler::create(const QString &device)
-{
-    int fd;
+Q_STATIC_ASSERT(QGamepadHandler::KeyCount == KEY_CNT);
+Q_STATIC_ASSERT(QGamepadHandler::AbsCount == ABS_CNT);
+//One bit of m_keyDirty per word of m_keyState
+Q_STATIC_ASSERT(QGamepadHandler::KeyCount / (8 * sizeof(ulong)) <= 32);
 
+static quint64 clockMicroseconds(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return quint64(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
 
-    fd = QT_OPEN(device.toLocal8Bit().constData(), O_RDONLY | O_NONBLOCK);
-    if (fd >= 0) {
-        return new QGamepadHandler(device, fd);
-    } else {
+int QGamepadHandler::openDevice(const QString &device)
+{
+    //Write access is only needed for force feedback
+    QByteArray path = device.toLocal8Bit();
+    int fd = QT_OPEN(path.constData(), O_RDWR | O_NONBLOCK);
+    if (fd < 0 && (errno == EACCES || errno == EPERM))
+        fd = QT_OPEN(path.constData(), O_RDONLY | O_NONBLOCK);
+    if (fd < 0)
         qWarning("Cannot open gamepad input device '%s': %s", qPrintable(device), strerror(errno));
+    return fd;
+}
+
+QGamepadHandler *QGamepadHandler::create(const QString &device)
+{
+    int fd = openDevice(device);
+    if (fd < 0)
         return 0;
+
+    QGamepadDeviceCapabilities capabilities;
+    capabilities.readIdentity(fd);
+    capabilities.probe(fd);
+    return create(device, fd, capabilities);
+}
+
+QGamepadHandler *QGamepadHandler::create(const QString &device, int fd, const QGamepadDeviceCapabilities &capabilities)
+{
+    QGamepadHandler *handler = new QGamepadHandler(device, fd);
+    handler->setCapabilities(capabilities);
+    return handler;
+}
+
+QGamepadHandler *QGamepadHandler::createVirtual(const QString &device, const QMap<int, AxisInfo> &axisInfo)
+{
+    QGamepadHandler *handler = new QGamepadHandler(device, -1);
+
+    QMap<int, AxisInfo>::const_iterator it;
+    for (it = axisInfo.constBegin(); it != axisInfo.constEnd(); ++it) {
+        if (it.key() < 0 || it.key() >= ABS_CNT)
+            continue;
+        handler->setAxisInfo(it.key(), it.value());
+        handler->m_absAvailable |= Q_UINT64_C(1) << it.key();
+        handler->m_absState[it.key()] = it.value().deadzoneCenter;
+        handler->m_sentAbsState[it.key()] = it.value().deadzoneCenter;
     }
+    handler->updateAxisState();
+
+    return handler;
 }
 
 QGamepadHandler::QGamepadHandler(const QString &device, int fd)
     : m_device(device)
     , m_fd(fd)
     , m_notify(0)
+    , m_axisInfoAvailable(0)
+    , m_mapped(false)
+    , m_deliveryModes(EventDelivery | FrameDelivery)
+    , m_frameRing(0)
+    , m_recorder(0)
+    , m_slot(-1)
+    , m_sinkCount(0)
+    , m_eventSignalConnected(false)
+    , m_frameSignalConnected(false)
+    , m_keyDirty(0)
+    , m_absDirty(0)
+    , m_absAvailable(0)
+    , m_syncDropped(false)
+    , m_maxBurst(0)
+    , m_forceFeedback(0)
+    , m_hasRumble(false)
+    , m_hasPeriodic(false)
+    , m_monotonicClock(false)
+    , m_latencyTracking(false)
 {
-    //socket notifier for events on the gamepad device
-    QSocketNotifier *notifier;
-    notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
-    connect(notifier, SIGNAL(activated(int)), this, SLOT(readGamepadData()));
+    m_frame.time = 0;
+    m_frame.decodeTime = 0;
+    m_frame.flags = 0;
+    m_frame.count = 0;
+    memset(m_keyState, 0, sizeof(m_keyState));
+    memset(m_absState, 0, sizeof(m_absState));
+    memset(m_sentKeyState, 0, sizeof(m_sentKeyState));
+    memset(m_sentAbsState, 0, sizeof(m_sentAbsState));
+    memset(m_axisState, 0, sizeof(m_axisState));
+    memset(m_axisInfo, 0, sizeof(m_axisInfo));
+    memset(m_axisCalibration, 0, sizeof(m_axisCalibration));
+    memset(m_keyAvailable, 0, sizeof(m_keyAvailable));
+
+    if (m_fd < 0)
+        return;
 
-    getAxisInfo();
+    //socket notifier for events on the gamepad device
+    m_notify = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notify, SIGNAL(activated(int)), this, SLOT(readGamepadData()));
 }
 
 QGamepadHandler::~QGamepadHandler()
 {
+    //Effects are erased through the fd, so before closing it
+    delete m_forceFeedback;
     if (m_fd >= 0)
         QT_CLOSE(m_fd);
-
-    foreach(int key, m_axisInfo.keys())
-    {
-        delete m_axisInfo.value(key);
-    }
 }
 
 QGamepadHandler::AxisInfo* QGamepadHandler::axisInfo(int axis)
 {
-    return m_axisInfo.value(axis, 0);
+    if (axis < 0 || axis >= AbsCount || !(m_axisInfoAvailable & (Q_UINT64_C(1) << axis)))
+        return 0;
+    return &m_axisInfo[axis];
 }
 
 const QList<int> QGamepadHandler::axisAvailable()
 {
-    return m_axisInfo.keys();
+    QList<int> axes;
+    for (int i = 0; i < AbsCount; ++i) {
+        if (m_axisInfoAvailable & (Q_UINT64_C(1) << i))
+            axes.append(i);
+    }
+    return axes;
 }
 
-void QGamepadHandler::sendGamepadEvent(quint64 time, GamepadEventType type, int code, int value)
+void QGamepadHandler::normalizeAxes(const AxisCalibration *calibration, const int *values, float *normalized, int count)
+{
+    //Straight line code over plain arrays so the compiler can vectorise it
+    for (int i = 0; i < count; ++i)
+        normalized[i] = normalizeAxis(calibration[i], values[i]);
+}
+
+void QGamepadHandler::setDeliveryModes(DeliveryModes modes)
 {
-    emit handleGamepadEvent(time, type, code, value);
+    m_deliveryModes = modes;
+    m_frame.count = 0;
 }
 
-void QGamepadHandler::getAxisInfo()
+bool QGamepadHandler::addEventSink(QGamepadEventSink *sink)
 {
-    unsigned long absbit[NBITS(ABS_MAX)] = { 0 };
+    for (int i = 0; i < m_sinkCount; ++i) {
+        if (m_sinks[i] == sink)
+            return true;
+    }
+    if (m_sinkCount == MaxEventSinks)
+        return false;
+    m_sinks[m_sinkCount++] = sink;
+    return true;
+}
 
-    if (ioctl(m_fd, EVIOCGBIT(EV_ABS, sizeof(absbit)), absbit) < 0)
+void QGamepadHandler::removeEventSink(QGamepadEventSink *sink)
+{
+    for (int i = 0; i < m_sinkCount; ++i) {
+        if (m_sinks[i] != sink)
+            continue;
+        //Keep the order the sinks were added in
+        memmove(m_sinks + i, m_sinks + i + 1, (m_sinkCount - i - 1) * sizeof(QGamepadEventSink*));
+        --m_sinkCount;
         return;
+    }
+}
+
+void QGamepadHandler::connectNotify(const QMetaMethod &signal)
+{
+    if (signal == QMetaMethod::fromSignal(&QGamepadHandler::handleGamepadEvent))
+        m_eventSignalConnected = true;
+    else if (signal == QMetaMethod::fromSignal(&QGamepadHandler::handleGamepadFrame))
+        m_frameSignalConnected = true;
+}
+
+void QGamepadHandler::disconnectNotify(const QMetaMethod &signal)
+{
+    //Called with an invalid method when everything was disconnected
+    m_eventSignalConnected = isSignalConnected(QMetaMethod::fromSignal(&QGamepadHandler::handleGamepadEvent));
+    m_frameSignalConnected = isSignalConnected(QMetaMethod::fromSignal(&QGamepadHandler::handleGamepadFrame));
+    Q_UNUSED(signal)
+}
+
+void QGamepadHandler::setNotifierEnabled(bool enabled)
+{
+    if (m_notify)
+        m_notify->setEnabled(enabled);
+}
+
+void QGamepadHandler::setFrameRing(QGamepadFrameRing *ring)
+{
+    m_frameRing = ring;
+    m_frame.count = 0;
+}
+
+bool QGamepadHandler::setMonotonicClock(bool monotonic)
+{
+    if (m_fd < 0)
+        return false;
+
+    int clock = monotonic ? CLOCK_MONOTONIC : CLOCK_REALTIME;
+    if (ioctl(m_fd, EVIOCSCLOCKID, &clock) < 0) {
+        qWarning("Cannot change the clock of gamepad input device '%s': %s", qPrintable(m_device), strerror(errno));
+        return false;
+    }
+    m_monotonicClock = monotonic;
+    return true;
+}
+
+quint64 QGamepadHandler::monotonicTime()
+{
+    return clockMicroseconds(CLOCK_MONOTONIC);
+}
+
+static quint16 effectMagnitude(qreal magnitude)
+{
+    return quint16(qBound(qreal(0), magnitude, qreal(1)) * 0xffff);
+}
+
+void QGamepadHandler::rumble(qreal strongMagnitude, qreal weakMagnitude, int msecs)
+{
+    if (!m_forceFeedback)
+        return;
+    if (!m_hasRumble) {
+        //Periodic only devices still get something
+        playPeriodicEffect(SineWave, qMax(strongMagnitude, weakMagnitude), 50, msecs);
+        return;
+    }
+
+    QGamepadForceFeedback::Command command;
+    memset(&command, 0, sizeof(command));
+    command.effect.type = FF_RUMBLE;
+    command.effect.strongMagnitude = effectMagnitude(strongMagnitude);
+    command.effect.weakMagnitude = effectMagnitude(weakMagnitude);
+    command.effect.duration = quint16(qBound(0, msecs, 0xffff));
+    m_forceFeedback->submit(command);
+}
+
+void QGamepadHandler::playPeriodicEffect(PeriodicWaveform waveform, qreal magnitude, int periodMsecs, int msecs)
+{
+    if (!m_forceFeedback)
+        return;
+    if (!m_hasPeriodic) {
+        rumble(magnitude, magnitude, msecs);
+        return;
+    }
+
+    QGamepadForceFeedback::Command command;
+    memset(&command, 0, sizeof(command));
+    command.effect.type = FF_PERIODIC;
+    command.effect.waveform = waveform;
+    command.effect.magnitude = qint16(effectMagnitude(magnitude) >> 1);
+    command.effect.period = quint16(qBound(1, periodMsecs, 0xffff));
+    command.effect.duration = quint16(qBound(0, msecs, 0xffff));
+    m_forceFeedback->submit(command);
+}
+
+void QGamepadHandler::stopForceFeedback()
+{
+    if (!m_forceFeedback)
+        return;
+
+    QGamepadForceFeedback::Command command;
+    memset(&command, 0, sizeof(command));
+    command.stop = true;
+    m_forceFeedback->submit(command);
+}
+
+void QGamepadHandler::setForceFeedbackWriter(QGamepadForceFeedbackWriter *writer)
+{
+    if (m_forceFeedback)
+        m_forceFeedback->setWriter(writer);
+}
+
+QGamepadHandler::Statistics QGamepadHandler::statistics() const
+{
+    Statistics statistics;
+    for (int type = Button; type <= Ball; ++type)
+        statistics.eventsDecoded[type] = counter(Counter(type));
+    statistics.framesDecoded = counter(FrameCounter);
+    statistics.readCalls = counter(ReadCounter);
+    statistics.bytesRead = counter(BytesReadCounter);
+    statistics.eagainRetries = counter(EagainCounter);
+    statistics.eintrRetries = counter(EintrCounter);
+    statistics.maxBurst = m_maxBurst.load();
+    statistics.signalsEmitted = counter(SignalCounter);
+    statistics.syncDrops = counter(SyncDropCounter);
+    return statistics;
+}
+
+void QGamepadHandler::resetStatistics()
+{
+    //The reading thread owns m_counters, so reset by moving the baseline
+    for (int i = 0; i < CounterCount; ++i)
+        m_counterBaseline[i].store(m_counters[i].load());
+    m_maxBurst.store(0);
+}
+
+void QGamepadHandler::sendGamepadEvent(quint64 time, GamepadEventType type, int code, int value)
+{
+    if (m_mapped && type != Ball) {
+        const ControlMap &map = type == Button ? m_keyMap[code] : m_absMap[code];
+        if (map.type < 0)
+            return;
+        type = GamepadEventType(map.type);
+        code = map.code;
+        if (map.invert)
+            value = map.invert - value;
+    }
+
+    count(Counter(type));
+    if ((type == Axis || type == Hat) && code >= 0 && code < AbsCount)
+        m_axisState[code] = value;
+
+    //When a frame ring is attached we are called from the reader thread,
+    //everything is queued as frames and emitted when the ring is drained
+    if ((m_deliveryModes & EventDelivery) && !m_frameRing && m_eventSignalConnected) {
+        count(SignalCounter);
+        emit handleGamepadEvent(time, type, code, value);
+    }
+
+    if ((m_deliveryModes & FrameDelivery) || m_frameRing || m_sinkCount) {
+        GamepadEvent &event = m_frame.events[m_frame.count++];
+        event.type = type;
+        event.code = code;
+        event.value = value;
+
+        //Frame is full before the SYN_REPORT arrived, hand out what we have
+        if (m_frame.count == MaxFrameEvents)
+            sendGamepadFrame(time);
+    }
+}
+
+void QGamepadHandler::sendGamepadFrame(quint64 time)
+{
+    commitState();
+    if (m_frame.count == 0)
+        return;
+
+    m_frame.time = time;
+    count(FrameCounter);
+    if (m_latencyTracking) {
+        quint64 now = clockMicroseconds(m_monotonicClock ? CLOCK_MONOTONIC : CLOCK_REALTIME);
+        if (now >= time)
+            m_latency[QGamepadLatencyHistogram::KernelToDecode].record(now - time);
+        m_frame.decodeTime = m_monotonicClock ? now : clockMicroseconds(CLOCK_MONOTONIC);
+    } else {
+        m_frame.decodeTime = 0;
+    }
+
+    if (m_frameRing) {
+        m_frameRing->push(m_frame);
+    } else {
+        for (int i = 0; i < m_sinkCount; ++i)
+            m_sinks[i]->processGamepadFrame(m_slot, m_frame);
+        if ((m_deliveryModes & FrameDelivery) && m_frameSignalConnected) {
+            count(SignalCounter);
+            emit handleGamepadFrame(m_frame);
+        }
+    }
+    m_frame.count = 0;
+}
+
+void QGamepadHandler::setCapabilities(const QGamepadDeviceCapabilities &capabilities)
+{
+    if (capabilities.bus || capabilities.vendor || capabilities.product)
+        m_guid = QGamepadMappingDatabase::guid(capabilities.bus, capabilities.vendor, capabilities.product, capabilities.version);
+    memcpy(m_keyAvailable, capabilities.keyBits, sizeof(m_keyAvailable));
+
+    m_hasRumble = QGamepadDeviceCapabilities::testBit(capabilities.ffBits, FF_RUMBLE);
+    m_hasPeriodic = QGamepadDeviceCapabilities::testBit(capabilities.ffBits, FF_PERIODIC);
+    if (m_fd >= 0 && !m_forceFeedback && (m_hasRumble || m_hasPeriodic) && capabilities.effectCount > 0
+            && (fcntl(m_fd, F_GETFL) & O_ACCMODE) == O_RDWR)
+        m_forceFeedback = new QGamepadForceFeedback(m_fd, capabilities.effectCount);
+
+    for (int i = 0; i < ABS_CNT; ++i) {
+        if (!QGamepadDeviceCapabilities::testBit(capabilities.absBits, i))
+            continue;
+        m_absAvailable |= Q_UINT64_C(1) << i;
+        m_absState[i] = capabilities.absInfo[i].value;
+        m_sentAbsState[i] = m_absState[i];
+    }
 
     for (int i = 0; i < ABS_MISC; ++i) {
         /* Skip hats */
@@ -100,27 +432,228 @@ void QGamepadHandler::getAxisInfo()
             continue;
         }
 
-        struct input_absinfo absinfo;
+        if (!(m_absAvailable & (Q_UINT64_C(1) << i)))
+            continue;
+
+        const QGamepadDeviceCapabilities::AbsInfo &absinfo = capabilities.absInfo[i];
+        AxisInfo currentAxis;
+        currentAxis.minimum = absinfo.minimum;
+        currentAxis.maximum = absinfo.maximum;
+        currentAxis.deadzoneCenter = absinfo.value;
+        currentAxis.deadzoneRadius = absinfo.flat;
+
+        if (currentAxis.minimum != currentAxis.maximum)
+            setAxisInfo(i, currentAxis);
+    }
+    updateAxisState();
+}
+
+void QGamepadHandler::updateAxisState()
+{
+    if (!m_mapped) {
+        memcpy(m_axisState, m_absState, sizeof(m_axisState));
+        return;
+    }
+
+    memset(m_axisState, 0, sizeof(m_axisState));
+    for (int i = 0; i < AbsCount; ++i) {
+        const ControlMap &map = m_absMap[i];
+        if ((map.type == Axis || map.type == Hat) && map.code >= 0 && map.code < AbsCount)
+            m_axisState[map.code] = map.invert ? map.invert - m_absState[i] : m_absState[i];
+    }
+}
+
+void QGamepadHandler::setAxisInfo(int axis, const AxisInfo &info)
+{
+    m_axisInfo[axis] = info;
+    m_axisInfoAvailable |= Q_UINT64_C(1) << axis;
+    m_axisCalibration[axis] = calibrate(info);
+}
+
+QGamepadHandler::AxisCalibration QGamepadHandler::calibrate(const AxisInfo &info)
+{
+    AxisCalibration calibration;
+    if (info.minimum == 0) {
+        //Case 0.0 - 1.0 triggers/throttles
+        calibration.lo = 0.0f;
+        calibration.hi = 0.0f;
+        calibration.negScale = 0.0f;
+        calibration.posScale = info.maximum > 0 ? 1.0f / info.maximum : 0.0f;
+    } else {
+        //Case -1.0 - 1.0 (with deadzone) joysticks
+        int deadZonePositive = info.deadzoneCenter + info.deadzoneRadius;
+        int deadZoneNegative = info.deadzoneCenter - info.deadzoneRadius;
+        calibration.lo = deadZoneNegative;
+        calibration.hi = deadZonePositive;
+        calibration.negScale = deadZoneNegative > info.minimum ? 1.0f / (deadZoneNegative - info.minimum) : 0.0f;
+        calibration.posScale = info.maximum > deadZonePositive ? 1.0f / (info.maximum - deadZonePositive) : 0.0f;
+    }
+    return calibration;
+}
+
+void QGamepadHandler::setControlMapping(const QGamepadControllerMapping *mapping)
+{
+    m_mapped = mapping != 0;
+
+    //Back to the device's own codes
+    memset(m_axisCalibration, 0, sizeof(m_axisCalibration));
+    if (!mapping) {
+        for (int i = 0; i < AbsCount; ++i) {
+            if (m_axisInfoAvailable & (Q_UINT64_C(1) << i))
+                m_axisCalibration[i] = calibrate(m_axisInfo[i]);
+        }
+        updateAxisState();
+        return;
+    }
+
+    for (int i = 0; i < KeyCount; ++i)
+        m_keyMap[i].type = -1;
+    for (int i = 0; i < AbsCount; ++i)
+        m_absMap[i].type = -1;
+
+    //Number the controls the way SDL does: buttons from BTN_JOYSTICK up
+    //followed by BTN_MISC up to BTN_JOYSTICK, axes in code order without
+    //hats, and hats by pair
+    QVector<int> buttons;
+    for (int code = BTN_JOYSTICK; code < KEY_MAX; ++code) {
+        if (m_keyAvailable[code / LONG_BITS] & (1UL << (code % LONG_BITS)))
+            buttons.append(code);
+    }
+    for (int code = BTN_MISC; code < BTN_JOYSTICK; ++code) {
+        if (m_keyAvailable[code / LONG_BITS] & (1UL << (code % LONG_BITS)))
+            buttons.append(code);
+    }
+
+    QVector<int> axes;
+    QVector<int> hats;
+    for (int code = 0; code < ABS_MAX; ++code) {
+        if (code >= ABS_HAT0X && code <= ABS_HAT3Y) {
+            if ((code - ABS_HAT0X) % 2 == 0 && (m_absAvailable & (Q_UINT64_C(3) << code)))
+                hats.append(code);
+            continue;
+        }
+        if (m_absAvailable & (Q_UINT64_C(1) << code))
+            axes.append(code);
+    }
 
-        if (ioctl(m_fd, EVIOCGABS(i), &absinfo) < 0)
+    foreach (const QGamepadControllerMapping::Binding &binding, mapping->bindings) {
+        int type;
+        int code;
+        if (!QGamepadMappingDatabase::resolveTarget(binding.target, binding.sourceType, &type, &code))
             continue;
 
-        AxisInfo *currentAxis = new AxisInfo;
-        currentAxis->minimum = absinfo.minimum;
-        currentAxis->maximum = absinfo.maximum;
-        currentAxis->deadzoneCenter = absinfo.value;
-        currentAxis->deadzoneRadius = absinfo.flat;
-
-        if (currentAxis->minimum != currentAxis->maximum) {
-//            qDebug("Joystick has absolute axis: %x\n", i);
-//            qDebug("Values = { %d, %d, %d, %d, %d }\n",
-//                   absinfo.value, absinfo.minimum, absinfo.maximum,
-//                   absinfo.fuzz, absinfo.flat);
-            m_axisInfo.insert(i, currentAxis);
-        } else {
-            delete currentAxis;
+        switch (binding.sourceType) {
+        case QGamepadControllerMapping::ButtonSource:
+            if (binding.index < buttons.count()) {
+                ControlMap &map = m_keyMap[buttons.at(binding.index)];
+                map.type = type;
+                map.code = code;
+                map.invert = 0;
+            }
+            break;
+        case QGamepadControllerMapping::AxisSource:
+            if (binding.index < axes.count()) {
+                int source = axes.at(binding.index);
+                ControlMap &map = m_absMap[source];
+                AxisInfo info = m_axisInfo[source];
+                map.type = type;
+                map.code = code;
+                map.invert = 0;
+                if (binding.inverted) {
+                    map.invert = info.minimum + info.maximum;
+                    info.deadzoneCenter = map.invert - info.deadzoneCenter;
+                }
+                m_axisCalibration[code] = calibrate(info);
+            }
+            break;
+        case QGamepadControllerMapping::HatSource:
+            //Both axes of the hat go to the first hat, QGamepadInputState
+            //splits them into the four directions
+            if (binding.index < hats.count()) {
+                int source = hats.at(binding.index);
+                m_absMap[source].type = Hat;
+                m_absMap[source].code = ABS_HAT0X;
+                m_absMap[source].invert = 0;
+                m_absMap[source + 1].type = Hat;
+                m_absMap[source + 1].code = ABS_HAT0Y;
+                m_absMap[source + 1].invert = 0;
+            }
+            break;
+        }
+    }
+    updateAxisState();
+}
+
+void QGamepadHandler::synchronizeState(quint64 time)
+{
+    //Everything between SYN_DROPPED and the next SYN_REPORT was thrown away,
+    //so send out only what really differs from the last state we sent.
+    m_frame.flags |= ResyncFrame;
+
+    ulong keyState[KEY_CNT / LONG_BITS] = { 0 };
+    if (ioctl(m_fd, EVIOCGKEY(sizeof(keyState)), keyState) >= 0) {
+        for (uint word = 0; word < KEY_CNT / LONG_BITS; ++word) {
+            ulong changed = keyState[word] ^ m_keyState[word];
+            for (uint bit = 0; changed; ++bit, changed >>= 1) {
+                int code = word * LONG_BITS + bit;
+                if ((changed & 1) && code >= BTN_MISC)
+                    sendGamepadEvent(time, Button, code, (keyState[word] >> bit) & 1);
+            }
+            if (keyState[word] != m_keyState[word]) {
+                m_keyState[word] = keyState[word];
+                m_keyDirty |= 1U << word;
+            }
         }
     }
+
+    for (int code = 0; code < ABS_MISC; ++code) {
+        if (!(m_absAvailable & (Q_UINT64_C(1) << code)))
+            continue;
+
+        struct input_absinfo absinfo;
+        if (ioctl(m_fd, EVIOCGABS(code), &absinfo) < 0 || absinfo.value == m_absState[code])
+            continue;
+
+        m_absState[code] = absinfo.value;
+        m_absDirty |= Q_UINT64_C(1) << code;
+        bool hat = code >= ABS_HAT0X && code <= ABS_HAT3Y;
+        sendGamepadEvent(time, hat ? Hat : Axis, code, absinfo.value);
+    }
+
+    sendGamepadFrame(time);
+    m_frame.flags = 0;
+}
+
+void QGamepadHandler::commitState()
+{
+    for (quint32 dirty = m_keyDirty; dirty; dirty &= dirty - 1) {
+        int word = __builtin_ctz(dirty);
+        m_sentKeyState[word] = m_keyState[word];
+    }
+    for (quint64 dirty = m_absDirty; dirty; dirty &= dirty - 1) {
+        int code = __builtin_ctzll(dirty);
+        m_sentAbsState[code] = m_absState[code];
+    }
+    m_keyDirty = 0;
+    m_absDirty = 0;
+}
+
+void QGamepadHandler::rollbackState()
+{
+    //Controls changed by the discarded events go back to what was sent, so
+    //synchronizeState() sends them again if the device disagrees
+    for (quint32 dirty = m_keyDirty; dirty; dirty &= dirty - 1) {
+        int word = __builtin_ctz(dirty);
+        m_keyState[word] = m_sentKeyState[word];
+    }
+    for (quint64 dirty = m_absDirty; dirty; dirty &= dirty - 1) {
+        int code = __builtin_ctzll(dirty);
+        m_absState[code] = m_sentAbsState[code];
+    }
+    if (m_absDirty)
+        updateAxisState();
+    m_keyDirty = 0;
+    m_absDirty = 0;
 }
 
 void QGamepadHandler::readGamepadData()
@@ -129,17 +662,26 @@ void QGamepadHandler::readGamepadData()
     int n = 0;
 
     forever {
-        int result = QT_READ(m_fd, buffer + n, sizeof(buffer) - n);
+        int result = QT_READ(m_fd, reinterpret_cast<char *>(buffer) + n, sizeof(buffer) - n);
+        count(ReadCounter);
 
         if (result == 0) {
             qWarning("Got EOF from the input device.");
             return;
         } else if (result < 0) {
-            if (errno != EINTR && errno != EAGAIN) {
+            if (errno == EINTR) {
+                count(EintrCounter);
+            } else if (errno == EAGAIN) {
+                count(EagainCounter);
+                //Nothing pending, don't spin until the next event arrives
+                if (n == 0)
+                    return;
+            } else {
                 qWarning("Could not read from input device: %s", strerror(errno));
                 return;
             }
         } else {
+            count(BytesReadCounter, result);
             n += result;
             if (n % sizeof(buffer[0]) == 0)
                 break;
@@ -147,16 +689,44 @@ void QGamepadHandler::readGamepadData()
     }
 
     n /= sizeof(buffer[0]);
+    if (n > m_maxBurst.load())
+        m_maxBurst.store(n);
+
+    if (m_recorder)
+        m_recorder->writeEvents(this, buffer, n);
 
+    processInputEvents(buffer, n);
+}
+
+void QGamepadHandler::processInputEvents(const struct input_event *events, int n)
+{
     for (int i = 0; i < n; ++i) {
-        struct input_event *data = &buffer[i];
+        const struct input_event *data = &events[i];
 
         int code = data->code;
         quint64 time = data->time.tv_sec * 1000000 + data->time.tv_usec;
 
+        if (m_syncDropped) {
+            //Events up to the next SYN_REPORT are incomplete, the device
+            //state is re-read instead
+            if (data->type == EV_SYN && code == SYN_REPORT) {
+                m_syncDropped = false;
+                synchronizeState(time);
+            }
+            continue;
+        }
+
         switch (data->type) {
 
         case EV_KEY:
+            if (code < KEY_CNT) {
+                if (data->value)
+                    m_keyState[code / LONG_BITS] |= 1UL << (code % LONG_BITS);
+                else
+                    m_keyState[code / LONG_BITS] &= ~(1UL << (code % LONG_BITS));
+                m_keyDirty |= 1U << (code / LONG_BITS);
+            }
+
             if (code >= BTN_MISC) {
                 //code -= BTN_MISC;
 
@@ -170,6 +740,9 @@ void QGamepadHandler::readGamepadData()
                 break;
             }
 
+            m_absState[code] = data->value;
+            m_absDirty |= Q_UINT64_C(1) << code;
+
             switch (code) {
             case ABS_HAT0X:
             case ABS_HAT0Y:
@@ -204,6 +777,17 @@ void QGamepadHandler::readGamepadData()
                 break;
             }
             break;
+        case EV_SYN:
+            if (code == SYN_REPORT) {
+                sendGamepadFrame(time);
+            } else if (code == SYN_DROPPED) {
+                //Kernel buffer overflowed, the frame in progress is unusable
+                m_frame.count = 0;
+                rollbackState();
+                m_syncDropped = true;
+                count(SyncDropCounter);
+            }
+            break;
         default:
             break;
 
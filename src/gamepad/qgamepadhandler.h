@@ -25,18 +25,30 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QMap>
+#include <QtCore/QAtomicInt>
 #include <QtGamepad/qtgamepadglobal.h>
+#include <QtGamepad/qgamepadlatencyhistogram.h>
 
 QT_BEGIN_HEADER
 
+struct input_event;
+
 QT_BEGIN_NAMESPACE
 
 class QSocketNotifier;
+class QGamepadFrameRing;
+class QGamepadRecorder;
+struct QGamepadControllerMapping;
+struct QGamepadDeviceCapabilities;
+class QGamepadEventSink;
+class QGamepadForceFeedback;
+class QGamepadForceFeedbackWriter;
 
 class Q_GAMEPAD_EXPORT QGamepadHandler : public QObject
 {
     Q_OBJECT
     Q_ENUMS(GamepadEventType)
+    Q_FLAGS(DeliveryModes)
 
 public:
     struct AxisInfo {
@@ -46,6 +58,16 @@ public:
         int deadzoneRadius;
     };
 
+    //AxisInfo folded into the factors used by normalizeAxis(). Values
+    //below lo map to [-1, 0), values above hi to (0, 1] and anything in
+    //between to 0. Axes starting at 0 (triggers) only use the positive side.
+    struct AxisCalibration {
+        float lo;
+        float hi;
+        float negScale;
+        float posScale;
+    };
+
     enum GamepadEventType {
         Button,
         Axis,
@@ -54,28 +76,246 @@ public:
     };
     Q_DECLARE_FLAGS(GamepadEventTypes, GamepadEventType)
 
+    enum DeliveryMode {
+        EventDelivery = 0x1,
+        FrameDelivery = 0x2
+    };
+    Q_DECLARE_FLAGS(DeliveryModes, DeliveryMode)
+
+    enum FrameFlag {
+        ResyncFrame = 0x1
+    };
+
+    //Values of the kernel's ff_periodic_effect waveforms
+    enum PeriodicWaveform {
+        SquareWave = 0x58,
+        TriangleWave = 0x59,
+        SineWave = 0x5a,
+        SawUpWave = 0x5b,
+        SawDownWave = 0x5c
+    };
+
+    //Sizes of the evdev KEY and ABS code ranges (KEY_CNT, ABS_CNT)
+    enum { MaxFrameEvents = 32, KeyCount = 0x300, AbsCount = 0x40 };
+
+    struct GamepadEvent {
+        GamepadEventType type;
+        int code;
+        int value;
+    };
+
+    //All events decoded between two SYN_REPORTs, sharing one timestamp
+    //Frames flagged ResyncFrame are synthesized after the kernel dropped
+    //events and only contain the controls that differ from what was sent.
+    //decodeTime is CLOCK_MONOTONIC and only set while latency tracking is on.
+    struct GamepadFrame {
+        quint64 time;
+        quint64 decodeTime;
+        int flags;
+        int count;
+        GamepadEvent events[MaxFrameEvents];
+    };
+
+    //Snapshot of the per-device counters, see statistics()
+    struct Statistics {
+        int eventsDecoded[Ball + 1];
+        int framesDecoded;
+        int readCalls;
+        int bytesRead;
+        int eagainRetries;
+        int eintrRetries;
+        int maxBurst;
+        int signalsEmitted;
+        int syncDrops;
+
+        int totalEvents() const { return eventsDecoded[Button] + eventsDecoded[Axis] + eventsDecoded[Hat] + eventsDecoded[Ball]; }
+        qreal eventsPerRead() const { return readCalls ? qreal(totalEvents()) / readCalls : 0.0; }
+    };
+
+    //Opens device non blocking, for writing too unless only reading is
+    //permitted. Returns -1 after a warning on failure.
+    static int openDevice(const QString &device);
     static QGamepadHandler *create(const QString &device);
+    //Takes over fd, a device opened non blocking whose capabilities were
+    //already probed, see QGamepadEvdevBackend
+    static QGamepadHandler *create(const QString &device, int fd, const QGamepadDeviceCapabilities &capabilities);
+    //A handler without a device, fed through processInputEvents()
+    static QGamepadHandler *createVirtual(const QString &device, const QMap<int, AxisInfo> &axisInfo);
     ~QGamepadHandler();
 
+    QString device() const { return m_device; }
+    bool isVirtual() const { return m_fd < 0; }
+    void processInputEvents(const struct input_event *events, int count);
+    void setRecorder(QGamepadRecorder *recorder) { m_recorder = recorder; }
+
+    //Slot assigned by QGamepadManager, -1 while unmanaged
+    int slot() const { return m_slot; }
+    void setSlot(int slot) { m_slot = slot; }
+
+    //Sinks get every frame before the signals are emitted. They are not
+    //owned, and frames are built for them whatever the delivery modes.
+    enum { MaxEventSinks = 4 };
+    bool addEventSink(QGamepadEventSink *sink);
+    void removeEventSink(QGamepadEventSink *sink);
+
+    //Calibration as reported by the device, indexed by its own ABS codes
     AxisInfo* axisInfo(int axis);
     const QList<int> axisAvailable();
 
+    //SDL style GUID built from EVIOCGID, empty for virtual devices
+    QByteArray guid() const { return m_guid; }
+
+    //Remaps buttons, axes and hats to the Xbox style codes used by
+    //QGamepadInputState while decoding. Controls the mapping does not
+    //mention are dropped. 0 reports the device codes unchanged.
+    void setControlMapping(const QGamepadControllerMapping *mapping);
+    bool hasControlMapping() const { return m_mapped; }
+
+    //Dense tables indexed by ABS code, AbsCount entries each, both in the
+    //codes events are reported with (mapped when a control mapping is set).
+    //Axes the device does not have normalise to 0.
+    const AxisCalibration *axisCalibration() const { return m_axisCalibration; }
+    const int *axisState() const { return m_axisState; }
+
+    static inline float normalizeAxis(const AxisCalibration &calibration, int value)
+    {
+        float v = value;
+        return qMax(v - calibration.hi, 0.0f) * calibration.posScale
+             + qMin(v - calibration.lo, 0.0f) * calibration.negScale;
+    }
+    static void normalizeAxes(const AxisCalibration *calibration, const int *values, float *normalized, int count);
+
+    DeliveryModes deliveryModes() const { return m_deliveryModes; }
+    void setDeliveryModes(DeliveryModes modes);
+
+    void setNotifierEnabled(bool enabled);
+    void setFrameRing(QGamepadFrameRing *ring);
+
+    int syncDropCount() const { return counter(SyncDropCounter); }
+
+    //Counters are only written by the thread reading the device and can
+    //be snapshotted from any thread
+    Statistics statistics() const;
+    void resetStatistics();
+
+    bool isMonotonicClock() const { return m_monotonicClock; }
+    bool setMonotonicClock(bool monotonic);
+
+    bool isLatencyTrackingEnabled() const { return m_latencyTracking; }
+    void setLatencyTrackingEnabled(bool enabled) { m_latencyTracking = enabled; }
+    QGamepadLatencyHistogram *latencyHistogram(QGamepadLatencyHistogram::Stage stage) { return &m_latency[stage]; }
+
+    static quint64 monotonicTime();
+
+    //Needs the device to be writable and to report FF_RUMBLE or FF_PERIODIC.
+    //Magnitudes are 0 to 1, a playing effect is replaced by the next one.
+    bool hasForceFeedback() const { return m_forceFeedback != 0; }
+    void rumble(qreal strongMagnitude, qreal weakMagnitude, int msecs);
+    void playPeriodicEffect(PeriodicWaveform waveform, qreal magnitude, int periodMsecs, int msecs);
+    void stopForceFeedback();
+    //Uploads and writes go through writer instead of blocking the caller,
+    //0 runs them inline. The writer is not owned.
+    void setForceFeedbackWriter(QGamepadForceFeedbackWriter *writer);
+
 signals:
     void handleGamepadEvent(quint64, QGamepadHandler::GamepadEventType, int, int);
-    
+    void handleGamepadFrame(const QGamepadHandler::GamepadFrame &frame);
+
+protected:
+    void connectNotify(const QMetaMethod &signal);
+    void disconnectNotify(const QMetaMethod &signal);
+
 private slots:
     void readGamepadData();
 
 private:
     explicit QGamepadHandler(const QString &device, int fd);
 
+    enum Counter {
+        //Ball + 1 decoded event counters come first, indexed by GamepadEventType
+        FrameCounter = Ball + 1,
+        ReadCounter,
+        BytesReadCounter,
+        EagainCounter,
+        EintrCounter,
+        SignalCounter,
+        SyncDropCounter,
+        CounterCount
+    };
+
+    //Single writer, so a relaxed load and store is enough and avoids a locked add
+    void count(Counter counter, int amount = 1) { m_counters[counter].store(m_counters[counter].load() + amount); }
+    int counter(Counter counter) const { return m_counters[counter].load() - m_counterBaseline[counter].load(); }
+
     void sendGamepadEvent(quint64 time, GamepadEventType type, int code, int value);
-    void getAxisInfo();
+    void sendGamepadFrame(quint64 time);
+    void setCapabilities(const QGamepadDeviceCapabilities &capabilities);
+    void setAxisInfo(int axis, const AxisInfo &info);
+    void updateAxisState();
+    static AxisCalibration calibrate(const AxisInfo &info);
+    void synchronizeState(quint64 time);
+    void commitState();
+    void rollbackState();
 
     QString m_device;
     int m_fd;
     QSocketNotifier *m_notify;
-    QMap<int, AxisInfo*>  m_axisInfo;
+    AxisInfo m_axisInfo[AbsCount];
+    AxisCalibration m_axisCalibration[AbsCount];
+    quint64 m_axisInfoAvailable;
+
+    //Where each device code is sent while a control mapping is set, type -1
+    //drops the control. Inverted axes are reported as invert - value.
+    struct ControlMap {
+        qint16 type;
+        qint16 code;
+        int invert;
+    };
+
+    QByteArray m_guid;
+    ulong m_keyAvailable[KeyCount / (8 * sizeof(ulong))];
+    bool m_mapped;
+    ControlMap m_keyMap[KeyCount];
+    ControlMap m_absMap[AbsCount];
+    DeliveryModes m_deliveryModes;
+    GamepadFrame m_frame;
+    QGamepadFrameRing *m_frameRing;
+    QGamepadRecorder *m_recorder;
+    int m_slot;
+    QGamepadEventSink *m_sinks[MaxEventSinks];
+    int m_sinkCount;
+    //Nothing is emitted without receivers
+    bool m_eventSignalConnected;
+    bool m_frameSignalConnected;
+
+    //State of every control as decoded, including the frame in progress
+    ulong m_keyState[KeyCount / (8 * sizeof(ulong))];
+    int m_absState[AbsCount];
+    //As of the last frame sent, compared against after SYN_DROPPED. The
+    //dirty masks hold the words of m_keyState and the axes changed since.
+    ulong m_sentKeyState[KeyCount / (8 * sizeof(ulong))];
+    int m_sentAbsState[AbsCount];
+    quint32 m_keyDirty;
+    quint64 m_absDirty;
+    quint64 m_absAvailable;
+    //m_absState as reported, see axisState()
+    int m_axisState[AbsCount];
+    bool m_syncDropped;
+
+    QAtomicInt m_counters[CounterCount];
+    QAtomicInt m_counterBaseline[CounterCount];
+    QAtomicInt m_maxBurst;
+
+    QGamepadForceFeedback *m_forceFeedback;
+    bool m_hasRumble;
+    bool m_hasPeriodic;
+
+    bool m_monotonicClock;
+    bool m_latencyTracking;
+    QGamepadLatencyHistogram m_latency[QGamepadLatencyHistogram::StageCount];
+
+    friend class QGamepadReaderThread;
+    friend class QGamepadMultiplexer;
 };
 
 QT_END_NAMESPACE
@@ -83,6 +323,8 @@ QT_END_NAMESPACE
 QT_END_HEADER
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(QGamepadHandler::GamepadEventTypes)
+Q_DECLARE_OPERATORS_FOR_FLAGS(QGamepadHandler::DeliveryModes)
 Q_DECLARE_METATYPE(QGamepadHandler*)
+Q_DECLARE_METATYPE(QGamepadHandler::GamepadFrame)
 
 #endif // JOYSTICKHANDLER_H
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "qgamepadinjectionbackend.h"
+
+#include <linux/input.h>
+
+QT_BEGIN_NAMESPACE
+
+static const char injectionPrefix[] = "inject:";
+
+QGamepadInjectionBackend::QGamepadInjectionBackend(QObject *parent)
+    : QGamepadBackend(parent)
+{
+}
+
+QGamepadInjectionBackend::~QGamepadInjectionBackend()
+{
+    for (int i = 0; i < m_devices.count(); ++i) {
+        if (m_devices.at(i).handler)
+            disconnect(m_devices.at(i).handler, SIGNAL(destroyed(QObject*)), this, SLOT(handlerDestroyed(QObject*)));
+    }
+}
+
+int QGamepadInjectionBackend::addDevice(const QMap<int, QGamepadHandler::AxisInfo> &axisInfo)
+{
+    Device device;
+    device.present = true;
+    device.axisInfo = axisInfo;
+    device.handler = 0;
+    m_devices.append(device);
+
+    int index = m_devices.count() - 1;
+    emit deviceDetected(deviceNode(index));
+    return index;
+}
+
+void QGamepadInjectionBackend::removeDevice(int device)
+{
+    if (device < 0 || device >= m_devices.count() || !m_devices.at(device).present)
+        return;
+
+    m_devices[device].present = false;
+    emit deviceRemoved(deviceNode(device));
+}
+
+QString QGamepadInjectionBackend::deviceNode(int device) const
+{
+    return QLatin1String(injectionPrefix) + QString::number(device);
+}
+
+int QGamepadInjectionBackend::deviceIndex(const QString &deviceNode) const
+{
+    if (!deviceNode.startsWith(QLatin1String(injectionPrefix)))
+        return -1;
+
+    bool ok;
+    int index = deviceNode.mid(sizeof(injectionPrefix) - 1).toInt(&ok);
+    if (!ok || index < 0 || index >= m_devices.count())
+        return -1;
+    return index;
+}
+
+void QGamepadInjectionBackend::injectEvents(int device, const struct input_event *events, int count)
+{
+    if (device < 0 || device >= m_devices.count())
+        return;
+
+    if (QGamepadHandler *handler = m_devices.at(device).handler)
+        handler->processInputEvents(events, count);
+}
+
+void QGamepadInjectionBackend::injectEvent(int device, quint64 time, int type, int code, int value)
+{
+    struct input_event event;
+    event.time.tv_sec = time / 1000000;
+    event.time.tv_usec = time % 1000000;
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    injectEvents(device, &event, 1);
+}
+
+QStringList QGamepadInjectionBackend::scanConnectedDevices()
+{
+    QStringList devices;
+    for (int i = 0; i < m_devices.count(); ++i) {
+        if (m_devices.at(i).present)
+            devices << deviceNode(i);
+    }
+    return devices;
+}
+
+QGamepadHandler *QGamepadInjectionBackend::createHandler(const QString &deviceNode)
+{
+    int index = deviceIndex(deviceNode);
+    if (index < 0 || !m_devices.at(index).present || m_devices.at(index).handler)
+        return 0;
+
+    QGamepadHandler *handler = QGamepadHandler::createVirtual(deviceNode, m_devices.at(index).axisInfo);
+    connect(handler, SIGNAL(destroyed(QObject*)), this, SLOT(handlerDestroyed(QObject*)));
+    m_devices[index].handler = handler;
+    return handler;
+}
+
+void QGamepadInjectionBackend::handlerDestroyed(QObject *handler)
+{
+    for (int i = 0; i < m_devices.count(); ++i) {
+        if (m_devices.at(i).handler == handler)
+            m_devices[i].handler = 0;
+    }
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADINJECTIONBACKEND_H
+#define QGAMEPADINJECTIONBACKEND_H
+
+#include <QtCore/QMap>
+#include <QtCore/QVector>
+#include <QtGamepad/qgamepadbackend.h>
+#include <QtGamepad/qgamepadhandler.h>
+
+QT_BEGIN_HEADER
+
+QT_BEGIN_NAMESPACE
+
+//In-memory devices for tests and benchmarks. Raw input_events injected
+//here go through the same decoding as events read from /dev/input.
+class Q_GAMEPAD_EXPORT QGamepadInjectionBackend : public QGamepadBackend
+{
+    Q_OBJECT
+public:
+    explicit QGamepadInjectionBackend(QObject *parent = 0);
+    ~QGamepadInjectionBackend();
+
+    int addDevice(const QMap<int, QGamepadHandler::AxisInfo> &axisInfo = QMap<int, QGamepadHandler::AxisInfo>());
+    void removeDevice(int device);
+    QString deviceNode(int device) const;
+
+    void injectEvents(int device, const struct input_event *events, int count);
+    void injectEvent(int device, quint64 time, int type, int code, int value);
+
+    QStringList scanConnectedDevices();
+    QGamepadHandler *createHandler(const QString &deviceNode);
+
+private slots:
+    void handlerDestroyed(QObject *handler);
+
+private:
+    struct Device {
+        bool present;
+        QMap<int, QGamepadHandler::AxisInfo> axisInfo;
+        QGamepadHandler *handler;
+    };
+
+    int deviceIndex(const QString &deviceNode) const;
+
+    QVector<Device> m_devices;
+};
+
+QT_END_NAMESPACE
+
+QT_END_HEADER
+
+#endif // QGAMEPADINJECTIONBACKEND_H
@@ -21,67 +21,453 @@
  */
 
 #include "qgamepadinputstate.h"
+#include "qgamepadsnapshotbuffer_p.h"
+#include "qgamepadstickpipeline_p.h"
 
 #include <QtCore/QDebug>
+#include <QtCore/QTimer>
+
+#include <math.h>
+#include <string.h>
 
 QT_BEGIN_NAMESPACE
 
+static const int LongBits = 8 * sizeof(ulong);
+
+//ChangeSummary::gamepads has a bit for every manager slot
+Q_STATIC_ASSERT(int(QGamepadInputState::ChangeSummary::MaxGamepads) == int(QGamepadManager::MaxGamepads));
+Q_STATIC_ASSERT(int(QGamepadInputState::ChangeSummary::MaxGamepads) <= int(8 * sizeof(uint)));
+
+static inline bool testBit(const ulong *bits, int bit)
+{
+    return bits[bit / LongBits] & (1UL << (bit % LongBits));
+}
+
+//The two axes of each stick
+static const int stickAxes[QGamepadInputState::StickCount][2] = {
+    { QGamepadInputState::Axis_X1, QGamepadInputState::Axis_Y1 },
+    { QGamepadInputState::Axis_X2, QGamepadInputState::Axis_Y2 }
+};
+
+static inline void setBit(ulong *bits, int bit, bool on)
+{
+    if (on)
+        bits[bit / LongBits] |= 1UL << (bit % LongBits);
+    else
+        bits[bit / LongBits] &= ~(1UL << (bit % LongBits));
+}
+
 QGamepadInputState::QGamepadInputState(QObject *parent)
     : QObject(parent)
+    , m_publishSnapshots(false)
+    , m_snapshots(new QGamepadSnapshotBuffer)
+    , m_notificationPolicy(PerEvent)
+    , m_tickInterval(0)
+    , m_tickTimer(0)
+    , m_buttonSignals(true)
+    , m_sticks(new QGamepadStickPipeline)
+    , m_axesDirty(false)
+{
+    qRegisterMetaType<QGamepadInputState::ChangeSummary>("QGamepadInputState::ChangeSummary");
+
+    memset(m_keyState, 0, sizeof(m_keyState));
+    memset(&m_changes, 0, sizeof(m_changes));
+}
+
+QGamepadInputState::~QGamepadInputState()
+{
+    qDeleteAll(m_gamepadStates);
+    delete m_snapshots;
+    delete m_sticks;
+}
+
+QGamepadInputState::StickSettings::StickSettings()
+    : deadzone(KernelDeadzone)
+    , innerDeadzone(0.0f)
+    , outerDeadzone(1.0f)
+    , smoothing(NoSmoothing)
+    , smoothingTime(30.0f)
+    , minCutoff(1.0f)
+    , beta(0.5f)
+{
+}
+
+QVector<float> QGamepadInputState::StickSettings::powerCurve(float exponent, int samples)
+{
+    QVector<float> curve(qMax(samples, 2));
+    for (int i = 0; i < curve.count(); ++i)
+        curve[i] = powf(float(i) / (curve.count() - 1), exponent);
+    return curve;
+}
+
+QGamepadInputState::StickSettings QGamepadInputState::stickSettings(Stick stick, int id) const
+{
+    int slot = id * StickCount + stick;
+    if (id < 0 || stick < 0 || stick >= StickCount || slot >= m_sticks->slotCount())
+        return StickSettings();
+    return m_sticks->settings(slot);
+}
+
+void QGamepadInputState::setStickSettings(Stick stick, const StickSettings &settings, int id)
+{
+    if (id < 0 || stick < 0 || stick >= StickCount)
+        return;
+
+    m_sticks->resize((id + 1) * StickCount);
+    m_sticks->setSettings(id * StickCount + stick, settings);
+
+    //The input may have to come from the other normalization now
+    if (GamepadState *state = gamepadStateForId(id))
+        state->axesDirty = true;
+    m_axesDirty = true;
+    publishSnapshot();
+}
+
+void QGamepadInputState::processAxes()
+{
+    if (!m_axesDirty && !m_sticks->isSmoothing())
+        return;
+    m_axesDirty = false;
+
+    //Gather the sticks of the gamepads that changed
+    foreach (GamepadState *state, m_gamepadStates) {
+        if (!state || !state->axesDirty)
+            continue;
+        state->axesDirty = false;
+
+        const QGamepadHandler::AxisCalibration *calibration = state->calibration;
+        QGamepadHandler::normalizeAxes(calibration, state->axes, state->processedAxes, QGamepadHandler::AbsCount);
+
+        for (int stick = 0; stick < StickCount; ++stick) {
+            int slot = state->id * StickCount + stick;
+            int xAxis = stickAxes[stick][0];
+            int yAxis = stickAxes[stick][1];
+            if (m_sticks->settings(slot).deadzone == KernelDeadzone) {
+                m_sticks->setInput(slot, state->processedAxes[xAxis], state->processedAxes[yAxis]);
+            } else {
+                m_sticks->setInput(slot, QGamepadStickPipeline::normalizeFullRange(calibration[xAxis], state->axes[xAxis]),
+                                   QGamepadStickPipeline::normalizeFullRange(calibration[yAxis], state->axes[yAxis]));
+            }
+        }
+    }
+
+    //One pass over every stick of every gamepad
+    m_sticks->process(QGamepadHandler::monotonicTime());
+
+    foreach (GamepadState *state, m_gamepadStates) {
+        if (!state)
+            continue;
+
+        for (int stick = 0; stick < StickCount; ++stick) {
+            int slot = state->id * StickCount + stick;
+            state->processedAxes[stickAxes[stick][0]] = m_sticks->x(slot);
+            state->processedAxes[stickAxes[stick][1]] = m_sticks->y(slot);
+        }
+    }
+}
+
+void QGamepadInputState::setNotificationPolicy(NotificationPolicy policy)
+{
+    if (m_notificationPolicy == policy)
+        return;
+
+    //Don't hold back what was collected under the previous policy
+    notify();
+    m_notificationPolicy = policy;
+    setTickInterval(m_tickInterval);
+}
+
+void QGamepadInputState::setTickInterval(int msecs)
+{
+    m_tickInterval = msecs;
+
+    if (m_notificationPolicy == PerTick && m_tickInterval > 0) {
+        if (!m_tickTimer) {
+            m_tickTimer = new QTimer(this);
+            m_tickTimer->setTimerType(Qt::PreciseTimer);
+            connect(m_tickTimer, SIGNAL(timeout()), this, SLOT(tick()));
+        }
+        m_tickTimer->start(m_tickInterval);
+    } else if (m_tickTimer) {
+        m_tickTimer->stop();
+    }
+}
+
+void QGamepadInputState::tick()
+{
+    if (m_sticks->isSmoothing()) {
+        processAxes();
+        publishSnapshot();
+    }
+    notify();
+}
+
+void QGamepadInputState::updated(bool frameBoundary)
+{
+    publishSnapshot();
+
+    if (m_notificationPolicy == PerEvent || (m_notificationPolicy == PerFrame && frameBoundary))
+        notify();
+}
+
+void QGamepadInputState::notify()
+{
+    //PerEvent keeps emitting stateUpdated() for every event, as it always did
+    if (m_changes.isEmpty()) {
+        if (m_notificationPolicy == PerEvent)
+            emit stateUpdated();
+        return;
+    }
+
+    emit stateChanged(m_changes);
+    emit stateUpdated();
+
+    //Only the touched gamepads need clearing
+    for (int id = 0; id < ChangeSummary::MaxGamepads; ++id) {
+        if (m_changes.gamepads & (1u << id))
+            memset(&m_changes.gamepad[id], 0, sizeof(ChangeSummary::Gamepad));
+    }
+    if (m_changes.keys)
+        memset(m_changes.keyMask, 0, sizeof(m_changes.keyMask));
+    m_changes.gamepads = 0;
+    m_changes.otherGamepads = false;
+    m_changes.keys = false;
+    m_changes.mouse = false;
+}
+
+void QGamepadInputState::setSnapshotPublishingEnabled(bool enabled)
+{
+    m_publishSnapshots = enabled;
+    if (enabled)
+        publishSnapshot();
+}
+
+bool QGamepadInputState::readSnapshot(QGamepadStateSnapshot *snapshot) const
 {
+    return m_snapshots->read(snapshot);
+}
+
+void QGamepadInputState::publishSnapshot()
+{
+    if (!m_publishSnapshots)
+        return;
+    if (m_axesDirty)
+        processAxes();
+
+    QGamepadStateSnapshot *snapshot = m_snapshots->beginWrite();
+    snapshot->mousePos = m_mousePos;
+    snapshot->mouseButtons = m_buttonState;
+    snapshot->keyboardModifiers = m_modifierState;
+    memcpy(snapshot->keys, m_keyState, sizeof(snapshot->keys));
+
+    for (int id = 0; id < QGamepadStateSnapshot::MaxGamepads; ++id) {
+        GamepadState *state = id < m_gamepadStates.count() ? m_gamepadStates.at(id) : 0;
+        QGamepadStateSnapshot::Gamepad &gamepad = snapshot->gamepads[id];
+        if (!state) {
+            if (gamepad.present)
+                memset(&gamepad, 0, sizeof(gamepad));
+            continue;
+        }
+        gamepad.present = true;
+        memcpy(gamepad.buttons, state->buttons, sizeof(gamepad.buttons));
+        memcpy(gamepad.axes, state->processedAxes, sizeof(gamepad.axes));
+    }
+    m_snapshots->endWrite();
 }
 
 void QGamepadInputState::processMousePressEvent(QMouseEvent *event)
 {
+    if (event->windowPos() != m_mousePos || event->buttons() != m_buttonState || event->modifiers() != m_modifierState)
+        m_changes.mouse = true;
     m_mousePos = event->windowPos();
     m_buttonState = event->buttons();
     m_modifierState = event->modifiers();
-    emit stateUpdated();
+    updated(true);
 }
 
 void QGamepadInputState::processMouseReleaseEvent(QMouseEvent *event)
 {
+    if (event->windowPos() != m_mousePos || event->buttons() != m_buttonState || event->modifiers() != m_modifierState)
+        m_changes.mouse = true;
     m_mousePos = event->windowPos();
     m_buttonState = event->buttons();
     m_modifierState = event->modifiers();
-    emit stateUpdated();
+    updated(true);
 }
 
 void QGamepadInputState::processMouseMoveEvent(QMouseEvent *event)
 {
+    if (event->windowPos() != m_mousePos || event->buttons() != m_buttonState || event->modifiers() != m_modifierState)
+        m_changes.mouse = true;
     m_mousePos = event->windowPos();
     m_buttonState = event->buttons();
     m_modifierState = event->modifiers();
-    emit stateUpdated();
+    updated(true);
 }
 
 void QGamepadInputState::processKeyPressEvent(QKeyEvent *event)
 {
-    m_keyStateMap.insert(event->key(), true);
-    emit stateUpdated();
+    setKeyState(event->key(), true);
+    updated(true);
 }
 
 void QGamepadInputState::processKeyReleaseEvent(QKeyEvent *event)
 {
-    m_keyStateMap.insert(event->key(), false);
-    emit stateUpdated();
+    setKeyState(event->key(), false);
+    updated(true);
+}
+
+void QGamepadInputState::setKeyState(int key, bool pressed)
+{
+    bool changed = queryKey(key) != pressed;
+    if (changed)
+        m_changes.keys = true;
+
+    if (key >= 0 && key < LatinKeyCount) {
+        setBit(m_keyState, key, pressed);
+        if (changed)
+            setBit(m_changes.keyMask, key, true);
+    } else if (key >= SpecialKeyBase && key < SpecialKeyBase + SpecialKeyCount) {
+        setBit(m_keyState, LatinKeyCount + key - SpecialKeyBase, pressed);
+        if (changed)
+            setBit(m_changes.keyMask, LatinKeyCount + key - SpecialKeyBase, true);
+    } else if (pressed)
+        m_otherKeys.insert(key);
+    else
+        m_otherKeys.remove(key);
+}
+
+bool QGamepadInputState::queryKey(int key) const
+{
+    if (key >= 0 && key < LatinKeyCount)
+        return testBit(m_keyState, key);
+    if (key >= SpecialKeyBase && key < SpecialKeyBase + SpecialKeyCount)
+        return testBit(m_keyState, LatinKeyCount + key - SpecialKeyBase);
+    return m_otherKeys.contains(key);
 }
 
 void QGamepadInputState::processGamepadEvent(QGamepadInfo *info, quint64 time, int type, int number, int value)
 {
     Q_UNUSED(time)
 
-    QGamepadInputState::GamepadState *gamepadState = m_gamepadStates.value(info->id(), 0);
+    GamepadState *state = gamepadState(info);
+    ulong previous[ButtonWords];
+    memcpy(previous, state->buttons, sizeof(previous));
+
+    applyGamepadEvent(state, type, number, value);
+    updateButtonChanges(state, previous);
+    updated(false);
+}
+
+void QGamepadInputState::processGamepadFrame(QGamepadInfo *info, const QGamepadHandler::GamepadFrame &frame)
+{
+    GamepadState *state = gamepadState(info);
+    ulong previous[ButtonWords];
+    memcpy(previous, state->buttons, sizeof(previous));
+
+    for (int i = 0; i < frame.count; ++i) {
+        const QGamepadHandler::GamepadEvent &event = frame.events[i];
+        applyGamepadEvent(state, event.type, event.code, event.value);
+    }
+    updateButtonChanges(state, previous);
+
+    if (frame.decodeTime) {
+        quint64 now = QGamepadHandler::monotonicTime();
+        if (now >= frame.decodeTime)
+            info->latencyHistogram(QGamepadLatencyHistogram::DecodeToApply)->record(now - frame.decodeTime);
+    }
+    updated(true);
+}
+
+QGamepadInputState::GamepadState *QGamepadInputState::gamepadState(QGamepadInfo *info)
+{
+    int id = info->id();
+    if (id >= m_gamepadStates.count())
+        m_gamepadStates.resize(id + 1);
+
+    QGamepadInputState::GamepadState *gamepadState = m_gamepadStates.at(id);
 
     //If this even comes from a joystick we've not seen before
     //map a new JoystickState
     if(!gamepadState)
     {
         gamepadState = new QGamepadInputState::GamepadState;
-        gamepadState->info = info;
-        m_gamepadStates.insert(info->id(), gamepadState);
+        m_gamepadStates[id] = gamepadState;
+        m_sticks->resize((id + 1) * StickCount);
+    }
+    else if (gamepadState->generation == info->generation())
+    {
+        //Loading mappings changes the codes the calibration and the axes
+        //are indexed by
+        if (gamepadState->mapped != info->hasControlMapping()) {
+            copyCalibration(gamepadState, info);
+            memcpy(gamepadState->axes, info->axisState(), sizeof(gamepadState->axes));
+            memcpy(gamepadState->previousAxes, gamepadState->axes, sizeof(gamepadState->previousAxes));
+        }
+        return gamepadState;
+    }
+
+    //New, or the slot was given to another device since
+    memset(gamepadState, 0, sizeof(*gamepadState));
+    gamepadState->id = id;
+    gamepadState->generation = info->generation();
+    copyCalibration(gamepadState, info);
+    //Sticks held while the device was plugged in start where they are,
+    //reported as changed since queries returned 0 before
+    memcpy(gamepadState->axes, info->axisState(), sizeof(gamepadState->axes));
+    memcpy(gamepadState->previousAxes, gamepadState->axes, sizeof(gamepadState->previousAxes));
+    if (ChangeSummary::Gamepad *changes = gamepadChanges(gamepadState)) {
+        for (int axis = 0; axis < QGamepadHandler::AbsCount; ++axis) {
+            if (gamepadState->axes[axis])
+                changes->axes |= Q_UINT64_C(1) << axis;
+        }
+    }
+    gamepadState->axesDirty = true;
+    for (int stick = 0; stick < StickCount; ++stick)
+        m_sticks->reset(id * StickCount + stick);
+    m_axesDirty = true;
+
+    return gamepadState;
+}
+
+void QGamepadInputState::copyCalibration(GamepadState *gamepadState, QGamepadInfo *info)
+{
+    memcpy(gamepadState->calibration, info->axisCalibration(), sizeof(gamepadState->calibration));
+    gamepadState->availableAxes = 0;
+    foreach (int axis, info->axisAvailable()) {
+        if (axis >= 0 && axis < QGamepadHandler::AbsCount)
+            gamepadState->availableAxes |= Q_UINT64_C(1) << axis;
+    }
+    gamepadState->mapped = info->hasControlMapping();
+    gamepadState->axesDirty = true;
+    m_axesDirty = true;
+}
+
+void QGamepadInputState::removeGamepad(QGamepadInfo *info)
+{
+    int id = info->id();
+    GamepadState *state = gamepadStateForId(id);
+    if (!state || state->generation != info->generation())
+        return;
+
+    if (ChangeSummary::Gamepad *changes = gamepadChanges(state)) {
+        for (int i = 0; i < ButtonWords; ++i)
+            changes->buttons[i] |= state->buttons[i];
+        for (int axis = 0; axis < QGamepadHandler::AbsCount; ++axis) {
+            if (state->processedAxes[axis] != 0.0f)
+                changes->axes |= Q_UINT64_C(1) << axis;
+        }
     }
 
+    delete state;
+    m_gamepadStates[id] = 0;
+    for (int stick = 0; stick < StickCount; ++stick)
+        m_sticks->reset(id * StickCount + stick);
+    updated(true);
+}
+
+void QGamepadInputState::applyGamepadEvent(GamepadState *gamepadState, int type, int number, int value)
+{
     if (type == QGamepadHandler::Button) {
         addGamepadButtonState(gamepadState, (Buttons)number, value);
     } else if (type == QGamepadHandler::Hat) {
@@ -150,16 +536,18 @@ void QGamepadInputState::processGamepadEvent(QGamepadInfo *info, quint64 time, i
     } else if(type == QGamepadHandler::Axis) {
         addGamepadAxisState(gamepadState, (Axis)number, value);
     }
-    emit stateUpdated();
 }
 
 
 bool QGamepadInputState::queryGamepadButton(QGamepadInputState::Buttons button, int id)
 {
-    GamepadState *currentState = m_gamepadStates.value(id, 0);
+    if (id < 0 || id >= m_gamepadStates.count() || button < 0 || int(button) >= QGamepadHandler::KeyCount)
+        return false;
+
+    GamepadState *currentState = m_gamepadStates.at(id);
 
     if(currentState) {
-        return currentState->buttonStateMap.value(button, false);
+        return testBit(currentState->buttons, button);
     }
 
     return false;
@@ -167,42 +555,17 @@ bool QGamepadInputState::queryGamepadButton(QGamepadInputState::Buttons button,
 
 qreal QGamepadInputState::queryGamepadAxis(QGamepadInputState::Axis axis, int id)
 {
-    GamepadState *currentState = m_gamepadStates.value(id, 0);
+    if (id < 0 || id >= m_gamepadStates.count() || axis < 0 || int(axis) >= QGamepadHandler::AbsCount)
+        return 0;
+
+    GamepadState *currentState = m_gamepadStates.at(id);
 
     if(currentState) {
-        //Normalize value returned by driver
+        if (m_axesDirty)
+            processAxes();
         //Results will be from -1.0 -- 1.0
         // or 0.0 -- 1.0 depending on axis type
-
-        int axisMinimum = currentState->info->getAxisMinimum((int)axis);
-        int axisMaximum = currentState->info->getAxisMaximum((int)axis);
-        int axisDeadZoneCenter = currentState->info->getAxisDeadZoneCenter((int)axis);
-        int axisDeadZoneRadius = currentState->info->getAxisDeadZoneRadius((int)axis);
-        qreal currentValue = currentState->axisStateMap.value(axis, 0);
-
-
-        //Case 0.0 - 1.0 (when minimum value is 0) triggers/throttles
-        if (axisMinimum == 0) {
-            return currentValue / (axisMaximum - axisMinimum);
-        } else {
-        //Case -1.0 - 1.0 (with deadzone) joysticks
-            int deadZonePositive = axisDeadZoneCenter + axisDeadZoneRadius;
-            int deadZoneNegative = axisDeadZoneCenter - axisDeadZoneRadius;
-
-            //If the current value is within the deadzone
-            if ((currentValue < deadZonePositive) && (currentValue > deadZoneNegative))
-                return 0.0;
-
-            //If the current value is on the positive side of the deadzone
-            if ((currentValue > deadZonePositive)) {
-                return (currentValue - deadZonePositive) / (axisMaximum - deadZonePositive);
-            }
-
-            //If the current value is on the negative side of the deadzone
-            if ((currentValue < deadZoneNegative)) {
-                return -(currentValue + deadZoneNegative) / (axisMinimum + deadZoneNegative);
-            }
-        }
+        return currentState->processedAxes[axis];
     }
 
     return 0;
@@ -214,41 +577,193 @@ void QGamepadInputState::printInputState()
     qDebug() << "Mouse Buttons State: " << m_buttonState;
     qDebug() << "Modifiers State: " << m_modifierState;
 
+    for (int i = 0; i < LatinKeyCount + SpecialKeyCount; ++i)
+    {
+        if (testBit(m_keyState, i))
+            qDebug() << "key: " << (Qt::Key)(i < LatinKeyCount ? i : SpecialKeyBase + i - LatinKeyCount) << " is pressed";
+    }
 
-    foreach (int key, m_keyStateMap.keys())
+    foreach (int key, m_otherKeys)
     {
-        qDebug() << "key: " << (Qt::Key)key << (m_keyStateMap.value(key) ? " is pressed: " : " is not pressed");
+        qDebug() << "key: " << (Qt::Key)key << " is pressed";
     }
 
-    foreach (GamepadState *state, m_gamepadStates.values())
+    foreach (GamepadState *state, m_gamepadStates)
     {
-        qDebug() << "Joystick #" << state->info->id();
+        if (!state)
+            continue;
 
-        foreach (Buttons button, state->buttonStateMap.keys())
+        qDebug() << "Joystick #" << state->id;
+
+        for (int button = 0; button < QGamepadHandler::KeyCount; ++button)
         {
-            qDebug() << "button: " << (int)button << (queryGamepadButton(button, state->info->id()) ? " is pressed" : " is not pressed");
+            if (testBit(state->buttons, button))
+                qDebug() << "button: " << button << " is pressed";
         }
 
-        foreach (Axis axis, state->axisStateMap.keys())
+        for (int axis = 0; axis < QGamepadHandler::AbsCount; ++axis)
         {
-            qDebug() << "axis: " << (int)axis << " " << queryGamepadAxis(axis, state->info->id());
+            if (state->availableAxes & (Q_UINT64_C(1) << axis))
+                qDebug() << "axis: " << axis << " " << queryGamepadAxis((Axis)axis, state->id);
         }
     }
 }
 
 void QGamepadInputState::addGamepadButtonState(GamepadState *gamepadState, QGamepadInputState::Buttons button, int value)
 {
-    if (value) {
-        emit gamepadButtonPressed(button, gamepadState->info->id());
-    } else {
-        emit gamepadButtonReleased(button, gamepadState->info->id());
-    }
-    gamepadState->buttonStateMap.insert(button, value);
+    if (button >= 0 && int(button) < QGamepadHandler::KeyCount)
+        setBit(gamepadState->buttons, button, value);
 }
 
 void QGamepadInputState::addGamepadAxisState(GamepadState *gamepadState, QGamepadInputState::Axis axis, int value)
 {
-    gamepadState->axisStateMap.insert(axis, value);
+    if (axis < 0 || int(axis) >= QGamepadHandler::AbsCount || gamepadState->axes[axis] == value)
+        return;
+
+    gamepadState->axes[axis] = value;
+    gamepadState->axesDirty = true;
+    m_axesDirty = true;
+    if (ChangeSummary::Gamepad *changes = gamepadChanges(gamepadState))
+        changes->axes |= Q_UINT64_C(1) << axis;
+}
+
+QGamepadInputState::ChangeSummary::Gamepad *QGamepadInputState::gamepadChanges(GamepadState *gamepadState)
+{
+    int id = gamepadState->id;
+    if (id >= ChangeSummary::MaxGamepads) {
+        //Still notified, just without the per control masks
+        m_changes.otherGamepads = true;
+        return 0;
+    }
+
+    m_changes.gamepads |= 1u << id;
+    return &m_changes.gamepad[id];
+}
+
+void QGamepadInputState::updateButtonChanges(GamepadState *gamepadState, const ulong *previous)
+{
+    ChangeSummary::Gamepad *changes = 0;
+
+    //One XOR per word finds every button that changed since previous
+    for (int i = 0; i < ButtonWords; ++i) {
+        ulong changed = previous[i] ^ gamepadState->buttons[i];
+        if (!changed)
+            continue;
+
+        gamepadState->downEdges[i] |= changed & gamepadState->buttons[i];
+        gamepadState->upEdges[i] |= changed & ~gamepadState->buttons[i];
+
+        if (!changes)
+            changes = gamepadChanges(gamepadState);
+        if (changes)
+            changes->buttons[i] |= changed;
+
+        if (!m_buttonSignals)
+            continue;
+
+        while (changed) {
+            int bit = __builtin_ctzl(changed);
+            changed &= changed - 1;
+
+            int button = i * LongBits + bit;
+            if (gamepadState->buttons[i] & (1UL << bit))
+                emit gamepadButtonPressed(button, gamepadState->id);
+            else
+                emit gamepadButtonReleased(button, gamepadState->id);
+        }
+    }
+}
+
+void QGamepadInputState::beginFrame()
+{
+    processAxes();
+
+    foreach (GamepadState *state, m_gamepadStates) {
+        if (!state)
+            continue;
+
+        for (int i = 0; i < ButtonWords; ++i) {
+            state->pressedButtons[i] = state->downEdges[i];
+            state->releasedButtons[i] = state->upEdges[i];
+            state->downEdges[i] = 0;
+            state->upEdges[i] = 0;
+        }
+        for (int i = 0; i < QGamepadHandler::AbsCount; ++i)
+            state->axisDeltas[i] = state->axes[i] - state->previousAxes[i];
+    }
+}
+
+void QGamepadInputState::endFrame()
+{
+    foreach (GamepadState *state, m_gamepadStates) {
+        if (!state)
+            continue;
+
+        memcpy(state->previousButtons, state->buttons, sizeof(state->previousButtons));
+        memcpy(state->previousAxes, state->axes, sizeof(state->previousAxes));
+    }
+}
+
+QGamepadInputState::GamepadState *QGamepadInputState::gamepadStateForId(int id) const
+{
+    if (id < 0 || id >= m_gamepadStates.count())
+        return 0;
+    return m_gamepadStates.at(id);
+}
+
+const ulong *QGamepadInputState::gamepadButtonMask(ButtonMask mask, int id) const
+{
+    GamepadState *state = gamepadStateForId(id);
+    if (!state)
+        return 0;
+
+    switch (mask) {
+    case CurrentButtons:
+        return state->buttons;
+    case PreviousButtons:
+        return state->previousButtons;
+    case PressedButtons:
+        return state->pressedButtons;
+    case ReleasedButtons:
+        return state->releasedButtons;
+    }
+    return 0;
+}
+
+bool QGamepadInputState::queryGamepadButtonPressed(Buttons button, int id) const
+{
+    GamepadState *state = gamepadStateForId(id);
+    if (!state || button < 0 || int(button) >= QGamepadHandler::KeyCount)
+        return false;
+    return testBit(state->pressedButtons, button);
+}
+
+bool QGamepadInputState::queryGamepadButtonReleased(Buttons button, int id) const
+{
+    GamepadState *state = gamepadStateForId(id);
+    if (!state || button < 0 || int(button) >= QGamepadHandler::KeyCount)
+        return false;
+    return testBit(state->releasedButtons, button);
+}
+
+bool QGamepadInputState::queryGamepadButtonPrevious(Buttons button, int id) const
+{
+    GamepadState *state = gamepadStateForId(id);
+    if (!state || button < 0 || int(button) >= QGamepadHandler::KeyCount)
+        return false;
+    return testBit(state->previousButtons, button);
+}
+
+qreal QGamepadInputState::queryGamepadAxisDelta(Axis axis, int id) const
+{
+    GamepadState *state = gamepadStateForId(id);
+    if (!state || axis < 0 || int(axis) >= QGamepadHandler::AbsCount)
+        return 0;
+
+    const QGamepadHandler::AxisCalibration &calibration = state->calibration[axis];
+    int previous = state->previousAxes[axis];
+    return QGamepadHandler::normalizeAxis(calibration, previous + state->axisDeltas[axis])
+         - QGamepadHandler::normalizeAxis(calibration, previous);
 }
 
 QT_END_NAMESPACE
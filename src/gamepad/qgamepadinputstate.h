@@ -29,17 +29,83 @@
 #include <QtGui/QMouseEvent>
 #include <QtCore/QSizeF>
 #include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
 #include <QtGamepad/qtgamepadglobal.h>
 #include <QtGamepad/qgamepadmanager.h>
+#include <QtGamepad/qgamepadstatesnapshot.h>
 
 QT_BEGIN_HEADER
 
 QT_BEGIN_NAMESPACE
 
+class QGamepadSnapshotBuffer;
+class QGamepadStickPipeline;
+class QTimer;
+
 class Q_GAMEPAD_EXPORT QGamepadInputState : public QObject
 {
     Q_OBJECT
+    Q_ENUMS(NotificationPolicy)
 public:
+    //When stateUpdated() and stateChanged() are emitted
+    enum NotificationPolicy {
+        PerEvent,
+        PerFrame,
+        PerTick
+    };
+
+    //What changed since the previous notification
+    struct ChangeSummary {
+        enum { MaxGamepads = QGamepadStateSnapshot::MaxGamepads };
+
+        struct Gamepad {
+            ulong buttons[QGamepadStateSnapshot::ButtonWords];
+            quint64 axes;
+        };
+
+        //One bit per QGamepadInfo::id() below MaxGamepads
+        uint gamepads;
+        //A gamepad with a higher id changed, no detail is kept for those
+        bool otherGamepads;
+        bool keys;
+        bool mouse;
+        Gamepad gamepad[MaxGamepads];
+        //Changed keys laid out like QGamepadStateSnapshot::keys, keys
+        //outside those ranges only set the keys flag
+        ulong keyMask[QGamepadStateSnapshot::KeyWords];
+
+        bool isEmpty() const { return !gamepads && !otherGamepads && !keys && !mouse; }
+        bool keyChanged(int key) const
+        {
+            if (key >= 0 && key < QGamepadStateSnapshot::LatinKeyCount)
+                return QGamepadStateSnapshot::testBit(keyMask, key);
+            if (key >= QGamepadStateSnapshot::SpecialKeyBase && key < QGamepadStateSnapshot::SpecialKeyBase + QGamepadStateSnapshot::SpecialKeyCount)
+                return QGamepadStateSnapshot::testBit(keyMask, QGamepadStateSnapshot::LatinKeyCount + key - QGamepadStateSnapshot::SpecialKeyBase);
+            return keys;
+        }
+        //Gamepads beyond MaxGamepads report every control as changed
+        //whenever any of them changed
+        bool gamepadChanged(int id) const
+        {
+            if (id >= MaxGamepads)
+                return otherGamepads;
+            return id >= 0 && (gamepads & (1u << id));
+        }
+        bool buttonChanged(int button, int id = 0) const
+        {
+            if (!gamepadChanged(id) || button < 0 || button >= QGamepadHandler::KeyCount)
+                return false;
+            return id >= MaxGamepads || QGamepadStateSnapshot::testBit(gamepad[id].buttons, button);
+        }
+        bool axisChanged(int axis, int id = 0) const
+        {
+            if (!gamepadChanged(id) || axis < 0 || axis >= QGamepadHandler::AbsCount)
+                return false;
+            return id >= MaxGamepads || (gamepad[id].axes & (Q_UINT64_C(1) << axis));
+        }
+    };
+
     enum Buttons {
         Gamepad_A = 0x130,
         Gamepad_B,
@@ -67,7 +133,47 @@ public:
         Gamepad_Up3,
         Gamepad_Down3,
         Gamepad_Left3,
-        Gamepad_Right3
+        Gamepad_Right3,
+        Gamepad_TriggerHappy1 = 0x2c0,
+        Gamepad_TriggerHappy2,
+        Gamepad_TriggerHappy3,
+        Gamepad_TriggerHappy4,
+        Gamepad_TriggerHappy5,
+        Gamepad_TriggerHappy6,
+        Gamepad_TriggerHappy7,
+        Gamepad_TriggerHappy8,
+        Gamepad_TriggerHappy9,
+        Gamepad_TriggerHappy10,
+        Gamepad_TriggerHappy11,
+        Gamepad_TriggerHappy12,
+        Gamepad_TriggerHappy13,
+        Gamepad_TriggerHappy14,
+        Gamepad_TriggerHappy15,
+        Gamepad_TriggerHappy16,
+        Gamepad_TriggerHappy17,
+        Gamepad_TriggerHappy18,
+        Gamepad_TriggerHappy19,
+        Gamepad_TriggerHappy20,
+        Gamepad_TriggerHappy21,
+        Gamepad_TriggerHappy22,
+        Gamepad_TriggerHappy23,
+        Gamepad_TriggerHappy24,
+        Gamepad_TriggerHappy25,
+        Gamepad_TriggerHappy26,
+        Gamepad_TriggerHappy27,
+        Gamepad_TriggerHappy28,
+        Gamepad_TriggerHappy29,
+        Gamepad_TriggerHappy30,
+        Gamepad_TriggerHappy31,
+        Gamepad_TriggerHappy32,
+        Gamepad_TriggerHappy33,
+        Gamepad_TriggerHappy34,
+        Gamepad_TriggerHappy35,
+        Gamepad_TriggerHappy36,
+        Gamepad_TriggerHappy37,
+        Gamepad_TriggerHappy38,
+        Gamepad_TriggerHappy39,
+        Gamepad_TriggerHappy40
     };
 
     enum Hats {
@@ -88,7 +194,53 @@ public:
         Axis_Z2
     };
 
+    enum Stick {
+        LeftStick,
+        RightStick,
+        StickCount
+    };
+
+    //KernelDeadzone starts from the per axis deadzone reported by the
+    //driver, the others from the full range of the axes. Axial and
+    //ScaledRadial rescale what lies past innerDeadzone to start at 0,
+    //Radial keeps the magnitude as it is.
+    enum DeadzoneMode {
+        KernelDeadzone,
+        AxialDeadzone,
+        RadialDeadzone,
+        ScaledRadialDeadzone
+    };
+
+    enum SmoothingMode {
+        NoSmoothing,
+        ExponentialSmoothing,
+        OneEuroSmoothing
+    };
+
+    //How both axes of a stick are turned into the values returned by
+    //queryGamepadAxis(). Deadzones are fractions of full deflection, past
+    //outerDeadzone the stick reads as fully deflected.
+    struct StickSettings {
+        StickSettings();
+
+        DeadzoneMode deadzone;
+        float innerDeadzone;
+        float outerDeadzone;
+        //Output magnitude at evenly spaced input magnitudes from 0 to 1,
+        //at least two samples, empty for a linear response
+        QVector<float> responseCurve;
+        SmoothingMode smoothing;
+        //ExponentialSmoothing time constant in ms
+        float smoothingTime;
+        //OneEuroSmoothing cutoff at rest in Hz and its speed coefficient
+        float minCutoff;
+        float beta;
+
+        static QVector<float> powerCurve(float exponent, int samples = 33);
+    };
+
     QGamepadInputState(QObject *parent = 0);
+    ~QGamepadInputState();
 
 public slots:
 
@@ -98,16 +250,72 @@ public slots:
     void processKeyPressEvent(QKeyEvent *event);
     void processKeyReleaseEvent(QKeyEvent *event);
     void processGamepadEvent(QGamepadInfo *info, quint64 time, int type, int number, int value);
+    void processGamepadFrame(QGamepadInfo *info, const QGamepadHandler::GamepadFrame &frame);
+    //Connect to QGamepadManager::gamepadDisconnected(), the gamepad's
+    //buttons and axes are reported released
+    void removeGamepad(QGamepadInfo *info);
+
+    //Notifies about everything accumulated since the last notification,
+    //drive this from vsync or a timer when using PerTick
+    void tick();
 
 public:
+    //PerFrame notifies once per processGamepadFrame() and per mouse or
+    //key event. Single gamepad events carry no frame boundary and are
+    //reported with the next frame. PerTick only notifies from tick(),
+    //which is called every tickInterval() ms when that is non zero.
+    NotificationPolicy notificationPolicy() const { return m_notificationPolicy; }
+    void setNotificationPolicy(NotificationPolicy policy);
+    int tickInterval() const { return m_tickInterval; }
+    void setTickInterval(int msecs);
+
     QPointF mousePos() { return m_mousePos; }
 
-    bool queryKey(int key) { return m_keyStateMap.value(key, false); }
+    bool queryKey(int key) const;
     Qt::MouseButtons mouseButtons() { return m_buttonState; }
     Qt::KeyboardModifiers keyboardModifiers() { return m_modifierState; }
     bool queryGamepadButton(Buttons button, int id = 0);
     qreal queryGamepadAxis(Axis axis, int id = 0);
 
+    //Axes of all gamepads are processed in one pass when first needed
+    //after a change, queries only read the results. Smoothing also
+    //advances in beginFrame() and tick(), so a stick that stopped moving
+    //still settles.
+    StickSettings stickSettings(Stick stick, int id = 0) const;
+    void setStickSettings(Stick stick, const StickSettings &settings, int id = 0);
+
+    //When enabled, a copy of the whole state is published after every
+    //update. readSnapshot() is lock free and may be called from any
+    //thread, while everything else stays on the thread owning this object.
+    bool isSnapshotPublishingEnabled() const { return m_publishSnapshots; }
+    void setSnapshotPublishingEnabled(bool enabled);
+    bool readSnapshot(QGamepadStateSnapshot *snapshot) const;
+
+    //Game frame boundaries. beginFrame() latches which buttons went down
+    //or up and how far each axis moved since the previous endFrame(),
+    //endFrame() makes the current state the previous one.
+    void beginFrame();
+    void endFrame();
+
+    enum ButtonMask {
+        CurrentButtons,
+        PreviousButtons,
+        PressedButtons,
+        ReleasedButtons
+    };
+
+    //QGamepadStateSnapshot::ButtonWords words indexed like the evdev key
+    //codes, or 0 for an unknown gamepad
+    const ulong *gamepadButtonMask(ButtonMask mask, int id = 0) const;
+    bool queryGamepadButtonPressed(Buttons button, int id = 0) const;
+    bool queryGamepadButtonReleased(Buttons button, int id = 0) const;
+    bool queryGamepadButtonPrevious(Buttons button, int id = 0) const;
+    qreal queryGamepadAxisDelta(Axis axis, int id = 0) const;
+
+    //The per button signals can be turned off when only the masks are used
+    bool isButtonSignalsEnabled() const { return m_buttonSignals; }
+    void setButtonSignalsEnabled(bool enabled) { m_buttonSignals = enabled; }
+
     //Debug
     void printInputState();
 
@@ -115,27 +323,84 @@ signals:
     void gamepadButtonReleased(int button, int id);
     void gamepadButtonPressed(int button, int id);
     void stateUpdated();
+    //Emitted right before stateUpdated(), only when something changed
+    void stateChanged(const QGamepadInputState::ChangeSummary &summary);
 
 private:
+    //Latin-1 keys and the Qt::Key_Escape block are kept in a bitset laid
+    //out like the snapshot's, anything else goes to m_otherKeys
+    enum {
+        ButtonWords = QGamepadStateSnapshot::ButtonWords,
+        LatinKeyCount = QGamepadStateSnapshot::LatinKeyCount,
+        SpecialKeyBase = QGamepadStateSnapshot::SpecialKeyBase,
+        SpecialKeyCount = QGamepadStateSnapshot::SpecialKeyCount,
+        KeyWords = QGamepadStateSnapshot::KeyWords
+    };
 
+    //Constant size, one bit per evdev key code and one int per ABS code
     struct GamepadState {
-        QGamepadInfo *info;
-        QMap<Buttons, bool> buttonStateMap;
-        QMap<Axis, int> axisStateMap;
+        int id;
+        //Of the device the state belongs to, a slot can be reused
+        quint32 generation;
+        //Copied on connect, the QGamepadInfo goes away with the device
+        QGamepadHandler::AxisCalibration calibration[QGamepadHandler::AbsCount];
+        quint64 availableAxes;
+        bool mapped;
+        ulong buttons[ButtonWords];
+        int axes[QGamepadHandler::AbsCount];
+
+        //Game frame state, see beginFrame()/endFrame()
+        ulong previousButtons[ButtonWords];
+        ulong pressedButtons[ButtonWords];
+        ulong releasedButtons[ButtonWords];
+        //Edges collected since the last beginFrame(), so a press and
+        //release between two frames still shows up in both masks
+        ulong downEdges[ButtonWords];
+        ulong upEdges[ButtonWords];
+        int previousAxes[QGamepadHandler::AbsCount];
+        int axisDeltas[QGamepadHandler::AbsCount];
+
+        //Normalized and, for the sticks, processed by m_sticks
+        float processedAxes[QGamepadHandler::AbsCount];
+        bool axesDirty;
     };
 
+    GamepadState *gamepadState(QGamepadInfo *info);
+    void copyCalibration(GamepadState *gamepadState, QGamepadInfo *info);
+    void applyGamepadEvent(GamepadState *gamepadState, int type, int number, int value);
     void addGamepadButtonState(GamepadState *gamepadState, Buttons button, int value);
     void addGamepadAxisState(GamepadState *gamepadState, Axis axis, int value);
+    void updateButtonChanges(GamepadState *gamepadState, const ulong *previous);
+    GamepadState *gamepadStateForId(int id) const;
+    void setKeyState(int key, bool pressed);
+    void processAxes();
+    void publishSnapshot();
+    void updated(bool frameBoundary);
+    void notify();
+    ChangeSummary::Gamepad *gamepadChanges(GamepadState *gamepadState);
 
     QPointF m_mousePos;
-    QMap<int, bool> m_keyStateMap;
-    QMap<int,GamepadState*> m_gamepadStates;
+    ulong m_keyState[KeyWords];
+    QSet<int> m_otherKeys;
+    //Indexed by QGamepadInfo::id()
+    QVector<GamepadState*> m_gamepadStates;
     Qt::MouseButtons m_buttonState;
     Qt::KeyboardModifiers m_modifierState;
+    bool m_publishSnapshots;
+    QGamepadSnapshotBuffer *m_snapshots;
+    NotificationPolicy m_notificationPolicy;
+    int m_tickInterval;
+    QTimer *m_tickTimer;
+    ChangeSummary m_changes;
+    bool m_buttonSignals;
+    QGamepadStickPipeline *m_sticks;
+    bool m_axesDirty;
 };
 
 QT_END_NAMESPACE
 
 QT_END_HEADER
 
+Q_DECLARE_METATYPE(QGamepadInputState::ChangeSummary)
+
 #endif // INPUTSTATE_H
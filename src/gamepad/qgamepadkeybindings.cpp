@@ -24,14 +24,147 @@
 
 QT_BEGIN_NAMESPACE
 
+//The reverse index has controls for every manager slot
+Q_STATIC_ASSERT(int(QGamepadStateSnapshot::MaxGamepads) == int(QGamepadManager::MaxGamepads));
+
 QGamepadKeyBindings::QGamepadKeyBindings(QGamepadInputState *inputState)
     : QObject(inputState)
     , m_inputState(inputState)
+    , m_reverseIndexDirty(true)
+    , m_stamp(0)
+{
+    m_bindingOffsets.append(0);
+    //Only the actions bound to something that changed are checked again
+    connect(m_inputState, SIGNAL(stateChanged(QGamepadInputState::ChangeSummary)),
+            this, SLOT(checkChangedActions(QGamepadInputState::ChangeSummary)));
+    connect(m_inputState, SIGNAL(stateUpdated()), this, SLOT(checkUnindexedActions()));
+}
+
+int QGamepadKeyBindings::registerAction(const QString &action)
+{
+    int id = m_actionIds.value(action, -1);
+    if (id < 0) {
+        id = m_actionNames.count();
+        m_actionIds.insert(action, id);
+        m_actionNames.append(action);
+        m_bindingOffsets.append(m_bindings.count());
+        m_monitoredValues.append(0);
+        m_monitored.append(false);
+        m_actionStamps.append(0);
+    }
+    return id;
+}
+
+void QGamepadKeyBindings::addBinding(int action, const KeyBinding &binding)
+{
+    if (action < 0 || action >= m_actionNames.count())
+        return;
+
+    //Keep the table grouped by action, bindings are added far less often
+    //than they are evaluated. Newest first, as QMultiMap::values() returned
+    //them, since the first axis binding decides the value of an action.
+    m_bindings.insert(m_bindingOffsets.at(action), binding);
+    for (int i = action + 1; i < m_bindingOffsets.count(); ++i)
+        ++m_bindingOffsets[i];
+    m_reverseIndexDirty = true;
+}
+
+int QGamepadKeyBindings::controlIndex(const KeyBinding &binding) const
 {
-    connect(m_inputState, SIGNAL(stateUpdated()), this, SLOT(checkMonitoredActions()));
+    switch (binding.type) {
+    case QGamepadKeyBindings::Key:
+        if (binding.identifier >= 0 && binding.identifier < QGamepadStateSnapshot::LatinKeyCount)
+            return binding.identifier;
+        if (binding.identifier >= QGamepadStateSnapshot::SpecialKeyBase
+                && binding.identifier < QGamepadStateSnapshot::SpecialKeyBase + QGamepadStateSnapshot::SpecialKeyCount)
+            return QGamepadStateSnapshot::LatinKeyCount + binding.identifier - QGamepadStateSnapshot::SpecialKeyBase;
+        break;
+    case QGamepadKeyBindings::Button:
+        if (binding.controllerId >= 0 && binding.controllerId < QGamepadStateSnapshot::MaxGamepads
+                && binding.identifier >= 0 && binding.identifier < QGamepadHandler::KeyCount)
+            return KeyControls + binding.controllerId * GamepadControls + binding.identifier;
+        break;
+    case QGamepadKeyBindings::Axis:
+        if (binding.controllerId >= 0 && binding.controllerId < QGamepadStateSnapshot::MaxGamepads
+                && binding.identifier >= 0 && binding.identifier < QGamepadHandler::AbsCount)
+            return KeyControls + binding.controllerId * GamepadControls + QGamepadHandler::KeyCount + binding.identifier;
+        break;
+    default:
+        break;
+    }
+    return -1;
+}
+
+void QGamepadKeyBindings::rebuildReverseIndex()
+{
+    m_reverseIndexDirty = false;
+    m_mouseActions.clear();
+    m_unindexedActions.clear();
+
+    //Count the actions of every control, then turn the counts into offsets
+    m_controlOffsets.fill(0, ControlCount + 1);
+    for (int action = 0; action < m_actionNames.count(); ++action) {
+        bool mouse = false;
+        bool unindexed = false;
+        for (int i = m_bindingOffsets.at(action); i < m_bindingOffsets.at(action + 1); ++i) {
+            const KeyBinding &binding = m_bindings.at(i);
+            if (binding.type == QGamepadKeyBindings::Mouse || binding.modifiers != Qt::NoModifier)
+                mouse = true;
+            if (binding.type == QGamepadKeyBindings::Mouse)
+                continue;
+
+            int control = controlIndex(binding);
+            if (control >= 0)
+                ++m_controlOffsets[control + 1];
+            else
+                unindexed = true;
+        }
+        if (mouse)
+            m_mouseActions.append(action);
+        if (unindexed)
+            m_unindexedActions.append(action);
+    }
+
+    for (int control = 0; control < ControlCount; ++control)
+        m_controlOffsets[control + 1] += m_controlOffsets[control];
+
+    //An action bound twice to the same control shows up twice, the stamps
+    //filter that out
+    m_controlActions.resize(m_controlOffsets.at(ControlCount));
+    QVector<int> fill = m_controlOffsets;
+    for (int action = 0; action < m_actionNames.count(); ++action) {
+        for (int i = m_bindingOffsets.at(action); i < m_bindingOffsets.at(action + 1); ++i) {
+            const KeyBinding &binding = m_bindings.at(i);
+            if (binding.type == QGamepadKeyBindings::Mouse)
+                continue;
+            int control = controlIndex(binding);
+            if (control >= 0)
+                m_controlActions[fill[control]++] = action;
+        }
+    }
 }
 
 void QGamepadKeyBindings::addAction(const QString &action, Qt::Key key, Qt::KeyboardModifiers modifiers)
+{
+    addAction(registerAction(action), key, modifiers);
+}
+
+void QGamepadKeyBindings::addAction(const QString &action, Qt::MouseButton button, Qt::KeyboardModifiers modifiers)
+{
+    addAction(registerAction(action), button, modifiers);
+}
+
+void QGamepadKeyBindings::addAction(const QString &action, QGamepadInputState::Buttons button, int controllerId)
+{
+    addAction(registerAction(action), button, controllerId);
+}
+
+void QGamepadKeyBindings::addAction(const QString &action, QGamepadInputState::Axis axis, int controllerId)
+{
+    addAction(registerAction(action), axis, controllerId);
+}
+
+void QGamepadKeyBindings::addAction(int action, Qt::Key key, Qt::KeyboardModifiers modifiers)
 {
     struct KeyBinding keyBinding;
     keyBinding.type = QGamepadKeyBindings::Key;
@@ -39,10 +172,10 @@ void QGamepadKeyBindings::addAction(const QString &action, Qt::Key key, Qt::Keyb
     keyBinding.modifiers = modifiers;
     keyBinding.controllerId = -1;
 
-    m_bindingsMap.insert(action, keyBinding);
+    addBinding(action, keyBinding);
 }
 
-void QGamepadKeyBindings::addAction(const QString &action, Qt::MouseButton button, Qt::KeyboardModifiers modifiers)
+void QGamepadKeyBindings::addAction(int action, Qt::MouseButton button, Qt::KeyboardModifiers modifiers)
 {
     struct KeyBinding keyBinding;
     keyBinding.type = QGamepadKeyBindings::Mouse;
@@ -50,10 +183,10 @@ void QGamepadKeyBindings::addAction(const QString &action, Qt::MouseButton butto
     keyBinding.modifiers = modifiers;
     keyBinding.controllerId = -1;
 
-    m_bindingsMap.insert(action, keyBinding);
+    addBinding(action, keyBinding);
 }
 
-void QGamepadKeyBindings::addAction(const QString &action, QGamepadInputState::Buttons button, int controllerId)
+void QGamepadKeyBindings::addAction(int action, QGamepadInputState::Buttons button, int controllerId)
 {
     struct KeyBinding keyBinding;
     keyBinding.type = QGamepadKeyBindings::Button;
@@ -61,10 +194,10 @@ void QGamepadKeyBindings::addAction(const QString &action, QGamepadInputState::B
     keyBinding.modifiers = Qt::NoModifier;
     keyBinding.controllerId = controllerId;
 
-    m_bindingsMap.insert(action, keyBinding);
+    addBinding(action, keyBinding);
 }
 
-void QGamepadKeyBindings::addAction(const QString &action, QGamepadInputState::Axis axis, int controllerId)
+void QGamepadKeyBindings::addAction(int action, QGamepadInputState::Axis axis, int controllerId)
 {
     struct KeyBinding keyBinding;
     keyBinding.type = QGamepadKeyBindings::Axis;
@@ -72,44 +205,62 @@ void QGamepadKeyBindings::addAction(const QString &action, QGamepadInputState::A
     keyBinding.modifiers = Qt::NoModifier;
     keyBinding.controllerId = controllerId;
 
-    m_bindingsMap.insert(action, keyBinding);
+    addBinding(action, keyBinding);
 }
 
 void QGamepadKeyBindings::registerMonitoredAction(const QString &action)
 {
-    if(!m_monitoredActions.contains(action))
-        m_monitoredActions.insert(action, checkAction(action));
+    int id = registerAction(action);
+    if(!m_monitored.at(id)) {
+        m_monitoredActions.append(id);
+        m_monitored[id] = true;
+        m_monitoredValues[id] = checkAction(id);
+    }
 }
 
 void QGamepadKeyBindings::deregisterMonitoredAction(const QString &action)
 {
-    m_monitoredActions.remove(action);
+    int id = actionId(action);
+    int index = m_monitoredActions.indexOf(id);
+    if (index >= 0) {
+        m_monitoredActions.remove(index);
+        m_monitored[id] = false;
+    }
 }
 
 int QGamepadKeyBindings::checkAction(const QString &action)
 {
-    QList<KeyBinding> keyBindings = m_bindingsMap.values(action);
+    return checkAction(actionId(action));
+}
+
+qreal QGamepadKeyBindings::evaluateAction(int action) const
+{
+    if (action < 0 || action >= m_actionNames.count())
+        return 0;
 
-    foreach(KeyBinding binding, keyBindings) {
-        switch(binding.type) {
+    const KeyBinding *binding = m_bindings.constData() + m_bindingOffsets.at(action);
+    const KeyBinding *end = m_bindings.constData() + m_bindingOffsets.at(action + 1);
+
+    for (; binding != end; ++binding) {
+        switch(binding->type) {
         case QGamepadKeyBindings::Key:
-            if (m_inputState->queryKey(binding.identifier)) {
-                if (binding.modifiers == (binding.modifiers & m_inputState->keyboardModifiers()))
+            if (m_inputState->queryKey(binding->identifier)) {
+                if (binding->modifiers == (binding->modifiers & m_inputState->keyboardModifiers()))
                     return 1;
             }
             break;
         case QGamepadKeyBindings::Button:
-            if (m_inputState->queryGamepadButton((QGamepadInputState::Buttons)binding.identifier, binding.controllerId))
+            if (m_inputState->queryGamepadButton((QGamepadInputState::Buttons)binding->identifier, binding->controllerId))
                 return 1;
             break;
         case QGamepadKeyBindings::Mouse:
-            if (binding.identifier == (binding.identifier & m_inputState->mouseButtons())) {
-                if (binding.modifiers == (binding.modifiers & m_inputState->keyboardModifiers()))
+            if (binding->identifier == (binding->identifier & m_inputState->mouseButtons())) {
+                if (binding->modifiers == (binding->modifiers & m_inputState->keyboardModifiers()))
                     return 1;
             }
             break;
         case QGamepadKeyBindings::Axis:
-            return m_inputState->queryGamepadAxis((QGamepadInputState::Axis)binding.identifier, binding.controllerId);
+            return m_inputState->queryGamepadAxis((QGamepadInputState::Axis)binding->identifier, binding->controllerId);
             break;
         default:
             qWarning("Unknown action type");
@@ -120,11 +271,24 @@ int QGamepadKeyBindings::checkAction(const QString &action)
     return 0;
 }
 
+void QGamepadKeyBindings::evaluateActions(qreal *values) const
+{
+    for (int action = 0; action < m_actionNames.count(); ++action)
+        values[action] = evaluateAction(action);
+}
+
 qreal QGamepadKeyBindings::checkAxisAction(const QString &action)
 {
-    QList<KeyBinding> keyBindings = m_bindingsMap.values(action);
+    return checkAxisAction(actionId(action));
+}
+
+qreal QGamepadKeyBindings::checkAxisAction(int action) const
+{
+    if (action < 0 || action >= m_actionNames.count())
+        return 0.0;
 
-    foreach(KeyBinding binding, keyBindings) {
+    for (int i = m_bindingOffsets.at(action); i < m_bindingOffsets.at(action + 1); ++i) {
+        const KeyBinding &binding = m_bindings.at(i);
         switch(binding.type) {
         case QGamepadKeyBindings::Axis:
             return m_inputState->queryGamepadAxis((QGamepadInputState::Axis)binding.identifier, binding.controllerId);
@@ -140,23 +304,97 @@ qreal QGamepadKeyBindings::checkAxisAction(const QString &action)
 
 void QGamepadKeyBindings::reset()
 {
-    m_bindingsMap.clear();
+    m_bindings.clear();
+    m_bindingOffsets.fill(0);
     m_monitoredActions.clear();
+    m_monitored.fill(false);
+    m_reverseIndexDirty = true;
 }
 
 void QGamepadKeyBindings::checkMonitoredActions()
 {
-    foreach (QString action, m_monitoredActions.keys()) {
-        int currentValue = checkAction(action);
-        if (currentValue != m_monitoredActions.value(action, 0)) {
-            if (currentValue)
-                emit monitoredActionActivated(action);
-            else
-                emit monitoredActionDeactivated(action);
-            //Reset stored value
-            m_monitoredActions.insert(action, currentValue);
+    foreach (int action, m_monitoredActions)
+        checkMonitoredAction(action);
+}
+
+void QGamepadKeyBindings::checkMonitoredAction(int action)
+{
+    int currentValue = checkAction(action);
+    if (currentValue != m_monitoredValues.at(action)) {
+        if (currentValue)
+            emit monitoredActionActivated(m_actionNames.at(action));
+        else
+            emit monitoredActionDeactivated(m_actionNames.at(action));
+        //Reset stored value
+        m_monitoredValues[action] = currentValue;
+    }
+}
+
+void QGamepadKeyBindings::checkControl(int control)
+{
+    for (int i = m_controlOffsets.at(control); i < m_controlOffsets.at(control + 1); ++i) {
+        int action = m_controlActions.at(i);
+        if (m_monitored.at(action) && m_actionStamps.at(action) != m_stamp) {
+            m_actionStamps[action] = m_stamp;
+            checkMonitoredAction(action);
         }
     }
 }
 
+void QGamepadKeyBindings::checkChangedActions(const QGamepadInputState::ChangeSummary &changes)
+{
+    if (m_monitoredActions.isEmpty())
+        return;
+    if (m_reverseIndexDirty)
+        rebuildReverseIndex();
+
+    //Stamps are only compared for equality, wrapping around is harmless
+    //as long as no action sleeps through 2^32 notifications
+    ++m_stamp;
+
+    if (changes.keys) {
+        const int bits = 8 * sizeof(ulong);
+        for (int word = 0; word < QGamepadStateSnapshot::KeyWords; ++word) {
+            for (ulong changed = changes.keyMask[word]; changed; changed &= changed - 1)
+                checkControl(word * bits + __builtin_ctzl(changed));
+        }
+    }
+
+    for (uint gamepads = changes.gamepads; gamepads; gamepads &= gamepads - 1) {
+        int id = __builtin_ctz(gamepads);
+        int base = KeyControls + id * GamepadControls;
+        const QGamepadInputState::ChangeSummary::Gamepad &gamepad = changes.gamepad[id];
+
+        const int bits = 8 * sizeof(ulong);
+        for (int word = 0; word < QGamepadStateSnapshot::ButtonWords; ++word) {
+            for (ulong changed = gamepad.buttons[word]; changed; changed &= changed - 1)
+                checkControl(base + word * bits + __builtin_ctzl(changed));
+        }
+        for (quint64 changed = gamepad.axes; changed; changed &= changed - 1)
+            checkControl(base + QGamepadHandler::KeyCount + __builtin_ctzll(changed));
+    }
+
+    if (changes.mouse) {
+        foreach (int action, m_mouseActions) {
+            if (m_monitored.at(action) && m_actionStamps.at(action) != m_stamp) {
+                m_actionStamps[action] = m_stamp;
+                checkMonitoredAction(action);
+            }
+        }
+    }
+}
+
+void QGamepadKeyBindings::checkUnindexedActions()
+{
+    if (m_monitoredActions.isEmpty())
+        return;
+    if (m_reverseIndexDirty)
+        rebuildReverseIndex();
+
+    foreach (int action, m_unindexedActions) {
+        if (m_monitored.at(action))
+            checkMonitoredAction(action);
+    }
+}
+
 QT_END_NAMESPACE
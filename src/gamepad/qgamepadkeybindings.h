@@ -26,7 +26,8 @@
 #include <QtGamepad/qtgamepadglobal.h>
 #include <QtGamepad/qgamepadinputstate.h>
 
-#include <QtCore/QMultiMap>
+#include <QtCore/QHash>
+#include <QtCore/QVector>
 
 QT_BEGIN_HEADER
 
@@ -48,21 +49,40 @@ class Q_GAMEPAD_EXPORT QGamepadKeyBindings : public QObject
 public:
     QGamepadKeyBindings(QGamepadInputState *inputState);
 
+    //Actions are numbered from 0 in the order they are first seen. The
+    //integer overloads avoid the name lookup.
+    int registerAction(const QString &action);
+    int actionId(const QString &action) const { return m_actionIds.value(action, -1); }
+    QString actionName(int action) const { return m_actionNames.value(action); }
+    int actionCount() const { return m_actionNames.count(); }
+
     void addAction(const QString &action, Qt::Key key, Qt::KeyboardModifiers modifiers = Qt::NoModifier);
     void addAction(const QString &action, Qt::MouseButton button, Qt::KeyboardModifiers modifiers = Qt::NoModifier);
     void addAction(const QString &action, QGamepadInputState::Buttons button, int controllerId = 0);
     void addAction(const QString &action, QGamepadInputState::Axis axis, int controllerId = 0);
+    void addAction(int action, Qt::Key key, Qt::KeyboardModifiers modifiers = Qt::NoModifier);
+    void addAction(int action, Qt::MouseButton button, Qt::KeyboardModifiers modifiers = Qt::NoModifier);
+    void addAction(int action, QGamepadInputState::Buttons button, int controllerId = 0);
+    void addAction(int action, QGamepadInputState::Axis axis, int controllerId = 0);
 
     void registerMonitoredAction(const QString &action);
     void deregisterMonitoredAction(const QString &action);
 
     int checkAction(const QString &action);
     qreal checkAxisAction(const QString &action);
+    int checkAction(int action) const { return int(evaluateAction(action)); }
+    qreal checkAxisAction(int action) const;
+
+    //Writes the value of every action, actionCount() entries, in one pass
+    //over the binding table: 1 or 0 for digital bindings, the position for axes
+    void evaluateActions(qreal *values) const;
 
-    void reset(); //Remove all keybindings
+    void reset(); //Remove all keybindings, action ids stay valid
 
 private slots:
     void checkMonitoredActions();
+    void checkChangedActions(const QGamepadInputState::ChangeSummary &changes);
+    void checkUnindexedActions();
 
 signals:
     void monitoredActionActivated(const QString &action);
@@ -77,9 +97,47 @@ private:
         int controllerId;
     };
 
+    //Controls of the reverse index: keys in the ranges of
+    //QGamepadStateSnapshot::keys, then the buttons and axes of every gamepad
+    enum {
+        KeyControls = QGamepadStateSnapshot::LatinKeyCount + QGamepadStateSnapshot::SpecialKeyCount,
+        GamepadControls = QGamepadHandler::KeyCount + QGamepadHandler::AbsCount,
+        ControlCount = KeyControls + QGamepadStateSnapshot::MaxGamepads * GamepadControls
+    };
+
+    void addBinding(int action, const KeyBinding &binding);
+    qreal evaluateAction(int action) const;
+    int controlIndex(const KeyBinding &binding) const;
+    void rebuildReverseIndex();
+    void checkControl(int control);
+    void checkMonitoredAction(int action);
+
     QGamepadInputState *m_inputState;
-    QMultiMap<QString, QGamepadKeyBindings::KeyBinding> m_bindingsMap;
-    QMap<QString, bool> m_monitoredActions;
+    QHash<QString, int> m_actionIds;
+    QVector<QString> m_actionNames;
+    //Bindings grouped by action, those of action i are
+    //m_bindings[m_bindingOffsets[i]] up to m_bindings[m_bindingOffsets[i + 1]]
+    QVector<KeyBinding> m_bindings;
+    QVector<int> m_bindingOffsets;
+    QVector<int> m_monitoredActions;
+    //Last value of every monitored action, indexed by action
+    QVector<int> m_monitoredValues;
+    QVector<bool> m_monitored;
+
+    //Actions depending on each control, the actions of control i are
+    //m_controlActions[m_controlOffsets[i]] up to m_controlOffsets[i + 1].
+    //Rebuilt lazily after bindings change.
+    bool m_reverseIndexDirty;
+    QVector<int> m_controlOffsets;
+    QVector<int> m_controlActions;
+    //Actions with mouse or modifier bindings, rechecked when the mouse
+    //state changes, and actions with bindings outside the index, rechecked
+    //on every update
+    QVector<int> m_mouseActions;
+    QVector<int> m_unindexedActions;
+    //Makes sure an action is only checked once per notification
+    QVector<uint> m_actionStamps;
+    uint m_stamp;
 };
 
 QT_END_NAMESPACE
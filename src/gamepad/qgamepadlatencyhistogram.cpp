@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "qgamepadlatencyhistogram.h"
+
+QT_BEGIN_NAMESPACE
+
+QGamepadLatencyHistogram::QGamepadLatencyHistogram()
+{
+    reset();
+}
+
+QGamepadLatencyHistogram::QGamepadLatencyHistogram(const QGamepadLatencyHistogram &other)
+{
+    *this = other;
+}
+
+QGamepadLatencyHistogram &QGamepadLatencyHistogram::operator=(const QGamepadLatencyHistogram &other)
+{
+    for (int i = 0; i < BucketCount; ++i)
+        m_buckets[i].store(other.m_buckets[i].load());
+    m_count.store(other.m_count.load());
+    m_maximum.store(other.m_maximum.load());
+    return *this;
+}
+
+int QGamepadLatencyHistogram::bucketIndex(quint64 usecs)
+{
+    if (usecs < SubBucketCount)
+        return int(usecs);
+    if (usecs > Q_UINT64_C(0xffffffff))
+        return BucketCount - 1;
+
+    //Highest set bit picks the power of two, the next three bits the sub bucket
+    int msb = 63 - __builtin_clzll(usecs);
+    return (msb - SubBucketBits + 1) * SubBucketCount + int((usecs >> (msb - SubBucketBits)) & (SubBucketCount - 1));
+}
+
+quint64 QGamepadLatencyHistogram::bucketLowerBound(int bucket)
+{
+    if (bucket < SubBucketCount)
+        return bucket;
+
+    int shift = bucket / SubBucketCount - 1;
+    return quint64(SubBucketCount + bucket % SubBucketCount) << shift;
+}
+
+quint64 QGamepadLatencyHistogram::bucketUpperBound(int bucket)
+{
+    if (bucket < SubBucketCount)
+        return bucket;
+
+    int shift = bucket / SubBucketCount - 1;
+    return bucketLowerBound(bucket) + (Q_UINT64_C(1) << shift) - 1;
+}
+
+void QGamepadLatencyHistogram::record(quint64 usecs)
+{
+    m_buckets[bucketIndex(usecs)].fetchAndAddRelaxed(1);
+    m_count.fetchAndAddRelaxed(1);
+
+    uint value = usecs > Q_UINT64_C(0xffffffff) ? 0xffffffff : uint(usecs);
+    int maximum = m_maximum.load();
+    while (value > uint(maximum) && !m_maximum.testAndSetRelaxed(maximum, int(value)))
+        maximum = m_maximum.load();
+}
+
+void QGamepadLatencyHistogram::reset()
+{
+    for (int i = 0; i < BucketCount; ++i)
+        m_buckets[i].store(0);
+    m_count.store(0);
+    m_maximum.store(0);
+}
+
+quint64 QGamepadLatencyHistogram::percentile(qreal percent) const
+{
+    int total = count();
+    if (total == 0)
+        return 0;
+
+    qint64 wanted = qint64(total * percent / 100.0 + 0.5);
+    qint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += m_buckets[i].load();
+        if (seen >= wanted && seen > 0)
+            return qMin(bucketUpperBound(i), maximum());
+    }
+    return maximum();
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADLATENCYHISTOGRAM_H
+#define QGAMEPADLATENCYHISTOGRAM_H
+
+#include <QtCore/QAtomicInt>
+#include <QtGamepad/qtgamepadglobal.h>
+
+QT_BEGIN_HEADER
+
+QT_BEGIN_NAMESPACE
+
+//Log-linear histogram of latencies in microseconds. Every power of two is
+//split into 8 buckets, so any recorded value is known to within 12.5%.
+//Recording is a single relaxed atomic increment and never allocates, so
+//it can stay enabled in production and be read from any thread.
+class Q_GAMEPAD_EXPORT QGamepadLatencyHistogram
+{
+public:
+    enum Stage {
+        KernelToDecode,
+        DecodeToApply,
+        StageCount
+    };
+
+    enum { SubBucketBits = 3, SubBucketCount = 1 << SubBucketBits, BucketCount = 30 * SubBucketCount };
+
+    QGamepadLatencyHistogram();
+    QGamepadLatencyHistogram(const QGamepadLatencyHistogram &other);
+    QGamepadLatencyHistogram &operator=(const QGamepadLatencyHistogram &other);
+
+    void record(quint64 usecs);
+    void reset();
+
+    int count() const { return m_count.load(); }
+    quint64 maximum() const { return quint32(m_maximum.load()); }
+    quint64 percentile(qreal percent) const;
+
+    int bucketSamples(int bucket) const { return m_buckets[bucket].load(); }
+    static quint64 bucketLowerBound(int bucket);
+    static quint64 bucketUpperBound(int bucket);
+    static int bucketIndex(quint64 usecs);
+
+private:
+    QAtomicInt m_buckets[BucketCount];
+    QAtomicInt m_count;
+    QAtomicInt m_maximum;
+};
+
+QT_END_NAMESPACE
+
+QT_END_HEADER
+
+#endif // QGAMEPADLATENCYHISTOGRAM_H
@@ -23,64 +23,454 @@
 #include "qgamepadmanager.h"
 
 #include "qgamepadhandler.h"
-#include "qgamepaddevicediscovery_p.h"
+#include "qgamepadevdevbackend_p.h"
+#include "qgamepadframering_p.h"
+#include "qgamepadreaderthread_p.h"
+#include "qgamepadmultiplexer_p.h"
+#include "qgamepadrecorder_p.h"
+#include "qgamepadmappingdatabase.h"
+#include "qgamepadforcefeedback_p.h"
 
 #include <QtCore/QStringList>
 
 #include <QtCore/QDebug>
 
+#include <string.h>
+
 QT_BEGIN_NAMESPACE
 
 QGamepadManager::QGamepadManager(QObject *parent) :
     QObject(parent)
 {
-    m_gamepadDeviceDiscovery = QGamepadDeviceDiscovery::create(this);
-    if (m_gamepadDeviceDiscovery) {
-        // scan and add already connected joysticks
-        QStringList devices = m_gamepadDeviceDiscovery->scanConnectedDevices();
-        foreach (QString device, devices) {
-            addGamepad(device);
-        }
+    init();
+    addBackend(new QGamepadEvdevBackend);
+}
+
+QGamepadManager::QGamepadManager(QGamepadBackend *backend, QObject *parent) :
+    QObject(parent)
+{
+    init();
+    addBackend(backend);
+}
+
+void QGamepadManager::init()
+{
+    m_deliveryModes = QGamepadHandler::EventDelivery | QGamepadHandler::FrameDelivery;
+    m_readMode = NotifierReading;
+    m_readerThread = 0;
+    m_multiplexer = 0;
+    m_monotonicClock = false;
+    m_latencyTracking = false;
+    m_recorder = new QGamepadRecorder;
+    m_mappings = new QGamepadMappingDatabase;
+    //Started on the first effect played
+    m_forceFeedbackWriter = new QGamepadForceFeedbackWriter;
+    m_sinkCount = 0;
 
-        connect(m_gamepadDeviceDiscovery, SIGNAL(deviceDetected(QString)), this, SLOT(addGamepad(QString)));
-        connect(m_gamepadDeviceDiscovery, SIGNAL(deviceRemoved(QString)), this, SLOT(removeGamepad(QString)));
+    for (int i = 0; i < MaxGamepads; ++i) {
+        m_slots[i].handler = 0;
+        m_slots[i].info = 0;
+        m_slots[i].frameRing = 0;
+        m_slots[i].generation = 1;
     }
+
+    qRegisterMetaType<QGamepadHandler::GamepadFrame>("QGamepadHandler::GamepadFrame");
+}
+
+void QGamepadManager::addBackend(QGamepadBackend *backend)
+{
+    if (!backend || m_backends.contains(backend))
+        return;
+
+    backend->setParent(this);
+    m_backends.append(backend);
+
+    // scan and add already connected joysticks
+    QStringList devices = backend->scanConnectedDevices();
+    foreach (QString device, devices) {
+        addGamepad(backend, device);
+    }
+
+    connect(backend, SIGNAL(deviceDetected(QString)), this, SLOT(addGamepad(QString)));
+    connect(backend, SIGNAL(deviceRemoved(QString)), this, SLOT(removeGamepad(QString)));
+
+    if (m_readMode == MultiplexedReading && backend->deviceDiscovery())
+        m_multiplexer->setDeviceDiscovery(backend->deviceDiscovery());
 }
 
 QGamepadManager::~QGamepadManager()
 {
-    qDeleteAll(m_gamepads);
+    //Backends are deleted after us and may still report removals
+    foreach (QGamepadBackend *backend, m_backends)
+        disconnect(backend, 0, this, 0);
+
+    if (m_readerThread)
+        m_readerThread->stop();
+    for (int i = 0; i < MaxGamepads; ++i) {
+        delete m_slots[i].handler;
+        delete m_slots[i].info;
+        delete m_slots[i].frameRing;
+    }
+    //Handlers detach from the writer when deleted
+    delete m_forceFeedbackWriter;
+    delete m_recorder;
+    delete m_mappings;
+}
+
+QGamepadInfo *QGamepadManager::gamepadInfo(int id) const
+{
+    if (id < 0 || id >= MaxGamepads)
+        return 0;
+    return m_slots[id].info;
+}
+
+QGamepadInfo *QGamepadManager::gamepadInfoForHandle(quint32 handle) const
+{
+    int id = handle & 0xff;
+    if (id >= MaxGamepads || !m_slots[id].info || m_slots[id].generation != handle >> 8)
+        return 0;
+    return m_slots[id].info;
+}
+
+int QGamepadManager::slotForDevice(const QString &deviceNode) const
+{
+    for (int i = 0; i < MaxGamepads; ++i) {
+        if (m_slots[i].handler && m_slots[i].deviceNode == deviceNode)
+            return i;
+    }
+    return -1;
+}
+
+QGamepadHandler *QGamepadManager::handlerForInfo(QGamepadInfo *info) const
+{
+    if (!info || info->id() < 0 || info->id() >= MaxGamepads || m_slots[info->id()].info != info)
+        return 0;
+    return m_slots[info->id()].handler;
+}
+
+bool QGamepadManager::addEventSink(QGamepadEventSink *sink)
+{
+    for (int i = 0; i < m_sinkCount; ++i) {
+        if (m_sinks[i] == sink)
+            return true;
+    }
+    if (m_sinkCount == MaxEventSinks)
+        return false;
+    m_sinks[m_sinkCount++] = sink;
+    return true;
+}
+
+void QGamepadManager::removeEventSink(QGamepadEventSink *sink)
+{
+    for (int i = 0; i < m_sinkCount; ++i) {
+        if (m_sinks[i] != sink)
+            continue;
+        memmove(m_sinks + i, m_sinks + i + 1, (m_sinkCount - i - 1) * sizeof(QGamepadEventSink*));
+        --m_sinkCount;
+        return;
+    }
+}
+
+void QGamepadManager::processGamepadFrame(int slot, const QGamepadHandler::GamepadFrame &frame)
+{
+    if (slot < 0 || slot >= MaxGamepads || !m_slots[slot].info)
+        return;
+
+    for (int i = 0; i < m_sinkCount; ++i)
+        m_sinks[i]->processGamepadFrame(slot, frame);
+    dispatchFrame(m_slots[slot].info, frame);
+}
+
+void QGamepadManager::setDeliveryModes(QGamepadHandler::DeliveryModes modes)
+{
+    m_deliveryModes = modes;
+    for (int i = 0; i < MaxGamepads; ++i) {
+        if (m_slots[i].handler)
+            m_slots[i].handler->setDeliveryModes(modes);
+    }
+}
+
+void QGamepadManager::setReadMode(QGamepadManager::ReadMode mode)
+{
+    if (mode == m_readMode)
+        return;
+
+    for (int i = 0; i < MaxGamepads; ++i) {
+        if (m_slots[i].handler)
+            detachHandler(m_slots[i].handler);
+    }
+
+    if (m_readMode == ThreadedReading) {
+        m_readerThread->stop();
+        //Hand out whatever was still queued
+        processPendingFrames();
+    } else if (m_readMode == MultiplexedReading) {
+        m_multiplexer->setDeviceDiscovery(0);
+    }
+
+    m_readMode = mode;
+
+    if (m_readMode == ThreadedReading && !m_readerThread) {
+        m_readerThread = new QGamepadReaderThread(this);
+    } else if (m_readMode == MultiplexedReading) {
+        if (!m_multiplexer)
+            m_multiplexer = new QGamepadMultiplexer(this);
+        foreach (QGamepadBackend *backend, m_backends) {
+            if (backend->deviceDiscovery())
+                m_multiplexer->setDeviceDiscovery(backend->deviceDiscovery());
+        }
+    }
+
+    for (int i = 0; i < MaxGamepads; ++i) {
+        if (m_slots[i].handler)
+            attachHandler(m_slots[i].handler);
+    }
+
+    if (m_readMode == ThreadedReading)
+        m_readerThread->start();
+}
+
+int QGamepadManager::frameOverflowCount(QGamepadInfo *info) const
+{
+    QGamepadHandler *handler = handlerForInfo(info);
+    if (!handler || !m_slots[handler->slot()].frameRing)
+        return 0;
+    return m_slots[handler->slot()].frameRing->overflowCount();
+}
+
+void QGamepadManager::setMonotonicClock(bool monotonic)
+{
+    m_monotonicClock = monotonic;
+    for (int i = 0; i < MaxGamepads; ++i) {
+        if (m_slots[i].handler)
+            m_slots[i].handler->setMonotonicClock(monotonic);
+    }
+}
+
+void QGamepadManager::setLatencyTrackingEnabled(bool enabled)
+{
+    m_latencyTracking = enabled;
+    for (int i = 0; i < MaxGamepads; ++i) {
+        if (m_slots[i].handler)
+            m_slots[i].handler->setLatencyTrackingEnabled(enabled);
+    }
+}
+
+QGamepadLatencyHistogram QGamepadManager::latencyHistogram(QGamepadInfo *info, QGamepadLatencyHistogram::Stage stage) const
+{
+    QGamepadHandler *handler = handlerForInfo(info);
+    if (handler)
+        return *handler->latencyHistogram(stage);
+    return QGamepadLatencyHistogram();
+}
+
+void QGamepadManager::resetLatencyHistograms()
+{
+    for (int i = 0; i < MaxGamepads; ++i) {
+        if (!m_slots[i].handler)
+            continue;
+        for (int stage = 0; stage < QGamepadLatencyHistogram::StageCount; ++stage)
+            m_slots[i].handler->latencyHistogram(QGamepadLatencyHistogram::Stage(stage))->reset();
+    }
+}
+
+QGamepadHandler::Statistics QGamepadManager::statistics(QGamepadInfo *info) const
+{
+    QGamepadHandler *handler = handlerForInfo(info);
+    if (handler)
+        return handler->statistics();
+
+    QGamepadHandler::Statistics statistics;
+    memset(&statistics, 0, sizeof(statistics));
+    return statistics;
+}
+
+void QGamepadManager::resetStatistics()
+{
+    for (int i = 0; i < MaxGamepads; ++i) {
+        if (m_slots[i].handler)
+            m_slots[i].handler->resetStatistics();
+    }
+}
+
+bool QGamepadManager::startRecording(const QString &fileName)
+{
+    return m_recorder->start(fileName);
+}
+
+void QGamepadManager::stopRecording()
+{
+    m_recorder->stop();
+}
+
+bool QGamepadManager::isRecording() const
+{
+    return m_recorder->isRecording();
+}
+
+bool QGamepadManager::loadMappings(const QString &fileName)
+{
+    if (!m_mappings->load(fileName))
+        return false;
+
+    //Keep the reader thread away from the tables while they are rebuilt
+    for (int i = 0; i < MaxGamepads; ++i) {
+        QGamepadHandler *handler = m_slots[i].handler;
+        if (!handler)
+            continue;
+        detachHandler(handler);
+        applyMapping(handler);
+        attachHandler(handler);
+    }
+    return true;
+}
+
+void QGamepadManager::applyMapping(QGamepadHandler *handler)
+{
+    if (handler->guid().isEmpty())
+        return;
+    handler->setControlMapping(m_mappings->mapping(handler->guid()));
+}
+
+void QGamepadManager::processPendingFrames()
+{
+    QGamepadHandler::GamepadFrame frame;
+
+    for (int i = 0; i < MaxGamepads; ++i) {
+        if (!m_slots[i].frameRing || !m_slots[i].info)
+            continue;
+        while (m_slots[i].frameRing->pop(&frame))
+            processGamepadFrame(i, frame);
+    }
+}
+
+void QGamepadManager::dispatchFrame(QGamepadInfo *info, const QGamepadHandler::GamepadFrame &frame)
+{
+    if (m_deliveryModes & QGamepadHandler::EventDelivery) {
+        for (int i = 0; i < frame.count; ++i) {
+            const QGamepadHandler::GamepadEvent &event = frame.events[i];
+            emit gamepadEvent(info, frame.time, (int)event.type, event.code, event.value);
+        }
+    }
+
+    if (m_deliveryModes & QGamepadHandler::FrameDelivery)
+        emit gamepadFrame(info, frame);
+}
+
+void QGamepadManager::attachHandler(QGamepadHandler *handler)
+{
+    //Virtual devices are fed directly by their backend
+    if (handler->isVirtual())
+        return;
+
+    switch (m_readMode) {
+    case ThreadedReading: {
+        QGamepadFrameRing *&ring = m_slots[handler->slot()].frameRing;
+        if (!ring)
+            ring = new QGamepadFrameRing;
+        handler->setFrameRing(ring);
+        m_readerThread->addHandler(handler);
+        break;
+    }
+    case MultiplexedReading:
+        m_multiplexer->addHandler(handler);
+        break;
+    default:
+        break;
+    }
 }
 
-void QGamepadManager::handleGamepadEvent(quint64 time, QGamepadHandler::GamepadEventType type, int number, int value)
+void QGamepadManager::detachHandler(QGamepadHandler *handler)
 {
-    QGamepadHandler *sender = qobject_cast<QGamepadHandler*>(this->sender());
-    emit gamepadEvent(m_gamepadInfos.value(sender), time, (int)type, number, value);
+    if (handler->isVirtual())
+        return;
+
+    switch (m_readMode) {
+    case ThreadedReading:
+        m_readerThread->removeHandler(handler);
+        handler->setFrameRing(0);
+        break;
+    case MultiplexedReading:
+        m_multiplexer->removeHandler(handler);
+        break;
+    default:
+        break;
+    }
 }
 
 void QGamepadManager::addGamepad(const QString &deviceNode)
 {
+    QGamepadBackend *backend = qobject_cast<QGamepadBackend*>(sender());
+    if (backend)
+        addGamepad(backend, deviceNode);
+}
+
+void QGamepadManager::addGamepad(QGamepadBackend *backend, const QString &deviceNode)
+{
+    if (slotForDevice(deviceNode) >= 0)
+        return;
 
     QGamepadHandler *handler;
-    handler = QGamepadHandler::create(deviceNode);
+    handler = backend->createHandler(deviceNode);
     if (handler) {
-        connect(handler, SIGNAL(handleGamepadEvent(quint64, QGamepadHandler::GamepadEventType, int, int)), this, SLOT(handleGamepadEvent(quint64, QGamepadHandler::GamepadEventType, int, int)));
-        m_gamepads.insert(deviceNode, handler);
-        m_gamepadInfos.insert(handler, new QGamepadInfo(m_gamepadInfos.count(), handler));
+        addHandler(deviceNode, handler);
     } else {
         qWarning("Failed to open gamepad");
     }
 }
 
-void QGamepadManager::removeGamepad(const QString &deviceNode)
+void QGamepadManager::addHandler(const QString &deviceNode, QGamepadHandler *handler)
 {
-    if (m_gamepads.contains(deviceNode)) {
-        QGamepadHandler *handler = m_gamepads.value(deviceNode);
-        m_gamepads.remove(deviceNode);
-        delete m_gamepadInfos.value(handler);
-        m_gamepadInfos.remove(handler);
+    int id = 0;
+    while (id < MaxGamepads && m_slots[id].handler)
+        ++id;
+    if (id == MaxGamepads) {
+        qWarning("Cannot add gamepad '%s': all %d slots are in use", qPrintable(deviceNode), int(MaxGamepads));
         delete handler;
+        return;
     }
+
+    Slot &slot = m_slots[id];
+    slot.handler = handler;
+    slot.deviceNode = deviceNode;
+    slot.info = new QGamepadInfo(id, handler, slot.generation);
+    handler->setSlot(id);
+
+    handler->setDeliveryModes(m_deliveryModes);
+    handler->setLatencyTrackingEnabled(m_latencyTracking);
+    if (m_monotonicClock)
+        handler->setMonotonicClock(true);
+    handler->setRecorder(m_recorder);
+    m_recorder->addDevice(handler, deviceNode);
+    applyMapping(handler);
+    handler->setForceFeedbackWriter(m_forceFeedbackWriter);
+    handler->addEventSink(this);
+    attachHandler(handler);
+    emit gamepadConnected(slot.info);
+}
+
+void QGamepadManager::removeGamepad(const QString &deviceNode)
+{
+    int id = slotForDevice(deviceNode);
+    if (id < 0)
+        return;
+
+    Slot &slot = m_slots[id];
+    detachHandler(slot.handler);
+    emit gamepadDisconnected(slot.info);
+    m_recorder->removeDevice(slot.handler);
+    slot.handler->setSlot(-1);
+    delete slot.handler;
+    delete slot.info;
+    delete slot.frameRing;
+    slot.handler = 0;
+    slot.info = 0;
+    slot.frameRing = 0;
+    slot.deviceNode.clear();
+    //Handles of the removed device no longer resolve
+    slot.generation = (slot.generation + 1) & 0xffffff;
+    if (!slot.generation)
+        slot.generation = 1;
 }
 
 QT_END_NAMESPACE
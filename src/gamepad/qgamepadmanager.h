@@ -27,22 +27,55 @@
 #include <QtCore/QHash>
 #include <QtGamepad/qtgamepadglobal.h>
 #include <QtGamepad/qgamepadhandler.h>
+#include <QtGamepad/qgamepadbackend.h>
+#include <QtGamepad/qgamepadeventsink.h>
 
 QT_BEGIN_HEADER
 
 QT_BEGIN_NAMESPACE
 
-class QGamepadDeviceDiscovery;
+class QGamepadReaderThread;
+class QGamepadMultiplexer;
+class QGamepadFrameRing;
+class QGamepadRecorder;
+class QGamepadMappingDatabase;
+class QGamepadForceFeedbackWriter;
 
 class Q_GAMEPAD_EXPORT QGamepadInfo
 {
 public:
-    QGamepadInfo(int id, QGamepadHandler *handler)
+    QGamepadInfo(int id, QGamepadHandler *handler, quint32 generation = 0)
         : m_id(id)
+        , m_generation(generation)
         , m_handler(handler)
     {}
+    //Slot index, reused once the device is removed
     int id() { return m_id; }
+    //Changes every time the slot is given to another device
+    quint32 generation() const { return m_generation; }
+    //Id and generation together, see QGamepadManager::gamepadInfo()
+    quint32 handle() const { return m_generation << 8 | quint32(m_id); }
+    QByteArray guid() { return m_handler->guid(); }
+    bool hasControlMapping() { return m_handler->hasControlMapping(); }
+    int syncDropCount() { return m_handler->syncDropCount(); }
+    QGamepadHandler::Statistics statistics() { return m_handler->statistics(); }
+    QGamepadLatencyHistogram *latencyHistogram(QGamepadLatencyHistogram::Stage stage) { return m_handler->latencyHistogram(stage); }
     QList<int> axisAvailable() { return m_handler->axisAvailable(); }
+    bool hasForceFeedback() { return m_handler->hasForceFeedback(); }
+    void rumble(qreal strongMagnitude, qreal weakMagnitude, int msecs) { m_handler->rumble(strongMagnitude, weakMagnitude, msecs); }
+    void playPeriodicEffect(QGamepadHandler::PeriodicWaveform waveform, qreal magnitude, int periodMsecs, int msecs) {
+        m_handler->playPeriodicEffect(waveform, magnitude, periodMsecs, msecs);
+    }
+    void stopForceFeedback() { m_handler->stopForceFeedback(); }
+    //Indexed by axis, QGamepadHandler::AbsCount entries
+    const QGamepadHandler::AxisCalibration *axisCalibration() { return m_handler->axisCalibration(); }
+    //Last reported axis values, indexed like axisCalibration()
+    const int *axisState() { return m_handler->axisState(); }
+    qreal normalizeAxis(int axis, int value) {
+        if (axis < 0 || axis >= QGamepadHandler::AbsCount)
+            return 0;
+        return QGamepadHandler::normalizeAxis(m_handler->axisCalibration()[axis], value);
+    }
     int getAxisMinimum(int axis) {
         QGamepadHandler::AxisInfo *axisInfo = m_handler->axisInfo(axis);
         if(axisInfo) {
@@ -75,28 +108,130 @@ public:
 
 private:
     int m_id;
+    quint32 m_generation;
     QGamepadHandler *m_handler;
 };
 
-class Q_GAMEPAD_EXPORT QGamepadManager : public QObject
+//The signals are an adapter over the frames the manager receives as the
+//QGamepadEventSink of every device, see addEventSink() for the direct path
+class Q_GAMEPAD_EXPORT QGamepadManager : public QObject, private QGamepadEventSink
 {
     Q_OBJECT
+    Q_ENUMS(ReadMode)
 public:
+    enum ReadMode {
+        NotifierReading,
+        ThreadedReading,
+        MultiplexedReading
+    };
+
+    //Without a backend, evdev devices discovered through udev are used
     explicit QGamepadManager(QObject *parent = 0);
+    explicit QGamepadManager(QGamepadBackend *backend, QObject *parent = 0);
     ~QGamepadManager();
 
+    //Devices are kept in a fixed table, a device's QGamepadInfo::id() is
+    //its index there and the lowest free slot is taken on connect
+    enum { MaxGamepads = 32 };
+
+    //0 for a free slot
+    QGamepadInfo *gamepadInfo(int id) const;
+    //0 once the device the handle was taken from is gone, even when its
+    //slot has been given to another device since
+    QGamepadInfo *gamepadInfoForHandle(quint32 handle) const;
+
+    //Sinks get the frames of every device ahead of the signals, in every
+    //read mode and whatever the delivery modes. They are not owned.
+    enum { MaxEventSinks = 8 };
+    bool addEventSink(QGamepadEventSink *sink);
+    void removeEventSink(QGamepadEventSink *sink);
+
+    //The manager takes ownership of added backends
+    void addBackend(QGamepadBackend *backend);
+    QList<QGamepadBackend*> backends() const { return m_backends; }
+
+    QGamepadHandler::DeliveryModes deliveryModes() const { return m_deliveryModes; }
+    void setDeliveryModes(QGamepadHandler::DeliveryModes modes);
+
+    //In ThreadedReading mode devices are read on a dedicated thread and
+    //frames are queued until processPendingFrames() is called.
+    //MultiplexedReading watches all devices and udev through one epoll set.
+    ReadMode readMode() const { return m_readMode; }
+    void setReadMode(ReadMode mode);
+    int frameOverflowCount(QGamepadInfo *info) const;
+
+    //Kernel timestamps use CLOCK_REALTIME unless switched with EVIOCSCLOCKID
+    bool isMonotonicClock() const { return m_monotonicClock; }
+    void setMonotonicClock(bool monotonic);
+
+    //Latency is tracked for frames only, from kernel timestamp to decode
+    //and from decode to QGamepadInputState::processGamepadFrame()
+    bool isLatencyTrackingEnabled() const { return m_latencyTracking; }
+    void setLatencyTrackingEnabled(bool enabled);
+    QGamepadLatencyHistogram latencyHistogram(QGamepadInfo *info, QGamepadLatencyHistogram::Stage stage) const;
+    void resetLatencyHistograms();
+
+    QGamepadHandler::Statistics statistics(QGamepadInfo *info) const;
+    void resetStatistics();
+
+    //Writes the raw input of every device, plus its calibration, to
+    //fileName for playback with QGamepadReplay
+    bool startRecording(const QString &fileName);
+    void stopRecording();
+    bool isRecording() const;
+
+    //Loads SDL GameControllerDB mappings and applies them to every device
+    //with a matching GUID, now and when it is connected later
+    bool loadMappings(const QString &fileName);
+    QGamepadMappingDatabase *mappingDatabase() const { return m_mappings; }
+
+public slots:
+    void processPendingFrames();
+
 signals:
     void gamepadEvent(QGamepadInfo* info, quint64 time, int type, int number, int value);
+    void gamepadFrame(QGamepadInfo* info, const QGamepadHandler::GamepadFrame &frame);
+    //info is deleted right after gamepadDisconnected() returns
+    void gamepadConnected(QGamepadInfo* info);
+    void gamepadDisconnected(QGamepadInfo* info);
 
 private slots:
-    void handleGamepadEvent(quint64 time, QGamepadHandler::GamepadEventType type, int number, int value);
     void addGamepad(const QString &deviceNode = QString());
     void removeGamepad(const QString &deviceNode);
     
 private:
-    QHash<QString, QGamepadHandler*> m_gamepads;
-    QHash<QGamepadHandler*, QGamepadInfo*> m_gamepadInfos;
-    QGamepadDeviceDiscovery *m_gamepadDeviceDiscovery;
+    void init();
+    void addGamepad(QGamepadBackend *backend, const QString &deviceNode);
+    void addHandler(const QString &deviceNode, QGamepadHandler *handler);
+    void attachHandler(QGamepadHandler *handler);
+    void detachHandler(QGamepadHandler *handler);
+    void processGamepadFrame(int slot, const QGamepadHandler::GamepadFrame &frame);
+    void dispatchFrame(QGamepadInfo *info, const QGamepadHandler::GamepadFrame &frame);
+    void applyMapping(QGamepadHandler *handler);
+    int slotForDevice(const QString &deviceNode) const;
+    QGamepadHandler *handlerForInfo(QGamepadInfo *info) const;
+
+    struct Slot {
+        QGamepadHandler *handler;
+        QGamepadInfo *info;
+        QGamepadFrameRing *frameRing;
+        QString deviceNode;
+        quint32 generation;
+    };
+
+    Slot m_slots[MaxGamepads];
+    QGamepadEventSink *m_sinks[MaxEventSinks];
+    int m_sinkCount;
+    QList<QGamepadBackend*> m_backends;
+    QGamepadHandler::DeliveryModes m_deliveryModes;
+    ReadMode m_readMode;
+    QGamepadReaderThread *m_readerThread;
+    QGamepadMultiplexer *m_multiplexer;
+    bool m_monotonicClock;
+    bool m_latencyTracking;
+    QGamepadRecorder *m_recorder;
+    QGamepadMappingDatabase *m_mappings;
+    QGamepadForceFeedbackWriter *m_forceFeedbackWriter;
 };
 
 QT_END_NAMESPACE
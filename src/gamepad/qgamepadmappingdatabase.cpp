@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "qgamepadmappingdatabase.h"
+
+#include "qgamepadhandler.h"
+#include "qgamepadinputstate.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+
+#include <linux/input.h>
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+static const quint32 QGamepadMappingCacheMagic = 0x51474d43; // "QGMC"
+static const quint32 QGamepadMappingCacheVersion = 1;
+
+//Indexed by QGamepadControllerMapping::Target
+static const char * const targetNames[QGamepadControllerMapping::TargetCount] = {
+    "a", "b", "x", "y", "back", "guide", "start", "leftstick", "rightstick",
+    "leftshoulder", "rightshoulder", "dpup", "dpdown", "dpleft", "dpright",
+    "leftx", "lefty", "rightx", "righty", "lefttrigger", "righttrigger"
+};
+
+static const int targetButtonCodes[QGamepadControllerMapping::DpadUp] = {
+    BTN_A, BTN_B, BTN_X, BTN_Y, BTN_SELECT, BTN_MODE, BTN_START,
+    BTN_THUMBL, BTN_THUMBR, BTN_TL, BTN_TR
+};
+
+static const int targetAxisCodes[QGamepadControllerMapping::TargetCount - QGamepadControllerMapping::LeftX] = {
+    ABS_X, ABS_Y, ABS_RX, ABS_RY, ABS_Z, ABS_RZ
+};
+
+QGamepadMappingDatabase::QGamepadMappingDatabase()
+{
+}
+
+bool QGamepadMappingDatabase::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning("Cannot open gamepad mappings '%s': %s", qPrintable(fileName), qPrintable(file.errorString()));
+        return false;
+    }
+
+    QByteArray text = file.readAll();
+    QString cacheName = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + QLatin1String("/gamepadmappings-")
+            + QString::fromLatin1(QCryptographicHash::hash(text, QCryptographicHash::Sha1).toHex())
+            + QLatin1String(".cache");
+
+    if (readCache(cacheName))
+        return true;
+
+    //The cache only holds what this file contains
+    QGamepadMappingDatabase parsed;
+    parsed.addMappings(text);
+    parsed.writeCache(cacheName);
+
+    QHash<QByteArray, QGamepadControllerMapping>::const_iterator it;
+    for (it = parsed.m_mappings.constBegin(); it != parsed.m_mappings.constEnd(); ++it)
+        m_mappings.insert(it.key(), it.value());
+    return true;
+}
+
+int QGamepadMappingDatabase::addMappings(const QByteArray &text)
+{
+    int added = 0;
+    QGamepadControllerMapping mapping;
+
+    foreach (const QByteArray &line, text.split('\n')) {
+        if (parseLine(line, &mapping)) {
+            m_mappings.insert(mapping.guid, mapping);
+            ++added;
+        }
+    }
+    return added;
+}
+
+const QGamepadControllerMapping *QGamepadMappingDatabase::mapping(const QByteArray &guid) const
+{
+    QHash<QByteArray, QGamepadControllerMapping>::const_iterator it = m_mappings.constFind(guid);
+    if (it != m_mappings.constEnd())
+        return &it.value();
+
+    //Version is the 7th 16 bit word
+    if (guid.size() == 32) {
+        QByteArray anyVersion = guid;
+        memset(anyVersion.data() + 24, '0', 4);
+        it = m_mappings.constFind(anyVersion);
+        if (it != m_mappings.constEnd())
+            return &it.value();
+    }
+    return 0;
+}
+
+QByteArray QGamepadMappingDatabase::guid(quint16 bus, quint16 vendor, quint16 product, quint16 version)
+{
+    //Little endian 16 bit words, each followed by a zero word
+    quint16 words[8] = { bus, 0, vendor, 0, product, 0, version, 0 };
+    uchar bytes[16];
+    for (int i = 0; i < 8; ++i) {
+        bytes[2 * i] = words[i] & 0xff;
+        bytes[2 * i + 1] = words[i] >> 8;
+    }
+    return QByteArray(reinterpret_cast<const char *>(bytes), sizeof(bytes)).toHex();
+}
+
+bool QGamepadMappingDatabase::resolveTarget(int target, int sourceType, int *eventType, int *code)
+{
+    if (target < 0 || target >= QGamepadControllerMapping::TargetCount)
+        return false;
+
+    if (target < QGamepadControllerMapping::DpadUp) {
+        if (sourceType != QGamepadControllerMapping::ButtonSource)
+            return false;
+        *eventType = QGamepadHandler::Button;
+        *code = targetButtonCodes[target];
+        return true;
+    }
+
+    if (target <= QGamepadControllerMapping::DpadRight) {
+        if (sourceType == QGamepadControllerMapping::HatSource) {
+            //Hats keep their axis pair, QGamepadInputState turns them into buttons
+            bool horizontal = target == QGamepadControllerMapping::DpadLeft || target == QGamepadControllerMapping::DpadRight;
+            *eventType = QGamepadHandler::Hat;
+            *code = horizontal ? ABS_HAT0X : ABS_HAT0Y;
+            return true;
+        }
+        if (sourceType != QGamepadControllerMapping::ButtonSource)
+            return false;
+        *eventType = QGamepadHandler::Button;
+        *code = QGamepadInputState::Gamepad_Up1 + target - QGamepadControllerMapping::DpadUp;
+        return true;
+    }
+
+    if (sourceType == QGamepadControllerMapping::AxisSource) {
+        *eventType = QGamepadHandler::Axis;
+        *code = targetAxisCodes[target - QGamepadControllerMapping::LeftX];
+        return true;
+    }
+
+    //Digital triggers
+    if (sourceType == QGamepadControllerMapping::ButtonSource
+            && (target == QGamepadControllerMapping::LeftTrigger || target == QGamepadControllerMapping::RightTrigger)) {
+        *eventType = QGamepadHandler::Button;
+        *code = target == QGamepadControllerMapping::LeftTrigger ? BTN_TL2 : BTN_TR2;
+        return true;
+    }
+    return false;
+}
+
+bool QGamepadMappingDatabase::parseLine(const QByteArray &line, QGamepadControllerMapping *mapping) const
+{
+    QByteArray trimmed = line.trimmed();
+    if (trimmed.isEmpty() || trimmed.at(0) == '#')
+        return false;
+
+    QList<QByteArray> fields = trimmed.split(',');
+    if (fields.count() < 3 || fields.at(0).size() != 32)
+        return false;
+
+    mapping->guid = fields.at(0).toLower();
+    mapping->name = QString::fromUtf8(fields.at(1).constData(), fields.at(1).size());
+    mapping->bindings.clear();
+
+    for (int i = 2; i < fields.count(); ++i) {
+        const QByteArray &field = fields.at(i);
+        int colon = field.indexOf(':');
+        if (colon <= 0)
+            continue;
+
+        QByteArray key = field.left(colon);
+        QByteArray value = field.mid(colon + 1);
+
+        if (key == "platform") {
+            if (value != "Linux")
+                return false;
+            continue;
+        }
+
+        int target = 0;
+        while (target < QGamepadControllerMapping::TargetCount && key != targetNames[target])
+            ++target;
+        //Unknown targets, half axis targets (+leftx) and half axis sources (+a2)
+        if (target == QGamepadControllerMapping::TargetCount || value.size() < 2)
+            continue;
+
+        QGamepadControllerMapping::Binding binding;
+        binding.target = target;
+        binding.hatMask = 0;
+        binding.inverted = 0;
+
+        bool ok = false;
+        switch (value.at(0)) {
+        case 'b':
+            binding.sourceType = QGamepadControllerMapping::ButtonSource;
+            binding.index = value.mid(1).toInt(&ok);
+            break;
+        case 'a':
+            binding.sourceType = QGamepadControllerMapping::AxisSource;
+            if (value.endsWith('~')) {
+                binding.inverted = 1;
+                value.resize(value.size() - 1);
+            }
+            binding.index = value.mid(1).toInt(&ok);
+            break;
+        case 'h': {
+            int dot = value.indexOf('.');
+            if (dot < 0)
+                break;
+            binding.sourceType = QGamepadControllerMapping::HatSource;
+            binding.index = value.mid(1, dot - 1).toInt(&ok);
+            if (ok)
+                binding.hatMask = value.mid(dot + 1).toInt(&ok);
+            break;
+        }
+        default:
+            break;
+        }
+
+        if (ok)
+            mapping->bindings.append(binding);
+    }
+
+    return true;
+}
+
+bool QGamepadMappingDatabase::readCache(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic, version, count;
+    stream >> magic >> version >> count;
+    if (stream.status() != QDataStream::Ok || magic != QGamepadMappingCacheMagic || version != QGamepadMappingCacheVersion)
+        return false;
+
+    QHash<QByteArray, QGamepadControllerMapping> mappings;
+    mappings.reserve(count);
+    for (quint32 i = 0; i < count; ++i) {
+        QGamepadControllerMapping mapping;
+        quint32 bindingCount;
+        stream >> mapping.guid >> mapping.name >> bindingCount;
+        if (stream.status() != QDataStream::Ok || bindingCount > 255)
+            return false;
+
+        mapping.bindings.resize(bindingCount);
+        int size = bindingCount * sizeof(QGamepadControllerMapping::Binding);
+        if (stream.readRawData(reinterpret_cast<char *>(mapping.bindings.data()), size) != size)
+            return false;
+
+        mappings.insert(mapping.guid, mapping);
+    }
+
+    //Only take the cache once it was read completely
+    QHash<QByteArray, QGamepadControllerMapping>::const_iterator it;
+    for (it = mappings.constBegin(); it != mappings.constEnd(); ++it)
+        m_mappings.insert(it.key(), it.value());
+    return true;
+}
+
+void QGamepadMappingDatabase::writeCache(const QString &fileName) const
+{
+    QDir().mkpath(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << QGamepadMappingCacheMagic << QGamepadMappingCacheVersion << quint32(m_mappings.count());
+
+    QHash<QByteArray, QGamepadControllerMapping>::const_iterator it;
+    for (it = m_mappings.constBegin(); it != m_mappings.constEnd(); ++it) {
+        const QGamepadControllerMapping &mapping = it.value();
+        stream << mapping.guid << mapping.name << quint32(mapping.bindings.count());
+        stream.writeRawData(reinterpret_cast<const char *>(mapping.bindings.constData()),
+                            mapping.bindings.count() * sizeof(QGamepadControllerMapping::Binding));
+    }
+    file.commit();
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADMAPPINGDATABASE_H
+#define QGAMEPADMAPPINGDATABASE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtGamepad/qtgamepadglobal.h>
+
+QT_BEGIN_HEADER
+
+QT_BEGIN_NAMESPACE
+
+//One line of an SDL GameControllerDB file. Sources are numbered the way
+//SDL numbers the buttons, axes and hats of an evdev device.
+struct QGamepadControllerMapping
+{
+    enum Target {
+        A,
+        B,
+        X,
+        Y,
+        Back,
+        Guide,
+        Start,
+        LeftStick,
+        RightStick,
+        LeftShoulder,
+        RightShoulder,
+        DpadUp,
+        DpadDown,
+        DpadLeft,
+        DpadRight,
+        LeftX,
+        LeftY,
+        RightX,
+        RightY,
+        LeftTrigger,
+        RightTrigger,
+        TargetCount
+    };
+
+    enum SourceType {
+        ButtonSource,
+        AxisSource,
+        HatSource
+    };
+
+    struct Binding {
+        quint8 target;
+        quint8 sourceType;
+        quint8 index;
+        //SDL hat direction bits, 1 up, 2 right, 4 down, 8 left
+        quint8 hatMask;
+        quint8 inverted;
+    };
+
+    QByteArray guid;
+    QString name;
+    QVector<Binding> bindings;
+};
+
+//SDL GameControllerDB mappings keyed by the GUID SDL builds from the
+//bus, vendor, product and version reported by EVIOCGID
+class Q_GAMEPAD_EXPORT QGamepadMappingDatabase
+{
+public:
+    QGamepadMappingDatabase();
+
+    //Parsed files are cached in QStandardPaths::CacheLocation under the
+    //hash of their contents, so unchanged files are not parsed again
+    bool load(const QString &fileName);
+    //Lines for other platforms, and bindings using half axes, are skipped.
+    //Later lines replace earlier ones with the same GUID.
+    int addMappings(const QByteArray &text);
+    void clear() { m_mappings.clear(); }
+
+    int count() const { return m_mappings.count(); }
+    //Falls back to the GUID without version, as SDL does
+    const QGamepadControllerMapping *mapping(const QByteArray &guid) const;
+
+    static QByteArray guid(quint16 bus, quint16 vendor, quint16 product, quint16 version);
+
+    //QGamepadHandler::GamepadEventType and code a target is reported as when
+    //fed from the given kind of source, false for unsupported combinations
+    static bool resolveTarget(int target, int sourceType, int *eventType, int *code);
+
+private:
+    bool parseLine(const QByteArray &line, QGamepadControllerMapping *mapping) const;
+    bool readCache(const QString &fileName);
+    void writeCache(const QString &fileName) const;
+
+    QHash<QByteArray, QGamepadControllerMapping> m_mappings;
+};
+
+QT_END_NAMESPACE
+
+QT_END_HEADER
+
+#endif // QGAMEPADMAPPINGDATABASE_H
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "qgamepadmultiplexer_p.h"
+
+#include "qgamepadhandler.h"
+#include "qgamepaddevicediscovery_p.h"
+
+#include <QtCore/QSocketNotifier>
+#include <qplatformdefs.h>
+
+#include <errno.h>
+#include <sys/epoll.h>
+
+QT_BEGIN_NAMESPACE
+
+QGamepadMultiplexer::QGamepadMultiplexer(QObject *parent)
+    : QObject(parent)
+    , m_notifier(0)
+    , m_discovery(0)
+    , m_wakeupCount(0)
+    , m_dispatchCount(0)
+{
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epollFd < 0) {
+        qWarning("Cannot create gamepad epoll descriptor: %s", strerror(errno));
+        return;
+    }
+
+    //An epoll descriptor is itself readable whenever one of its members is
+    m_notifier = new QSocketNotifier(m_epollFd, QSocketNotifier::Read, this);
+    connect(m_notifier, SIGNAL(activated(int)), this, SLOT(processReadyDescriptors()));
+}
+
+QGamepadMultiplexer::~QGamepadMultiplexer()
+{
+    delete m_notifier;
+    if (m_epollFd >= 0)
+        QT_CLOSE(m_epollFd);
+}
+
+void QGamepadMultiplexer::addHandler(QGamepadHandler *handler)
+{
+    if (m_epollFd < 0)
+        return;
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = handler;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, handler->m_fd, &event) < 0) {
+        qWarning("Cannot add gamepad device to epoll set: %s", strerror(errno));
+        return;
+    }
+    handler->setNotifierEnabled(false);
+}
+
+void QGamepadMultiplexer::removeHandler(QGamepadHandler *handler)
+{
+    if (m_epollFd < 0)
+        return;
+
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_DEL, handler->m_fd, 0) == 0)
+        handler->setNotifierEnabled(true);
+}
+
+void QGamepadMultiplexer::setDeviceDiscovery(QGamepadDeviceDiscovery *discovery)
+{
+    if (m_epollFd < 0 || discovery == m_discovery)
+        return;
+
+    if (m_discovery) {
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, m_discovery->m_udevMonitorFileDescriptor, 0);
+        if (m_discovery->m_udevSocketNotifier)
+            m_discovery->m_udevSocketNotifier->setEnabled(true);
+    }
+
+    m_discovery = 0;
+    if (!discovery || discovery->m_udevMonitorFileDescriptor < 0)
+        return;
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = discovery;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, discovery->m_udevMonitorFileDescriptor, &event) < 0) {
+        qWarning("Cannot add udev monitor to epoll set: %s", strerror(errno));
+        return;
+    }
+    discovery->m_udevSocketNotifier->setEnabled(false);
+    m_discovery = discovery;
+}
+
+void QGamepadMultiplexer::resetCounts()
+{
+    m_wakeupCount = 0;
+    m_dispatchCount = 0;
+}
+
+void QGamepadMultiplexer::processReadyDescriptors()
+{
+    struct epoll_event events[64];
+
+    int ready = epoll_wait(m_epollFd, events, 64, 0);
+    if (ready < 0) {
+        if (errno != EINTR)
+            qWarning("Could not wait on gamepad epoll set: %s", strerror(errno));
+        return;
+    }
+
+    ++m_wakeupCount;
+
+    //Hotplug can delete handlers, so udev is handled after all devices
+    bool discoveryReady = false;
+    for (int i = 0; i < ready; ++i) {
+        if (events[i].data.ptr == m_discovery) {
+            discoveryReady = true;
+            continue;
+        }
+        QGamepadHandler *handler = static_cast<QGamepadHandler*>(events[i].data.ptr);
+        if (events[i].events & EPOLLIN) {
+            handler->readGamepadData();
+            ++m_dispatchCount;
+        }
+        //An unplugged device stays ready until udev reports its removal,
+        //drop it from the set rather than waking up for it every time
+        if (events[i].events & (EPOLLHUP | EPOLLERR))
+            epoll_ctl(m_epollFd, EPOLL_CTL_DEL, handler->m_fd, 0);
+    }
+
+    if (discoveryReady)
+        m_discovery->handleUDevNotification();
+}
+
+QT_END_NAMESPACE
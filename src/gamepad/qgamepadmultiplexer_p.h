@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADMULTIPLEXER_P_H
+#define QGAMEPADMULTIPLEXER_P_H
+
+#include <QtCore/QObject>
+#include <QtGamepad/qtgamepadglobal.h>
+
+QT_BEGIN_NAMESPACE
+
+class QSocketNotifier;
+class QGamepadHandler;
+class QGamepadDeviceDiscovery;
+
+//Watches every gamepad fd and the udev monitor through one epoll set, so
+//the event dispatcher only has a single socket notifier to poll no matter
+//how many devices are connected.
+class Q_GAMEPAD_EXPORT QGamepadMultiplexer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QGamepadMultiplexer(QObject *parent = 0);
+    ~QGamepadMultiplexer();
+
+    bool isValid() const { return m_epollFd >= 0; }
+
+    void addHandler(QGamepadHandler *handler);
+    void removeHandler(QGamepadHandler *handler);
+    void setDeviceDiscovery(QGamepadDeviceDiscovery *discovery);
+
+    int wakeupCount() const { return m_wakeupCount; }
+    int dispatchCount() const { return m_dispatchCount; }
+    void resetCounts();
+
+private slots:
+    void processReadyDescriptors();
+
+private:
+    int m_epollFd;
+    QSocketNotifier *m_notifier;
+    QGamepadDeviceDiscovery *m_discovery;
+    int m_wakeupCount;
+    int m_dispatchCount;
+};
+
+QT_END_NAMESPACE
+
+#endif // QGAMEPADMULTIPLEXER_P_H
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "qgamepadreaderthread_p.h"
+
+#include "qgamepadhandler.h"
+
+#include <QtCore/QMutexLocker>
+#include <qplatformdefs.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+QT_BEGIN_NAMESPACE
+
+QGamepadReaderThread::QGamepadReaderThread(QObject *parent)
+    : QThread(parent)
+    , m_handlersChanged(false)
+    , m_stopRequested(false)
+{
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeFd < 0)
+        qWarning("Cannot create gamepad reader wakeup descriptor: %s", strerror(errno));
+}
+
+QGamepadReaderThread::~QGamepadReaderThread()
+{
+    stop();
+
+    if (m_wakeFd >= 0)
+        QT_CLOSE(m_wakeFd);
+}
+
+void QGamepadReaderThread::addHandler(QGamepadHandler *handler)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_handlers.contains(handler))
+        return;
+
+    handler->setNotifierEnabled(false);
+    m_handlers.append(handler);
+    m_handlersChanged = true;
+    wake();
+}
+
+void QGamepadReaderThread::removeHandler(QGamepadHandler *handler)
+{
+    //Handlers are only read while m_mutex is held, so once this returns
+    //the reader thread will not touch the handler again
+    QMutexLocker locker(&m_mutex);
+    int index = m_handlers.indexOf(handler);
+    if (index < 0)
+        return;
+
+    m_handlers.remove(index);
+    m_handlersChanged = true;
+    handler->setNotifierEnabled(true);
+    wake();
+}
+
+void QGamepadReaderThread::stop()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopRequested = true;
+        wake();
+    }
+    wait();
+
+    QMutexLocker locker(&m_mutex);
+    m_stopRequested = false;
+}
+
+void QGamepadReaderThread::wake()
+{
+    quint64 one = 1;
+    if (m_wakeFd >= 0 && QT_WRITE(m_wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        qWarning("Cannot wake gamepad reader thread: %s", strerror(errno));
+}
+
+void QGamepadReaderThread::run()
+{
+    //Only rebuilt when the set of handlers changes, so the read path
+    //itself never allocates
+    QVector<struct pollfd> pollFds;
+    QVector<QGamepadHandler*> handlers;
+
+    forever {
+        m_mutex.lock();
+        if (m_stopRequested) {
+            m_mutex.unlock();
+            break;
+        }
+        if (m_handlersChanged || pollFds.isEmpty()) {
+            handlers = m_handlers;
+            pollFds.resize(handlers.count() + 1);
+            pollFds[0].fd = m_wakeFd;
+            pollFds[0].events = POLLIN;
+            for (int i = 0; i < handlers.count(); ++i) {
+                pollFds[i + 1].fd = handlers.at(i)->m_fd;
+                pollFds[i + 1].events = POLLIN;
+            }
+            m_handlersChanged = false;
+        }
+        m_mutex.unlock();
+
+        int ready = poll(pollFds.data(), pollFds.count(), -1);
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            qWarning("Gamepad reader thread failed to poll: %s", strerror(errno));
+            break;
+        }
+
+        if (pollFds[0].revents & POLLIN) {
+            quint64 counter;
+            while (QT_READ(m_wakeFd, &counter, sizeof(counter)) > 0)
+                ;
+        }
+
+        QMutexLocker locker(&m_mutex);
+        //The handler set changed while polling, revents may belong to a removed handler
+        if (m_handlersChanged)
+            continue;
+
+        for (int i = 1; i < pollFds.count(); ++i) {
+            short revents = pollFds[i].revents;
+            if (revents & POLLIN) {
+                handlers.at(i - 1)->readGamepadData();
+            } else if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                //Device went away, stop polling it until udev tells the manager
+                pollFds[i].fd = -1;
+            }
+        }
+    }
+}
+
+QT_END_NAMESPACE
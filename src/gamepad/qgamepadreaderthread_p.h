@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADREADERTHREAD_P_H
+#define QGAMEPADREADERTHREAD_P_H
+
+#include <QtCore/QThread>
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
+
+QT_BEGIN_NAMESPACE
+
+class QGamepadHandler;
+
+class QGamepadReaderThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit QGamepadReaderThread(QObject *parent = 0);
+    ~QGamepadReaderThread();
+
+    void addHandler(QGamepadHandler *handler);
+    void removeHandler(QGamepadHandler *handler);
+    void stop();
+
+protected:
+    void run();
+
+private:
+    void wake();
+
+    QMutex m_mutex;
+    QVector<QGamepadHandler*> m_handlers;
+    bool m_handlersChanged;
+    bool m_stopRequested;
+    int m_wakeFd;
+};
+
+QT_END_NAMESPACE
+
+#endif // QGAMEPADREADERTHREAD_P_H
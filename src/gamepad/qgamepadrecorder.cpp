@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "qgamepadrecorder_p.h"
+
+#include "qgamepadhandler.h"
+#include "qgamepadmanager.h"
+
+#include <QtCore/QMutexLocker>
+#include <QtCore/QByteArray>
+
+#include <linux/input.h>
+
+QT_BEGIN_NAMESPACE
+
+static const char padding[8] = { 0 };
+
+Q_STATIC_ASSERT(int(QGamepadRecorder::MaxDevices) == int(QGamepadManager::MaxGamepads));
+
+QGamepadRecorder::QGamepadRecorder()
+    : m_recording(0)
+    , m_nextDevice(0)
+{
+    for (int i = 0; i < MaxDevices; ++i) {
+        m_devices[i].handler = 0;
+        m_devices[i].recordId = -1;
+    }
+}
+
+QGamepadRecorder::~QGamepadRecorder()
+{
+    stop();
+}
+
+bool QGamepadRecorder::start(const QString &fileName)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_file.isOpen())
+        m_file.close();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning("Cannot open gamepad recording '%s': %s", qPrintable(fileName), qPrintable(m_file.errorString()));
+        return false;
+    }
+
+    QGamepadRecordFileHeader header;
+    memcpy(header.magic, "QGPR", 4);
+    header.version = QGamepadRecordVersion;
+    header.eventSize = sizeof(struct input_event);
+    header.reserved = 0;
+    m_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    //Devices that are already open are added first, so that replay knows
+    //their calibration before any of their events
+    m_nextDevice = 0;
+    for (int i = 0; i < MaxDevices; ++i) {
+        Device &device = m_devices[i];
+        if (!device.handler)
+            continue;
+        device.recordId = m_nextDevice++;
+        writeDevice(device.handler, device.recordId, device.deviceNode);
+    }
+
+    m_recording.store(1);
+    return true;
+}
+
+void QGamepadRecorder::stop()
+{
+    QMutexLocker locker(&m_mutex);
+    m_recording.store(0);
+    if (m_file.isOpen())
+        m_file.close();
+}
+
+void QGamepadRecorder::addDevice(QGamepadHandler *handler, const QString &deviceNode)
+{
+    int slot = handler->slot();
+    if (slot < 0 || slot >= MaxDevices)
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    Device &device = m_devices[slot];
+    device.handler = handler;
+    device.deviceNode = deviceNode;
+    device.recordId = -1;
+    if (!m_recording.load())
+        return;
+
+    device.recordId = m_nextDevice++;
+    writeDevice(handler, device.recordId, deviceNode);
+}
+
+void QGamepadRecorder::removeDevice(QGamepadHandler *handler)
+{
+    int slot = handler->slot();
+    if (slot < 0 || slot >= MaxDevices)
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    Device &device = m_devices[slot];
+    if (device.handler != handler)
+        return;
+
+    if (m_recording.load() && device.recordId >= 0)
+        writeRecord(QGamepadDeviceRemovedRecord, device.recordId, 0, 0);
+    device.handler = 0;
+    device.deviceNode.clear();
+    device.recordId = -1;
+}
+
+void QGamepadRecorder::writeEvents(QGamepadHandler *handler, const struct input_event *events, int count)
+{
+    //Cheap check first, this is called for every read of every device
+    if (!m_recording.load())
+        return;
+
+    int slot = handler->slot();
+    if (slot < 0 || slot >= MaxDevices)
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    const Device &device = m_devices[slot];
+    if (!m_recording.load() || device.handler != handler || device.recordId < 0)
+        return;
+
+    writeRecord(QGamepadEventsRecord, device.recordId, reinterpret_cast<const char *>(events), count * sizeof(struct input_event));
+}
+
+void QGamepadRecorder::writeDevice(QGamepadHandler *handler, int device, const QString &deviceNode)
+{
+    QByteArray node = deviceNode.toUtf8();
+    QList<int> axes = handler->axisAvailable();
+
+    QGamepadRecordDevice info;
+    info.axisCount = axes.count();
+    info.nodeSize = node.size();
+
+    QByteArray payload;
+    payload.append(reinterpret_cast<const char *>(&info), sizeof(info));
+    foreach (int code, axes) {
+        QGamepadHandler::AxisInfo *axisInfo = handler->axisInfo(code);
+        QGamepadRecordAxis axis;
+        axis.code = code;
+        axis.minimum = axisInfo->minimum;
+        axis.maximum = axisInfo->maximum;
+        axis.deadzoneCenter = axisInfo->deadzoneCenter;
+        axis.deadzoneRadius = axisInfo->deadzoneRadius;
+        axis.reserved = 0;
+        payload.append(reinterpret_cast<const char *>(&axis), sizeof(axis));
+    }
+    payload.append(node);
+
+    writeRecord(QGamepadDeviceAddedRecord, device, payload.constData(), payload.size());
+}
+
+void QGamepadRecorder::writeRecord(quint32 type, quint32 device, const char *payload, int size)
+{
+    QGamepadRecordHeader header;
+    header.type = type;
+    header.device = device;
+    header.size = (size + 7) & ~7;
+    header.reserved = 0;
+
+    m_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    if (size) {
+        m_file.write(payload, size);
+        m_file.write(padding, header.size - size);
+    }
+}
+
+QT_END_NAMESPACE
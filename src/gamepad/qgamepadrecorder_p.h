@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADRECORDER_P_H
+#define QGAMEPADRECORDER_P_H
+
+#include <QtCore/QFile>
+#include <QtCore/QString>
+#include <QtCore/QMutex>
+#include <QtCore/QAtomicInt>
+#include <QtGamepad/qtgamepadglobal.h>
+
+struct input_event;
+
+QT_BEGIN_NAMESPACE
+
+class QGamepadHandler;
+
+//Recording file layout, host byte order:
+//  QGamepadRecordFileHeader
+//  { QGamepadRecordHeader, payload padded to 8 bytes }*
+//Device records carry a QGamepadRecordDevice, the axis calibration and the
+//device node. Event records carry the raw input_events of one read() and
+//stay 8 byte aligned, so a mapped file can be fed to handlers in place.
+enum { QGamepadRecordVersion = 1 };
+
+enum QGamepadRecordType {
+    QGamepadDeviceAddedRecord = 1,
+    QGamepadDeviceRemovedRecord,
+    QGamepadEventsRecord
+};
+
+struct QGamepadRecordFileHeader {
+    char magic[4];
+    quint32 version;
+    quint32 eventSize;
+    quint32 reserved;
+};
+
+struct QGamepadRecordHeader {
+    quint32 type;
+    quint32 device;
+    quint32 size;
+    quint32 reserved;
+};
+
+struct QGamepadRecordDevice {
+    quint32 axisCount;
+    quint32 nodeSize;
+};
+
+struct QGamepadRecordAxis {
+    qint32 code;
+    qint32 minimum;
+    qint32 maximum;
+    qint32 deadzoneCenter;
+    qint32 deadzoneRadius;
+    qint32 reserved;
+};
+
+class QGamepadRecorder
+{
+public:
+    QGamepadRecorder();
+    ~QGamepadRecorder();
+
+    bool start(const QString &fileName);
+    void stop();
+    bool isRecording() const { return m_recording.load(); }
+
+    //Devices are kept by QGamepadHandler::slot()
+    enum { MaxDevices = 32 };
+
+    void addDevice(QGamepadHandler *handler, const QString &deviceNode);
+    void removeDevice(QGamepadHandler *handler);
+    void writeEvents(QGamepadHandler *handler, const struct input_event *events, int count);
+
+private:
+    void writeDevice(QGamepadHandler *handler, int device, const QString &deviceNode);
+    void writeRecord(quint32 type, quint32 device, const char *payload, int size);
+
+    QMutex m_mutex;
+    QFile m_file;
+    QAtomicInt m_recording;
+    struct Device {
+        QGamepadHandler *handler;
+        QString deviceNode;
+        //Device number in the current recording, -1 when not in it
+        int recordId;
+    };
+    Device m_devices[MaxDevices];
+    int m_nextDevice;
+};
+
+QT_END_NAMESPACE
+
+#endif // QGAMEPADRECORDER_P_H
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "qgamepadreplay.h"
+
+#include "qgamepadhandler.h"
+#include "qgamepadrecorder_p.h"
+
+#include <linux/input.h>
+
+QT_BEGIN_NAMESPACE
+
+//Number of records replayed per event loop pass when not in real time
+static const int replayBatchSize = 1024;
+
+QGamepadReplay::QGamepadReplay(QObject *parent)
+    : QGamepadBackend(parent)
+    , m_data(0)
+    , m_size(0)
+    , m_offset(0)
+    , m_speed(RealTime)
+    , m_firstTime(0)
+    , m_eventsReplayed(0)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(replayNext()));
+}
+
+QGamepadReplay::~QGamepadReplay()
+{
+    close();
+}
+
+QStringList QGamepadReplay::scanConnectedDevices()
+{
+    QStringList devices;
+    for (int i = 0; i < m_devices.count(); ++i) {
+        if (m_devices.at(i) && !m_handedOut.at(i))
+            devices << m_deviceNodes.at(i);
+    }
+    return devices;
+}
+
+QGamepadHandler *QGamepadReplay::createHandler(const QString &deviceNode)
+{
+    int index = m_deviceNodes.indexOf(deviceNode);
+    if (index < 0 || !m_devices.at(index) || m_handedOut.at(index))
+        return 0;
+
+    m_handedOut[index] = true;
+    return m_devices.at(index);
+}
+
+void QGamepadReplay::handlerDestroyed(QObject *handler)
+{
+    int index = m_devices.indexOf(static_cast<QGamepadHandler *>(handler));
+    if (index >= 0)
+        m_devices[index] = 0;
+}
+
+bool QGamepadReplay::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning("Cannot open gamepad recording '%s': %s", qPrintable(fileName), qPrintable(m_file.errorString()));
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size >= qint64(sizeof(QGamepadRecordFileHeader)))
+        m_data = m_file.map(0, m_size);
+
+    const QGamepadRecordFileHeader *header = reinterpret_cast<const QGamepadRecordFileHeader *>(m_data);
+    if (!m_data || memcmp(header->magic, "QGPR", 4) != 0
+            || header->version != QGamepadRecordVersion
+            || header->eventSize != sizeof(struct input_event)) {
+        qWarning("'%s' is not a gamepad recording for this platform", qPrintable(fileName));
+        close();
+        return false;
+    }
+
+    m_offset = sizeof(QGamepadRecordFileHeader);
+    return true;
+}
+
+void QGamepadReplay::close()
+{
+    stop();
+
+    //Devices still present at the end of the recording go away with it
+    for (int i = 0; i < m_devices.count(); ++i) {
+        QGamepadHandler *handler = m_devices.at(i);
+        if (!handler)
+            continue;
+        disconnect(handler, SIGNAL(destroyed(QObject*)), this, SLOT(handlerDestroyed(QObject*)));
+        if (m_handedOut.at(i))
+            emit deviceRemoved(m_deviceNodes.at(i));
+        else
+            delete handler;
+    }
+    m_devices.clear();
+    m_deviceNodes.clear();
+    m_handedOut.clear();
+
+    if (m_data)
+        m_file.unmap(const_cast<uchar *>(m_data));
+    m_data = 0;
+    m_size = 0;
+    m_offset = 0;
+    m_firstTime = 0;
+    m_eventsReplayed = 0;
+    m_file.close();
+}
+
+void QGamepadReplay::start(QGamepadReplay::Speed speed)
+{
+    if (!m_data)
+        return;
+
+    m_speed = speed;
+    m_firstTime = 0;
+    m_timer.start(0);
+}
+
+void QGamepadReplay::stop()
+{
+    m_timer.stop();
+}
+
+int QGamepadReplay::replayAll()
+{
+    stop();
+
+    int replayed = m_eventsReplayed;
+    while (replayRecord())
+        ;
+    return m_eventsReplayed - replayed;
+}
+
+void QGamepadReplay::replayNext()
+{
+    for (int i = 0; m_speed == RealTime || i < replayBatchSize; ++i) {
+        if (m_offset + qint64(sizeof(QGamepadRecordHeader)) > m_size) {
+            emit finished();
+            return;
+        }
+
+        const QGamepadRecordHeader *record = reinterpret_cast<const QGamepadRecordHeader *>(m_data + m_offset);
+        if (m_speed == RealTime && record->type == QGamepadEventsRecord && record->size) {
+            const struct input_event *event = reinterpret_cast<const struct input_event *>(record + 1);
+            quint64 time = quint64(event->time.tv_sec) * 1000000 + event->time.tv_usec;
+            if (!m_firstTime) {
+                m_firstTime = time;
+                m_clock.start();
+            }
+
+            //Wait until the recorded distance to the first event has passed
+            qint64 due = qint64(time - m_firstTime) - m_clock.nsecsElapsed() / 1000;
+            if (due > 0) {
+                m_timer.start(int((due + 999) / 1000));
+                return;
+            }
+        }
+
+        if (!replayRecord()) {
+            emit finished();
+            return;
+        }
+    }
+
+    m_timer.start(0);
+}
+
+bool QGamepadReplay::replayRecord()
+{
+    if (m_offset + qint64(sizeof(QGamepadRecordHeader)) > m_size)
+        return false;
+
+    const QGamepadRecordHeader *record = reinterpret_cast<const QGamepadRecordHeader *>(m_data + m_offset);
+    const uchar *payload = reinterpret_cast<const uchar *>(record + 1);
+    if (m_offset + qint64(sizeof(QGamepadRecordHeader)) + record->size > m_size) {
+        qWarning("Gamepad recording '%s' is truncated", qPrintable(m_file.fileName()));
+        m_offset = m_size;
+        return false;
+    }
+    m_offset += sizeof(QGamepadRecordHeader) + record->size;
+
+    if (record->device >= uint(m_devices.count())) {
+        m_devices.resize(record->device + 1);
+        m_deviceNodes.resize(record->device + 1);
+        m_handedOut.resize(record->device + 1);
+    }
+
+    switch (record->type) {
+    case QGamepadDeviceAddedRecord: {
+        const QGamepadRecordDevice *device = reinterpret_cast<const QGamepadRecordDevice *>(payload);
+        const QGamepadRecordAxis *axes = reinterpret_cast<const QGamepadRecordAxis *>(device + 1);
+        const char *node = reinterpret_cast<const char *>(axes + device->axisCount);
+
+        QMap<int, QGamepadHandler::AxisInfo> axisInfo;
+        for (uint i = 0; i < device->axisCount; ++i) {
+            QGamepadHandler::AxisInfo info;
+            info.minimum = axes[i].minimum;
+            info.maximum = axes[i].maximum;
+            info.deadzoneCenter = axes[i].deadzoneCenter;
+            info.deadzoneRadius = axes[i].deadzoneRadius;
+            axisInfo.insert(axes[i].code, info);
+        }
+
+        QString deviceNode = QString::fromLatin1("replay:%1:").arg(record->device) + QString::fromUtf8(node, device->nodeSize);
+        QGamepadHandler *handler = QGamepadHandler::createVirtual(deviceNode, axisInfo);
+        connect(handler, SIGNAL(destroyed(QObject*)), this, SLOT(handlerDestroyed(QObject*)));
+        m_devices[record->device] = handler;
+        m_deviceNodes[record->device] = deviceNode;
+        m_handedOut[record->device] = false;
+        emit deviceDetected(deviceNode);
+        break;
+    }
+    case QGamepadDeviceRemovedRecord:
+        if (QGamepadHandler *handler = m_devices.at(record->device)) {
+            if (m_handedOut.at(record->device)) {
+                emit deviceRemoved(m_deviceNodes.at(record->device));
+            } else {
+                m_devices[record->device] = 0;
+                delete handler;
+            }
+        }
+        break;
+    case QGamepadEventsRecord:
+        if (QGamepadHandler *handler = m_devices.at(record->device)) {
+            int count = record->size / sizeof(struct input_event);
+            handler->processInputEvents(reinterpret_cast<const struct input_event *>(payload), count);
+            m_eventsReplayed += count;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return true;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADREPLAY_H
+#define QGAMEPADREPLAY_H
+
+#include <QtCore/QObject>
+#include <QtCore/QFile>
+#include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QVector>
+#include <QtGamepad/qgamepadbackend.h>
+
+QT_BEGIN_HEADER
+
+QT_BEGIN_NAMESPACE
+
+//Backend playing a file written by QGamepadManager::startRecording().
+//The file is memory mapped and events are decoded in place. Recorded
+//devices appear and disappear as their records are replayed.
+class Q_GAMEPAD_EXPORT QGamepadReplay : public QGamepadBackend
+{
+    Q_OBJECT
+    Q_ENUMS(Speed)
+public:
+    enum Speed {
+        RealTime,
+        AsFastAsPossible
+    };
+
+    explicit QGamepadReplay(QObject *parent = 0);
+    ~QGamepadReplay();
+
+    QStringList scanConnectedDevices();
+    QGamepadHandler *createHandler(const QString &deviceNode);
+
+    bool open(const QString &fileName);
+    void close();
+
+    void start(Speed speed = RealTime);
+    void stop();
+    bool isRunning() const { return m_timer.isActive(); }
+
+    //Replays the remaining file synchronously and returns the number of
+    //input events decoded
+    int replayAll();
+
+signals:
+    void finished();
+
+private slots:
+    void replayNext();
+    void handlerDestroyed(QObject *handler);
+
+private:
+    bool replayRecord();
+
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+    qint64 m_offset;
+    Speed m_speed;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    quint64 m_firstTime;
+    int m_eventsReplayed;
+    //Handlers are created when a device record is replayed and handed to
+    //the manager from createHandler()
+    QVector<QGamepadHandler*> m_devices;
+    QVector<QString> m_deviceNodes;
+    QVector<bool> m_handedOut;
+};
+
+QT_END_NAMESPACE
+
+QT_END_HEADER
+
+#endif // QGAMEPADREPLAY_H
@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "qgamepadsharedstate.h"
+#include "qgamepadmanager.h"
+
+#include <QtCore/QThread>
+#include <qplatformdefs.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+
+QT_BEGIN_NAMESPACE
+
+Q_STATIC_ASSERT(int(QGamepadSharedState::MaxGamepads) >= int(QGamepadManager::MaxGamepads));
+Q_STATIC_ASSERT((QGamepadSharedState::EventCount & (QGamepadSharedState::EventCount - 1)) == 0);
+
+QGamepadSharedStatePublisher::QGamepadSharedStatePublisher(QGamepadManager *manager, QObject *parent)
+    : QObject(parent)
+    , m_manager(manager)
+    , m_state(0)
+{
+    connect(manager, SIGNAL(gamepadConnected(QGamepadInfo*)), this, SLOT(gamepadConnected(QGamepadInfo*)));
+    connect(manager, SIGNAL(gamepadDisconnected(QGamepadInfo*)), this, SLOT(gamepadDisconnected(QGamepadInfo*)));
+}
+
+QGamepadSharedStatePublisher::~QGamepadSharedStatePublisher()
+{
+    stop();
+}
+
+bool QGamepadSharedStatePublisher::start(const QString &name)
+{
+    stop();
+    if (!m_manager)
+        return false;
+
+    QByteArray path = name.toLocal8Bit();
+    int fd = shm_open(path.constData(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        qWarning("Cannot open gamepad shared memory '%s': %s", path.constData(), strerror(errno));
+        return false;
+    }
+
+    void *memory = MAP_FAILED;
+    if (ftruncate(fd, sizeof(QGamepadSharedState)) == 0)
+        memory = mmap(0, sizeof(QGamepadSharedState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        qWarning("Cannot map gamepad shared memory '%s': %s", path.constData(), strerror(errno));
+        QT_CLOSE(fd);
+        return false;
+    }
+    QT_CLOSE(fd);
+
+    m_state = static_cast<QGamepadSharedState*>(memory);
+    m_name = name;
+
+    //A taken over segment keeps its sequences and event head, so
+    //subscribers still reading it just see every slot emptied
+    QGamepadSharedState::Header &header = m_state->header;
+    __atomic_store_n(&header.magic, 0, __ATOMIC_RELAXED);
+    for (int i = 0; i < QGamepadSharedState::MaxGamepads; ++i) {
+        QGamepadSharedState::Gamepad *gamepad = &m_state->gamepads[i];
+        beginWrite(gamepad);
+        gamepad->generation = 0;
+        endWrite(gamepad);
+    }
+    header.layoutVersion = QGamepadSharedState::LayoutVersion;
+    header.size = sizeof(QGamepadSharedState);
+    header.publisherPid = getpid();
+    __atomic_store_n(&header.magic, quint32(QGamepadSharedState::Magic), __ATOMIC_RELEASE);
+
+    for (int i = 0; i < QGamepadManager::MaxGamepads; ++i) {
+        if (QGamepadInfo *info = m_manager->gamepadInfo(i))
+            gamepadConnected(info);
+    }
+
+    if (!m_manager->addEventSink(this)) {
+        qWarning("Cannot publish gamepad state: the manager has no free event sink");
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void QGamepadSharedStatePublisher::stop()
+{
+    if (!m_state)
+        return;
+
+    if (m_manager)
+        m_manager->removeEventSink(this);
+
+    __atomic_store_n(&m_state->header.publisherPid, 0, __ATOMIC_RELEASE);
+    munmap(m_state, sizeof(QGamepadSharedState));
+    shm_unlink(m_name.toLocal8Bit().constData());
+    m_state = 0;
+}
+
+void QGamepadSharedStatePublisher::beginWrite(QGamepadSharedState::Gamepad *gamepad)
+{
+    __atomic_store_n(&gamepad->sequence, gamepad->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void QGamepadSharedStatePublisher::endWrite(QGamepadSharedState::Gamepad *gamepad)
+{
+    __atomic_store_n(&gamepad->sequence, gamepad->sequence + 1, __ATOMIC_RELEASE);
+}
+
+void QGamepadSharedStatePublisher::gamepadConnected(QGamepadInfo *info)
+{
+    if (!m_state || info->id() < 0 || info->id() >= QGamepadSharedState::MaxGamepads)
+        return;
+
+    QGamepadSharedState::Gamepad *gamepad = &m_state->gamepads[info->id()];
+    beginWrite(gamepad);
+    gamepad->generation = info->generation();
+    gamepad->time = 0;
+    gamepad->frameCount = 0;
+    qstrncpy(gamepad->guid, info->guid().constData(), sizeof(gamepad->guid));
+    memset(gamepad->buttons, 0, sizeof(gamepad->buttons));
+    memcpy(gamepad->calibration, info->axisCalibration(), sizeof(gamepad->calibration));
+    //Where the axes were when the device appeared, buttons held since are
+    //only known once reported
+    memcpy(gamepad->axes, info->axisState(), sizeof(gamepad->axes));
+    endWrite(gamepad);
+}
+
+void QGamepadSharedStatePublisher::gamepadDisconnected(QGamepadInfo *info)
+{
+    if (!m_state || info->id() < 0 || info->id() >= QGamepadSharedState::MaxGamepads)
+        return;
+
+    QGamepadSharedState::Gamepad *gamepad = &m_state->gamepads[info->id()];
+    beginWrite(gamepad);
+    gamepad->generation = 0;
+    endWrite(gamepad);
+}
+
+void QGamepadSharedStatePublisher::processGamepadFrame(int slot, const QGamepadHandler::GamepadFrame &frame)
+{
+    if (!m_state || slot < 0 || slot >= QGamepadSharedState::MaxGamepads)
+        return;
+    QGamepadSharedState::Gamepad *gamepad = &m_state->gamepads[slot];
+    if (!gamepad->generation)
+        return;
+
+    beginWrite(gamepad);
+    for (int i = 0; i < frame.count; ++i) {
+        const QGamepadHandler::GamepadEvent &event = frame.events[i];
+        switch (event.type) {
+        case QGamepadHandler::Button:
+            if (event.code >= 0 && event.code < QGamepadHandler::KeyCount) {
+                if (event.value)
+                    gamepad->buttons[event.code / 32] |= 1U << (event.code % 32);
+                else
+                    gamepad->buttons[event.code / 32] &= ~(1U << (event.code % 32));
+            }
+            break;
+        case QGamepadHandler::Axis:
+        case QGamepadHandler::Hat:
+            if (event.code >= 0 && event.code < QGamepadHandler::AbsCount)
+                gamepad->axes[event.code] = event.value;
+            break;
+        default:
+            break;
+        }
+    }
+    gamepad->time = frame.time;
+    ++gamepad->frameCount;
+    endWrite(gamepad);
+
+    //Each entry is zeroed before it is rewritten, readers compare its
+    //sequence before and after copying
+    quint64 head = m_state->header.eventHead;
+    for (int i = 0; i < frame.count; ++i) {
+        const QGamepadHandler::GamepadEvent &event = frame.events[i];
+        QGamepadSharedState::Event &entry = m_state->events[head & (QGamepadSharedState::EventCount - 1)];
+        __atomic_store_n(&entry.sequence, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        entry.time = frame.time;
+        entry.generation = gamepad->generation;
+        entry.id = slot;
+        entry.type = event.type;
+        entry.code = event.code;
+        entry.value = event.value;
+        __atomic_store_n(&entry.sequence, head + 1, __ATOMIC_RELEASE);
+        ++head;
+    }
+    __atomic_store_n(&m_state->header.eventHead, head, __ATOMIC_RELEASE);
+}
+
+QGamepadSharedStateSubscriber::QGamepadSharedStateSubscriber()
+    : m_state(0)
+    , m_eventTail(0)
+    , m_lostEvents(0)
+{
+}
+
+QGamepadSharedStateSubscriber::~QGamepadSharedStateSubscriber()
+{
+    detach();
+}
+
+bool QGamepadSharedStateSubscriber::attach(const QString &name)
+{
+    detach();
+
+    QByteArray path = name.toLocal8Bit();
+    int fd = shm_open(path.constData(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    QT_STATBUF st;
+    void *memory = MAP_FAILED;
+    if (QT_FSTAT(fd, &st) == 0 && st.st_size >= QT_OFF_T(sizeof(QGamepadSharedState)))
+        memory = mmap(0, sizeof(QGamepadSharedState), PROT_READ, MAP_SHARED, fd, 0);
+    QT_CLOSE(fd);
+    if (memory == MAP_FAILED)
+        return false;
+
+    const QGamepadSharedState *state = static_cast<const QGamepadSharedState*>(memory);
+    if (__atomic_load_n(&state->header.magic, __ATOMIC_ACQUIRE) != quint32(QGamepadSharedState::Magic)
+            || state->header.layoutVersion != QGamepadSharedState::LayoutVersion
+            || state->header.size != sizeof(QGamepadSharedState)) {
+        qWarning("Gamepad shared memory '%s' has an unknown layout", path.constData());
+        munmap(memory, sizeof(QGamepadSharedState));
+        return false;
+    }
+
+    m_state = state;
+    //Events from before attaching are not handed out
+    m_eventTail = __atomic_load_n(&state->header.eventHead, __ATOMIC_ACQUIRE);
+    m_lostEvents = 0;
+    return true;
+}
+
+void QGamepadSharedStateSubscriber::detach()
+{
+    if (!m_state)
+        return;
+    munmap(const_cast<QGamepadSharedState*>(m_state), sizeof(QGamepadSharedState));
+    m_state = 0;
+}
+
+bool QGamepadSharedStateSubscriber::isPublisherRunning() const
+{
+    if (!m_state || __atomic_load_n(&m_state->header.magic, __ATOMIC_ACQUIRE) != quint32(QGamepadSharedState::Magic))
+        return false;
+    pid_t pid = __atomic_load_n(&m_state->header.publisherPid, __ATOMIC_ACQUIRE);
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+bool QGamepadSharedStateSubscriber::readGamepad(int id, QGamepadSharedState::Gamepad *gamepad) const
+{
+    if (!m_state || id < 0 || id >= QGamepadSharedState::MaxGamepads)
+        return false;
+
+    const QGamepadSharedState::Gamepad *shared = &m_state->gamepads[id];
+    for (int spins = 1; ; ++spins) {
+        quint32 before = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            //A publisher that died mid write never finishes it
+            if (spins % 1024 == 0 && !isPublisherRunning())
+                return false;
+            QThread::yieldCurrentThread();
+            continue;
+        }
+
+        memcpy(gamepad, shared, sizeof(*gamepad));
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shared->sequence, __ATOMIC_RELAXED) == before)
+            return gamepad->generation != 0;
+    }
+}
+
+int QGamepadSharedStateSubscriber::readEvents(QGamepadSharedState::Event *events, int maxCount)
+{
+    if (!m_state)
+        return 0;
+
+    quint64 head = __atomic_load_n(&m_state->header.eventHead, __ATOMIC_ACQUIRE);
+    if (m_eventTail > head)
+        m_eventTail = head;
+    if (head - m_eventTail > QGamepadSharedState::EventCount) {
+        m_lostEvents += head - m_eventTail - QGamepadSharedState::EventCount;
+        m_eventTail = head - QGamepadSharedState::EventCount;
+    }
+
+    int count = 0;
+    for (; m_eventTail < head && count < maxCount; ++m_eventTail) {
+        const QGamepadSharedState::Event &entry = m_state->events[m_eventTail & (QGamepadSharedState::EventCount - 1)];
+        quint64 sequence = __atomic_load_n(&entry.sequence, __ATOMIC_ACQUIRE);
+        if (sequence == m_eventTail + 1) {
+            events[count] = entry;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&entry.sequence, __ATOMIC_RELAXED) == sequence) {
+                ++count;
+                continue;
+            }
+        }
+        //Overwritten by the publisher in the meantime
+        ++m_lostEvents;
+    }
+    return count;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADSHAREDSTATE_H
+#define QGAMEPADSHAREDSTATE_H
+
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtGamepad/qtgamepadglobal.h>
+#include <QtGamepad/qgamepadeventsink.h>
+#include <QtGamepad/qgamepadhandler.h>
+
+QT_BEGIN_HEADER
+
+QT_BEGIN_NAMESPACE
+
+class QGamepadManager;
+class QGamepadInfo;
+
+//Layout of the POSIX shared memory segment written by
+//QGamepadSharedStatePublisher. Every gamepad block is guarded by its own
+//seqlock and events go through a ring stamped per entry, so readers in
+//other processes never take a lock and never block the publisher.
+struct QGamepadSharedState
+{
+    enum {
+        Magic = 0x51475353,
+        //Bumped whenever the layout below changes
+        LayoutVersion = 1,
+        MaxGamepads = 32,
+        ButtonWords = QGamepadHandler::KeyCount / 32,
+        //Power of two
+        EventCount = 1024,
+        GuidSize = 40
+    };
+
+    struct Header {
+        quint32 magic;
+        quint32 layoutVersion;
+        quint32 size;
+        //0 once the publisher is gone
+        qint32 publisherPid;
+        //Index of the next event, see Event::sequence
+        quint64 eventHead;
+    };
+
+    //Device state after the last frame, in the codes of the frames (so
+    //mapped when the device has a control mapping). Hats are kept in the
+    //axes with their raw -1, 0 and 1.
+    struct Gamepad {
+        //Odd while the block is being written
+        quint32 sequence;
+        //QGamepadInfo::generation(), 0 while the slot is free
+        quint32 generation;
+        quint64 time;
+        quint64 frameCount;
+        char guid[GuidSize];
+        quint32 buttons[ButtonWords];
+        qint32 axes[QGamepadHandler::AbsCount];
+        QGamepadHandler::AxisCalibration calibration[QGamepadHandler::AbsCount];
+
+        bool isPresent() const { return generation != 0; }
+        bool button(int button) const
+        {
+            if (button < 0 || button >= QGamepadHandler::KeyCount)
+                return false;
+            return buttons[button / 32] & (1U << (button % 32));
+        }
+        //Normalised like QGamepadInfo::normalizeAxis()
+        float axis(int axis) const
+        {
+            if (axis < 0 || axis >= QGamepadHandler::AbsCount)
+                return 0.0f;
+            return QGamepadHandler::normalizeAxis(calibration[axis], axes[axis]);
+        }
+    };
+
+    struct Event {
+        //Index of the event + 1 once written, 0 while being written
+        quint64 sequence;
+        quint64 time;
+        quint32 generation;
+        qint16 id;
+        qint16 type;
+        qint32 code;
+        qint32 value;
+    };
+
+    Header header;
+    Gamepad gamepads[MaxGamepads];
+    Event events[EventCount];
+
+    static QString defaultName() { return QString::fromLatin1("/qtgamepad"); }
+};
+
+//Mirrors the devices of a QGamepadManager into a shared memory segment,
+//so other processes can read them without opening the devices
+//themselves. The publisher is a sink of the manager and writes on the
+//thread decoding the devices.
+class Q_GAMEPAD_EXPORT QGamepadSharedStatePublisher : public QObject, public QGamepadEventSink
+{
+    Q_OBJECT
+public:
+    explicit QGamepadSharedStatePublisher(QGamepadManager *manager, QObject *parent = 0);
+    ~QGamepadSharedStatePublisher();
+
+    //Creates or takes over the segment. Subscribers still attached to a
+    //segment of the same name see it reset.
+    bool start(const QString &name = QGamepadSharedState::defaultName());
+    //Unlinks the segment, attached subscribers keep their mapping
+    void stop();
+    bool isRunning() const { return m_state != 0; }
+    QString name() const { return m_name; }
+
+    void processGamepadFrame(int slot, const QGamepadHandler::GamepadFrame &frame);
+
+private slots:
+    void gamepadConnected(QGamepadInfo *info);
+    void gamepadDisconnected(QGamepadInfo *info);
+
+private:
+    void beginWrite(QGamepadSharedState::Gamepad *gamepad);
+    void endWrite(QGamepadSharedState::Gamepad *gamepad);
+
+    QPointer<QGamepadManager> m_manager;
+    QString m_name;
+    QGamepadSharedState *m_state;
+};
+
+//Read-only view of a segment written by QGamepadSharedStatePublisher.
+//Reads are wait-free for the publisher and retried by the subscriber
+//when they overlap a write.
+class Q_GAMEPAD_EXPORT QGamepadSharedStateSubscriber
+{
+public:
+    QGamepadSharedStateSubscriber();
+    ~QGamepadSharedStateSubscriber();
+
+    bool attach(const QString &name = QGamepadSharedState::defaultName());
+    void detach();
+    bool isAttached() const { return m_state != 0; }
+    //False once the publisher stopped or died, attach() again to follow
+    //a new one
+    bool isPublisherRunning() const;
+
+    //Consistent copy of one block, false while the slot is free
+    bool readGamepad(int id, QGamepadSharedState::Gamepad *gamepad) const;
+
+    //Events published since the last call, oldest first. Events the ring
+    //overwrote before they were read are counted in lostEventCount().
+    int readEvents(QGamepadSharedState::Event *events, int maxCount);
+    quint64 lostEventCount() const { return m_lostEvents; }
+
+    //The raw segment, for readers doing their own seqlock reads
+    const QGamepadSharedState *state() const { return m_state; }
+
+private:
+    Q_DISABLE_COPY(QGamepadSharedStateSubscriber)
+
+    const QGamepadSharedState *m_state;
+    quint64 m_eventTail;
+    quint64 m_lostEvents;
+};
+
+QT_END_NAMESPACE
+
+QT_END_HEADER
+
+#endif // QGAMEPADSHAREDSTATE_H
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADSNAPSHOTBUFFER_P_H
+#define QGAMEPADSNAPSHOTBUFFER_P_H
+
+#include <QtCore/QAtomicInt>
+#include <QtGamepad/qgamepadstatesnapshot.h>
+
+QT_BEGIN_NAMESPACE
+
+//Seqlock around one QGamepadStateSnapshot. A single thread writes between
+//beginWrite() and endWrite(), any number of threads read() concurrently.
+//Readers never block the writer, they retry if a write overlapped their copy.
+class QGamepadSnapshotBuffer
+{
+public:
+    QGamepadSnapshotBuffer()
+        : m_sequence(0)
+        , m_snapshot()
+    {}
+
+    QGamepadStateSnapshot *beginWrite()
+    {
+        //Odd while the snapshot is being written
+        m_sequence.store(m_sequence.load() + 1);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        return &m_snapshot;
+    }
+
+    void endWrite()
+    {
+        int sequence = m_sequence.load() + 1;
+        m_snapshot.version = uint(sequence) / 2;
+        m_sequence.storeRelease(sequence);
+    }
+
+    //Returns false until the first snapshot was published
+    bool read(QGamepadStateSnapshot *snapshot) const
+    {
+        for (;;) {
+            int before = m_sequence.loadAcquire();
+            if (before & 1)
+                continue;
+
+            *snapshot = m_snapshot;
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (m_sequence.load() == before)
+                return before != 0;
+        }
+    }
+
+private:
+    QAtomicInt m_sequence;
+    QGamepadStateSnapshot m_snapshot;
+};
+
+QT_END_NAMESPACE
+
+#endif // QGAMEPADSNAPSHOTBUFFER_P_H
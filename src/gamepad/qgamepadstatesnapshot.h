@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADSTATESNAPSHOT_H
+#define QGAMEPADSTATESNAPSHOT_H
+
+#include <QtCore/QPointF>
+#include <QtGamepad/qtgamepadglobal.h>
+#include <QtGamepad/qgamepadhandler.h>
+#include <QtGamepad/qgamepadmanager.h>
+
+QT_BEGIN_HEADER
+
+QT_BEGIN_NAMESPACE
+
+//Immutable copy of the whole QGamepadInputState, see
+//QGamepadInputState::readSnapshot(). Plain data, so it can be kept on the
+//stack of any thread.
+struct QGamepadStateSnapshot
+{
+    enum {
+        //Every slot QGamepadManager hands out
+        MaxGamepads = QGamepadManager::MaxGamepads,
+        ButtonWords = QGamepadHandler::KeyCount / (8 * sizeof(ulong)),
+        //Latin-1 keys followed by the block starting at Qt::Key_Escape
+        LatinKeyCount = 0x100,
+        SpecialKeyBase = Qt::Key_Escape,
+        SpecialKeyCount = 0x200,
+        KeyWords = (LatinKeyCount + SpecialKeyCount) / (8 * sizeof(ulong))
+    };
+
+    struct Gamepad {
+        bool present;
+        ulong buttons[ButtonWords];
+        //Normalised like QGamepadInputState::queryGamepadAxis()
+        float axes[QGamepadHandler::AbsCount];
+    };
+
+    //Increases with every published snapshot
+    quint64 version;
+
+    QPointF mousePos;
+    Qt::MouseButtons mouseButtons;
+    Qt::KeyboardModifiers keyboardModifiers;
+    ulong keys[KeyWords];
+
+    //Indexed by QGamepadInfo::id()
+    Gamepad gamepads[MaxGamepads];
+
+    //Keys outside the two ranges above are not part of the snapshot
+    bool queryKey(int key) const
+    {
+        if (key >= 0 && key < LatinKeyCount)
+            return testBit(keys, key);
+        if (key >= SpecialKeyBase && key < SpecialKeyBase + SpecialKeyCount)
+            return testBit(keys, LatinKeyCount + key - SpecialKeyBase);
+        return false;
+    }
+
+    bool queryGamepadButton(int button, int id = 0) const
+    {
+        if (id < 0 || id >= MaxGamepads || button < 0 || button >= QGamepadHandler::KeyCount)
+            return false;
+        return testBit(gamepads[id].buttons, button);
+    }
+
+    float queryGamepadAxis(int axis, int id = 0) const
+    {
+        if (id < 0 || id >= MaxGamepads || axis < 0 || axis >= QGamepadHandler::AbsCount)
+            return 0.0f;
+        return gamepads[id].axes[axis];
+    }
+
+    static bool testBit(const ulong *bits, int bit)
+    {
+        return bits[bit / (8 * sizeof(ulong))] & (1UL << (bit % (8 * sizeof(ulong))));
+    }
+};
+
+QT_END_NAMESPACE
+
+QT_END_HEADER
+
+#endif // QGAMEPADSTATESNAPSHOT_H
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "qgamepadstickpipeline_p.h"
+
+#include <math.h>
+
+QT_BEGIN_NAMESPACE
+
+static const float TwoPi = 6.2831853f;
+//One euro filters smooth the speed itself with a fixed 1 Hz cutoff
+static const float SpeedTau = 1.0f / TwoPi;
+
+QGamepadStickPipeline::QGamepadStickPipeline()
+    : m_slotCount(0)
+    , m_smoothingSlots(0)
+    , m_time(0)
+{
+}
+
+void QGamepadStickPipeline::resize(int slotCount)
+{
+    if (slotCount <= m_slotCount)
+        return;
+
+    int oldCount = m_slotCount;
+    m_slotCount = slotCount;
+
+    m_settings.resize(slotCount);
+    m_inX.resize(slotCount);
+    m_inY.resize(slotCount);
+    m_x.resize(slotCount);
+    m_y.resize(slotCount);
+    m_speedX.resize(slotCount);
+    m_speedY.resize(slotCount);
+    m_radial.resize(slotCount);
+    m_inner.resize(slotCount);
+    m_offset.resize(slotCount);
+    m_scale.resize(slotCount);
+    m_lut.resize(slotCount * LutSize);
+    m_smoothing.resize(slotCount);
+    m_minCutoff.resize(slotCount);
+    m_beta.resize(slotCount);
+    m_prime.resize(slotCount);
+
+    for (int slot = oldCount; slot < slotCount; ++slot) {
+        m_inX[slot] = m_inY[slot] = 0.0f;
+        m_x[slot] = m_y[slot] = 0.0f;
+        m_speedX[slot] = m_speedY[slot] = 0.0f;
+        m_prime[slot] = 1.0f;
+        updateCoefficients(slot);
+    }
+}
+
+void QGamepadStickPipeline::setSettings(int slot, const QGamepadInputState::StickSettings &settings)
+{
+    if (m_settings.at(slot).smoothing != QGamepadInputState::NoSmoothing)
+        --m_smoothingSlots;
+    m_settings[slot] = settings;
+    if (settings.smoothing != QGamepadInputState::NoSmoothing)
+        ++m_smoothingSlots;
+
+    updateCoefficients(slot);
+    reset(slot);
+}
+
+void QGamepadStickPipeline::updateCoefficients(int slot)
+{
+    const QGamepadInputState::StickSettings &settings = m_settings.at(slot);
+
+    float inner = qBound(0.0f, settings.innerDeadzone, 1.0f);
+    float outer = qBound(inner + 0.001f, settings.outerDeadzone, 1.0f + 0.001f);
+    bool radial = settings.deadzone == QGamepadInputState::RadialDeadzone
+            || settings.deadzone == QGamepadInputState::ScaledRadialDeadzone;
+
+    m_radial[slot] = radial ? 1.0f : 0.0f;
+    m_inner[slot] = inner;
+    m_offset[slot] = settings.deadzone == QGamepadInputState::RadialDeadzone ? 0.0f : inner;
+    m_scale[slot] = 1.0f / (outer - m_offset.at(slot));
+
+    //Resample the curve to the fixed table size
+    float *lut = m_lut.data() + slot * LutSize;
+    const QVector<float> &curve = settings.responseCurve;
+    for (int i = 0; i < LutSize; ++i) {
+        float input = float(i) / LutSegments;
+        if (curve.count() < 2) {
+            lut[i] = input;
+            continue;
+        }
+        float position = input * (curve.count() - 1);
+        int index = qMin(int(position), curve.count() - 2);
+        float fraction = position - index;
+        lut[i] = curve.at(index) + fraction * (curve.at(index + 1) - curve.at(index));
+    }
+
+    //Exponential smoothing is a one euro filter that ignores the speed
+    switch (settings.smoothing) {
+    case QGamepadInputState::NoSmoothing:
+        m_smoothing[slot] = 0.0f;
+        m_minCutoff[slot] = 1.0f;
+        m_beta[slot] = 0.0f;
+        break;
+    case QGamepadInputState::ExponentialSmoothing:
+        m_smoothing[slot] = 1.0f;
+        m_minCutoff[slot] = 1000.0f / (TwoPi * qMax(settings.smoothingTime, 0.001f));
+        m_beta[slot] = 0.0f;
+        break;
+    case QGamepadInputState::OneEuroSmoothing:
+        m_smoothing[slot] = 1.0f;
+        m_minCutoff[slot] = qMax(settings.minCutoff, 0.001f);
+        m_beta[slot] = qMax(settings.beta, 0.0f);
+        break;
+    }
+}
+
+void QGamepadStickPipeline::process(quint64 time)
+{
+    //Seconds since the previous pass, the same for every slot
+    float dt = m_time && time > m_time ? (time - m_time) / 1000000.0f : 0.0f;
+    dt = qBound(0.000001f, dt, 1.0f);
+    m_time = time;
+
+    const float *inX = m_inX.constData();
+    const float *inY = m_inY.constData();
+    const float *radial = m_radial.constData();
+    const float *innerDeadzone = m_inner.constData();
+    const float *offset = m_offset.constData();
+    const float *scale = m_scale.constData();
+    const float *lut = m_lut.constData();
+    const float *smoothing = m_smoothing.constData();
+    const float *minCutoff = m_minCutoff.constData();
+    const float *beta = m_beta.constData();
+    float *outX = m_x.data();
+    float *outY = m_y.data();
+    float *speedX = m_speedX.data();
+    float *speedY = m_speedY.data();
+    float *prime = m_prime.data();
+
+    for (int i = 0; i < m_slotCount; ++i) {
+        float x = inX[i];
+        float y = inY[i];
+
+        //Radial modes measure both axes by the stick's magnitude, axial
+        //ones each axis by itself
+        float magnitude = sqrtf(x * x + y * y);
+        float mx = radial[i] * magnitude + (1.0f - radial[i]) * fabsf(x);
+        float my = radial[i] * magnitude + (1.0f - radial[i]) * fabsf(y);
+
+        float rx = mx < innerDeadzone[i] ? 0.0f : qBound(0.0f, (mx - offset[i]) * scale[i], 1.0f);
+        float ry = my < innerDeadzone[i] ? 0.0f : qBound(0.0f, (my - offset[i]) * scale[i], 1.0f);
+
+        //Response curve, linear between table entries
+        const float *table = lut + i * LutSize;
+        float px = rx * LutSegments;
+        float py = ry * LutSegments;
+        int ix = qMin(int(px), LutSegments - 1);
+        int iy = qMin(int(py), LutSegments - 1);
+        rx = table[ix] + (px - ix) * (table[ix + 1] - table[ix]);
+        ry = table[iy] + (py - iy) * (table[iy + 1] - table[iy]);
+
+        //Back to the direction of the input
+        float targetX = mx > 0.0f ? x * rx / mx : 0.0f;
+        float targetY = my > 0.0f ? y * ry / my : 0.0f;
+
+        //One euro filter, the cutoff rises with the speed of the stick.
+        //Without smoothing tau is 0 and the output follows the input.
+        float speedAlpha = dt / (dt + smoothing[i] * SpeedTau);
+        speedX[i] += speedAlpha * ((targetX - outX[i]) / dt - speedX[i]);
+        speedY[i] += speedAlpha * ((targetY - outY[i]) / dt - speedY[i]);
+
+        float tauX = smoothing[i] / (TwoPi * (minCutoff[i] + beta[i] * fabsf(speedX[i])));
+        float tauY = smoothing[i] / (TwoPi * (minCutoff[i] + beta[i] * fabsf(speedY[i])));
+        float alphaX = qMax(dt / (dt + tauX), prime[i]);
+        float alphaY = qMax(dt / (dt + tauY), prime[i]);
+        outX[i] += alphaX * (targetX - outX[i]);
+        outY[i] += alphaY * (targetY - outY[i]);
+        speedX[i] *= 1.0f - prime[i];
+        speedY[i] *= 1.0f - prime[i];
+        prime[i] = 0.0f;
+    }
+}
+
+float QGamepadStickPipeline::normalizeFullRange(const QGamepadHandler::AxisCalibration &calibration, int value)
+{
+    //The calibration scales from the deadzone edges, recover the ends of
+    //the range from them and scale from the center instead
+    float center = (calibration.lo + calibration.hi) * 0.5f;
+    if (value >= center) {
+        if (calibration.posScale <= 0.0f)
+            return 0.0f;
+        float maximum = calibration.hi + 1.0f / calibration.posScale;
+        return qMin((value - center) / (maximum - center), 1.0f);
+    }
+
+    if (calibration.negScale <= 0.0f)
+        return 0.0f;
+    float minimum = calibration.lo - 1.0f / calibration.negScale;
+    return qMax((value - center) / (center - minimum), -1.0f);
+}
+
+QT_END_NAMESPACE
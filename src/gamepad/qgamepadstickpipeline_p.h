@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADSTICKPIPELINE_P_H
+#define QGAMEPADSTICKPIPELINE_P_H
+
+#include <QtCore/QVector>
+#include <QtGamepad/qgamepadinputstate.h>
+
+QT_BEGIN_NAMESPACE
+
+//Deadzones, response curve and smoothing for every stick of every
+//gamepad, one slot per stick. The settings are folded into per slot
+//coefficients kept as structure of arrays, so process() is a straight
+//loop over all slots without branching on the settings.
+class QGamepadStickPipeline
+{
+public:
+    enum { LutSegments = 32, LutSize = LutSegments + 1 };
+
+    QGamepadStickPipeline();
+
+    //New slots start with the default settings
+    int slotCount() const { return m_slotCount; }
+    void resize(int slotCount);
+
+    const QGamepadInputState::StickSettings &settings(int slot) const { return m_settings.at(slot); }
+    void setSettings(int slot, const QGamepadInputState::StickSettings &settings);
+    bool isSmoothing() const { return m_smoothingSlots > 0; }
+
+    void setInput(int slot, float x, float y) { m_inX[slot] = x; m_inY[slot] = y; }
+    //The next process() skips smoothing and jumps to the input
+    void reset(int slot) { m_prime[slot] = 1.0f; }
+    //time in microseconds, only differences matter
+    void process(quint64 time);
+    float x(int slot) const { return m_x.at(slot); }
+    float y(int slot) const { return m_y.at(slot); }
+
+    //Like QGamepadHandler::normalizeAxis() but ignoring the deadzone
+    static float normalizeFullRange(const QGamepadHandler::AxisCalibration &calibration, int value);
+
+private:
+    void updateCoefficients(int slot);
+
+    int m_slotCount;
+    int m_smoothingSlots;
+    quint64 m_time;
+    QVector<QGamepadInputState::StickSettings> m_settings;
+
+    QVector<float> m_inX;
+    QVector<float> m_inY;
+    //Smoothed output and the smoothed speed of each axis
+    QVector<float> m_x;
+    QVector<float> m_y;
+    QVector<float> m_speedX;
+    QVector<float> m_speedY;
+
+    //1 for the radial modes, 0 for the axial ones
+    QVector<float> m_radial;
+    QVector<float> m_inner;
+    QVector<float> m_offset;
+    QVector<float> m_scale;
+    //LutSize entries per slot
+    QVector<float> m_lut;
+    //0 without smoothing, 1 with
+    QVector<float> m_smoothing;
+    QVector<float> m_minCutoff;
+    QVector<float> m_beta;
+    QVector<float> m_prime;
+};
+
+QT_END_NAMESPACE
+
+#endif // QGAMEPADSTICKPIPELINE_P_H
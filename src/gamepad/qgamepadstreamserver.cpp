@@ -0,0 +1,425 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "qgamepadstreamserver.h"
+#include "qgamepadmanager.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QStandardPaths>
+#include <qplatformdefs.h>
+
+#include <errno.h>
+#include <linux/input.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+QT_BEGIN_NAMESPACE
+
+Q_STATIC_ASSERT(sizeof(QGamepadStreamRecord) == 48);
+Q_STATIC_ASSERT(int(QGamepadHandler::ResyncFrame) == int(QGamepadStreamRecord::ResyncFlag));
+
+static QGamepadStreamRecord record(QGamepadStreamRecord::Type type, int id, quint32 generation, quint64 time = 0)
+{
+    QGamepadStreamRecord record;
+    //No stack garbage in the union or the padding
+    memset(&record, 0, sizeof(record));
+    record.type = type;
+    record.id = id;
+    record.generation = generation;
+    record.time = time;
+    return record;
+}
+
+QGamepadStreamServer::QGamepadStreamServer(QGamepadManager *manager, QObject *parent)
+    : QObject(parent)
+    , m_manager(manager)
+    , m_listenFd(-1)
+    , m_listenNotifier(0)
+{
+    memset(m_devices, 0, sizeof(m_devices));
+    connect(manager, SIGNAL(gamepadConnected(QGamepadInfo*)), this, SLOT(gamepadConnected(QGamepadInfo*)));
+    connect(manager, SIGNAL(gamepadDisconnected(QGamepadInfo*)), this, SLOT(gamepadDisconnected(QGamepadInfo*)));
+}
+
+QGamepadStreamServer::~QGamepadStreamServer()
+{
+    close();
+}
+
+QString QGamepadStreamServer::defaultPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation) + QLatin1String("/qtgamepad-stream");
+}
+
+bool QGamepadStreamServer::listen(const QString &path)
+{
+    close();
+    if (!m_manager)
+        return false;
+
+    QByteArray fileName = QFile::encodeName(path);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (fileName.size() >= int(sizeof(address.sun_path))) {
+        qWarning("Cannot listen on gamepad stream socket '%s': path too long", fileName.constData());
+        return false;
+    }
+    memcpy(address.sun_path, fileName.constData(), fileName.size());
+
+    m_listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listenFd >= 0) {
+        ::unlink(fileName.constData());
+        if (bind(m_listenFd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) < 0
+                || ::listen(m_listenFd, 16) < 0) {
+            QT_CLOSE(m_listenFd);
+            m_listenFd = -1;
+        }
+    }
+    if (m_listenFd < 0) {
+        qWarning("Cannot listen on gamepad stream socket '%s': %s", fileName.constData(), strerror(errno));
+        return false;
+    }
+    m_path = path;
+
+    m_listenNotifier = new QSocketNotifier(m_listenFd, QSocketNotifier::Read, this);
+    connect(m_listenNotifier, SIGNAL(activated(int)), this, SLOT(acceptClients()));
+
+    memset(m_devices, 0, sizeof(m_devices));
+    for (int i = 0; i < QGamepadManager::MaxGamepads; ++i) {
+        if (QGamepadInfo *info = m_manager->gamepadInfo(i))
+            gamepadConnected(info);
+    }
+
+    if (!m_manager->addEventSink(this)) {
+        qWarning("Cannot stream gamepad events: the manager has no free event sink");
+        close();
+        return false;
+    }
+    return true;
+}
+
+void QGamepadStreamServer::close()
+{
+    if (m_listenFd < 0)
+        return;
+
+    if (m_manager)
+        m_manager->removeEventSink(this);
+
+    foreach (Client *client, m_clients)
+        closeClient(client);
+    removeClosedClients();
+
+    m_listenNotifier->setEnabled(false);
+    m_listenNotifier->deleteLater();
+    m_listenNotifier = 0;
+    QT_CLOSE(m_listenFd);
+    m_listenFd = -1;
+    ::unlink(QFile::encodeName(m_path).constData());
+}
+
+QGamepadStreamServer::Client *QGamepadStreamServer::client(int fd) const
+{
+    foreach (Client *client, m_clients) {
+        if (client->fd == fd)
+            return client;
+    }
+    return 0;
+}
+
+void QGamepadStreamServer::closeClient(Client *client)
+{
+    client->closed = true;
+    client->readNotifier->setEnabled(false);
+    client->writeNotifier->setEnabled(false);
+}
+
+void QGamepadStreamServer::removeClosedClients()
+{
+    for (int i = m_clients.count() - 1; i >= 0; --i) {
+        Client *client = m_clients.at(i);
+        if (!client->closed)
+            continue;
+        //May be called from their own activated() signal
+        client->readNotifier->deleteLater();
+        client->writeNotifier->deleteLater();
+        QT_CLOSE(client->fd);
+        delete client;
+        m_clients.removeAt(i);
+    }
+}
+
+void QGamepadStreamServer::acceptClients()
+{
+    forever {
+        int fd = accept4(m_listenFd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                qWarning("Cannot accept gamepad stream client: %s", strerror(errno));
+            break;
+        }
+
+        Client *client = new Client;
+        client->fd = fd;
+        client->stalled = false;
+        client->closed = false;
+        client->readNotifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+        connect(client->readNotifier, SIGNAL(activated(int)), this, SLOT(clientReadable(int)));
+        client->writeNotifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+        client->writeNotifier->setEnabled(false);
+        connect(client->writeNotifier, SIGNAL(activated(int)), this, SLOT(clientWritable(int)));
+        m_clients.append(client);
+
+        sendSnapshot(client);
+    }
+    removeClosedClients();
+}
+
+void QGamepadStreamServer::clientReadable(int fd)
+{
+    Client *client = this->client(fd);
+    if (!client)
+        return;
+
+    //Clients have nothing to say, this only notices them leaving
+    char buffer[64];
+    ssize_t result = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (result == 0 || (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        closeClient(client);
+        removeClosedClients();
+    }
+}
+
+void QGamepadStreamServer::clientWritable(int fd)
+{
+    Client *client = this->client(fd);
+    if (!client)
+        return;
+
+    client->writeNotifier->setEnabled(false);
+    if (client->stalled)
+        sendSnapshot(client);
+    removeClosedClients();
+}
+
+bool QGamepadStreamServer::send(Client *client, struct mmsghdr *messages, int count)
+{
+    int sent = 0;
+    while (sent < count) {
+        int result = sendmmsg(client->fd, messages + sent, count - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (result > 0) {
+            sent += result;
+        } else if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+            //Whatever it missed is covered by the snapshot it gets later
+            client->stalled = true;
+            client->writeNotifier->setEnabled(true);
+            return false;
+        } else {
+            closeClient(client);
+            return false;
+        }
+    }
+    return true;
+}
+
+void QGamepadStreamServer::broadcast(const QGamepadStreamRecord *records, int count)
+{
+    struct iovec iov;
+    iov.iov_base = const_cast<QGamepadStreamRecord *>(records);
+    iov.iov_len = count * sizeof(QGamepadStreamRecord);
+    struct mmsghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_hdr.msg_iov = &iov;
+    message.msg_hdr.msg_iovlen = 1;
+
+    foreach (Client *client, m_clients) {
+        if (!client->stalled && !client->closed)
+            send(client, &message, 1);
+    }
+    removeClosedClients();
+}
+
+void QGamepadStreamServer::sendSnapshot(Client *client)
+{
+    //A Reset message, then one message per device, in one sendmmsg()
+    QVector<QGamepadStreamRecord> records;
+    QVector<int> messageStarts;
+
+    QGamepadStreamRecord reset = record(QGamepadStreamRecord::Reset, -1, 0);
+    reset.data.reset.protocolVersion = QGamepadStreamRecord::ProtocolVersion;
+    reset.data.reset.recordSize = sizeof(QGamepadStreamRecord);
+    messageStarts.append(0);
+    records.append(reset);
+
+    for (int i = 0; i < MaxDevices; ++i) {
+        if (!m_devices[i].generation)
+            continue;
+        messageStarts.append(records.count());
+        appendDeviceRecords(i, &records, true);
+    }
+    messageStarts.append(records.count());
+
+    int count = messageStarts.count() - 1;
+    QVector<struct iovec> iov(count);
+    QVector<struct mmsghdr> messages(count);
+    memset(messages.data(), 0, count * sizeof(struct mmsghdr));
+    for (int i = 0; i < count; ++i) {
+        iov[i].iov_base = records.data() + messageStarts.at(i);
+        iov[i].iov_len = (messageStarts.at(i + 1) - messageStarts.at(i)) * sizeof(QGamepadStreamRecord);
+        messages[i].msg_hdr.msg_iov = &iov[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    client->stalled = false;
+    send(client, messages.data(), count);
+}
+
+void QGamepadStreamServer::appendDeviceRecords(int id, QVector<QGamepadStreamRecord> *records, bool state) const
+{
+    const Device &device = m_devices[id];
+
+    QGamepadStreamRecord added = record(QGamepadStreamRecord::DeviceAdded, id, device.generation, device.time);
+    memcpy(added.data.guid, device.guid, sizeof(added.data.guid));
+    records->append(added);
+
+    for (int axis = 0; axis < QGamepadHandler::AbsCount; ++axis) {
+        const QGamepadHandler::AxisCalibration &calibration = device.calibration[axis];
+        if (!calibration.negScale && !calibration.posScale)
+            continue;
+        QGamepadStreamRecord axisRecord = record(QGamepadStreamRecord::Calibration, id, device.generation, device.time);
+        axisRecord.data.calibration.axis = axis;
+        axisRecord.data.calibration.calibration = calibration;
+        records->append(axisRecord);
+    }
+
+    if (!state)
+        return;
+
+    QGamepadStreamRecord event = record(QGamepadStreamRecord::Event, id, device.generation, device.time);
+    event.flags = QGamepadStreamRecord::StateFlag;
+    for (int button = 0; button < QGamepadHandler::KeyCount; ++button) {
+        if (!(device.buttons[button / (8 * sizeof(ulong))] & (1UL << (button % (8 * sizeof(ulong))))))
+            continue;
+        event.data.event.type = QGamepadHandler::Button;
+        event.data.event.code = button;
+        event.data.event.value = 1;
+        records->append(event);
+    }
+    for (int axis = 0; axis < QGamepadHandler::AbsCount; ++axis) {
+        if (!(device.axesSeen & (Q_UINT64_C(1) << axis)))
+            continue;
+        bool hat = axis >= ABS_HAT0X && axis <= ABS_HAT3Y;
+        event.data.event.type = hat ? QGamepadHandler::Hat : QGamepadHandler::Axis;
+        event.data.event.code = axis;
+        event.data.event.value = device.axes[axis];
+        records->append(event);
+    }
+}
+
+void QGamepadStreamServer::gamepadConnected(QGamepadInfo *info)
+{
+    int id = info->id();
+    if (id < 0 || id >= MaxDevices)
+        return;
+
+    Device &device = m_devices[id];
+    memset(&device, 0, sizeof(device));
+    device.generation = info->generation();
+    QByteArray guid = info->guid();
+    memcpy(device.guid, guid.constData(), qMin(guid.size(), int(sizeof(device.guid))));
+    const QGamepadHandler::AxisCalibration *calibration = info->axisCalibration();
+    memcpy(device.calibration, calibration, sizeof(device.calibration));
+    //Sticks held while the device was plugged in start where they are,
+    //buttons and hats are only known once reported
+    const int *axisState = info->axisState();
+    for (int axis = 0; axis < QGamepadHandler::AbsCount; ++axis) {
+        if (!calibration[axis].negScale && !calibration[axis].posScale)
+            continue;
+        device.axesSeen |= Q_UINT64_C(1) << axis;
+        device.axes[axis] = axisState[axis];
+    }
+
+    if (m_clients.isEmpty() || m_listenFd < 0)
+        return;
+    QVector<QGamepadStreamRecord> records;
+    appendDeviceRecords(id, &records, false);
+    broadcast(records.constData(), records.count());
+}
+
+void QGamepadStreamServer::gamepadDisconnected(QGamepadInfo *info)
+{
+    int id = info->id();
+    if (id < 0 || id >= MaxDevices || !m_devices[id].generation)
+        return;
+
+    QGamepadStreamRecord removed = record(QGamepadStreamRecord::DeviceRemoved, id, m_devices[id].generation);
+    m_devices[id].generation = 0;
+    if (!m_clients.isEmpty() && m_listenFd >= 0)
+        broadcast(&removed, 1);
+}
+
+void QGamepadStreamServer::processGamepadFrame(int slot, const QGamepadHandler::GamepadFrame &frame)
+{
+    if (slot < 0 || slot >= MaxDevices || !m_devices[slot].generation || !frame.count)
+        return;
+
+    //Kept current even without clients, for the snapshots
+    Device &device = m_devices[slot];
+    device.time = frame.time;
+    for (int i = 0; i < frame.count; ++i) {
+        const QGamepadHandler::GamepadEvent &event = frame.events[i];
+        if (event.type == QGamepadHandler::Button && event.code >= 0 && event.code < QGamepadHandler::KeyCount) {
+            ulong bit = 1UL << (event.code % (8 * sizeof(ulong)));
+            if (event.value)
+                device.buttons[event.code / (8 * sizeof(ulong))] |= bit;
+            else
+                device.buttons[event.code / (8 * sizeof(ulong))] &= ~bit;
+        } else if ((event.type == QGamepadHandler::Axis || event.type == QGamepadHandler::Hat)
+                   && event.code >= 0 && event.code < QGamepadHandler::AbsCount) {
+            device.axes[event.code] = event.value;
+            device.axesSeen |= Q_UINT64_C(1) << event.code;
+        }
+    }
+
+    if (m_clients.isEmpty())
+        return;
+
+    QGamepadStreamRecord records[QGamepadHandler::MaxFrameEvents];
+    QGamepadStreamRecord event = record(QGamepadStreamRecord::Event, slot, device.generation, frame.time);
+    event.flags = frame.flags & QGamepadStreamRecord::ResyncFlag;
+    for (int i = 0; i < frame.count; ++i) {
+        event.data.event.type = frame.events[i].type;
+        event.data.event.code = frame.events[i].code;
+        event.data.event.value = frame.events[i].value;
+        records[i] = event;
+    }
+    broadcast(records, frame.count);
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QGAMEPADSTREAMSERVER_H
+#define QGAMEPADSTREAMSERVER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QList>
+#include <QtCore/QPointer>
+#include <QtCore/QVector>
+#include <QtGamepad/qtgamepadglobal.h>
+#include <QtGamepad/qgamepadeventsink.h>
+#include <QtGamepad/qgamepadhandler.h>
+
+QT_BEGIN_HEADER
+
+QT_BEGIN_NAMESPACE
+
+class QGamepadManager;
+class QGamepadInfo;
+class QSocketNotifier;
+
+//Wire format of QGamepadStreamServer. Every SOCK_SEQPACKET message is a
+//whole number of these records and holds one frame, one device change or
+//one part of a state snapshot.
+struct QGamepadStreamRecord
+{
+    enum { ProtocolVersion = 1, GuidSize = 32 };
+
+    enum Type {
+        //Forget every device, a snapshot of the current state follows
+        Reset,
+        DeviceAdded,
+        DeviceRemoved,
+        Calibration,
+        Event
+    };
+
+    enum Flag {
+        //Same as QGamepadHandler::ResyncFrame
+        ResyncFlag = 0x1,
+        //Current state sent in a snapshot rather than a change
+        StateFlag = 0x2
+    };
+
+    struct ResetData {
+        quint32 protocolVersion;
+        quint32 recordSize;
+    };
+    struct EventData {
+        qint32 type;
+        qint32 code;
+        qint32 value;
+    };
+    struct CalibrationData {
+        qint32 axis;
+        QGamepadHandler::AxisCalibration calibration;
+    };
+
+    quint8 type;
+    quint8 flags;
+    //QGamepadInfo::id() and generation()
+    qint16 id;
+    quint32 generation;
+    quint64 time;
+    union {
+        ResetData reset;
+        EventData event;
+        CalibrationData calibration;
+        //Not terminated when all GuidSize characters are used
+        char guid[GuidSize];
+    } data;
+};
+
+//Streams the devices of a QGamepadManager to local clients over an
+//AF_UNIX SOCK_SEQPACKET socket. Clients first get a snapshot, then one
+//message per frame as it is decoded. A client whose socket is full is not
+//queued for: its frames are dropped and it gets a fresh snapshot once it
+//can take one, so a stuck client never holds up the others.
+//
+//The server is a sink of the manager and has to live in the thread the
+//frames are processed in.
+class Q_GAMEPAD_EXPORT QGamepadStreamServer : public QObject, public QGamepadEventSink
+{
+    Q_OBJECT
+public:
+    explicit QGamepadStreamServer(QGamepadManager *manager, QObject *parent = 0);
+    ~QGamepadStreamServer();
+
+    //A stale socket file at path is replaced
+    bool listen(const QString &path = defaultPath());
+    void close();
+    bool isListening() const { return m_listenFd >= 0; }
+    QString path() const { return m_path; }
+    int clientCount() const { return m_clients.count(); }
+
+    //qtgamepad-stream in the user's runtime directory
+    static QString defaultPath();
+
+    void processGamepadFrame(int slot, const QGamepadHandler::GamepadFrame &frame);
+
+private slots:
+    void gamepadConnected(QGamepadInfo *info);
+    void gamepadDisconnected(QGamepadInfo *info);
+    void acceptClients();
+    void clientReadable(int fd);
+    void clientWritable(int fd);
+
+private:
+    struct Client {
+        int fd;
+        QSocketNotifier *readNotifier;
+        QSocketNotifier *writeNotifier;
+        //Frames were dropped, a snapshot is due
+        bool stalled;
+        bool closed;
+    };
+
+    //What the snapshots are built from
+    struct Device {
+        quint32 generation;
+        char guid[QGamepadStreamRecord::GuidSize];
+        QGamepadHandler::AxisCalibration calibration[QGamepadHandler::AbsCount];
+        quint64 axesSeen;
+        quint64 time;
+        ulong buttons[QGamepadHandler::KeyCount / (8 * sizeof(ulong))];
+        int axes[QGamepadHandler::AbsCount];
+    };
+
+    enum { MaxDevices = 32 };
+
+    Client *client(int fd) const;
+    void removeClosedClients();
+    void closeClient(Client *client);
+    void sendSnapshot(Client *client);
+    bool send(Client *client, struct mmsghdr *messages, int count);
+    void broadcast(const QGamepadStreamRecord *records, int count);
+    void appendDeviceRecords(int id, QVector<QGamepadStreamRecord> *records, bool state) const;
+
+    QPointer<QGamepadManager> m_manager;
+    QString m_path;
+    int m_listenFd;
+    QSocketNotifier *m_listenNotifier;
+    QList<Client*> m_clients;
+    Device m_devices[MaxDevices];
+};
+
+QT_END_NAMESPACE
+
+QT_END_HEADER
+
+#endif // QGAMEPADSTREAMSERVER_H
@@ -0,0 +1,6 @@
+TEMPLATE = subdirs
+SUBDIRS += \
+    qgamepadcombodetector \
+    qgamepadforcefeedback \
+    qgamepadhandler \
+    qgamepadmappingdatabase
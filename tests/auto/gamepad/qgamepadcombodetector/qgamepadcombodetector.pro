@@ -0,0 +1,5 @@
+CONFIG += testcase
+TARGET = tst_qgamepadcombodetector
+QT = core gamepad testlib
+
+SOURCES += tst_qgamepadcombodetector.cpp
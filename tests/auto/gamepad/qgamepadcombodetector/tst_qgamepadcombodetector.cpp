@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <QtTest/QtTest>
+#include <QtGamepad/QGamepadComboDetector>
+#include <QtGamepad/QGamepadInputState>
+
+//Records the combos in the order they were detected
+class ComboRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    QList<int> combos;
+
+public slots:
+    void comboDetected(int combo, int, quint64) { combos.append(combo); }
+};
+
+class tst_QGamepadComboDetector : public QObject
+{
+    Q_OBJECT
+
+public:
+    tst_QGamepadComboDetector();
+
+private slots:
+    void init();
+    void cleanup();
+    void overlappingPatterns();
+    void stepWindow();
+    void sharedSuffix();
+    void chordInSequence();
+
+private:
+    QList<int> detected();
+    void press(int button, int msecs);
+    void release(int button, int msecs);
+    void tap(int button, int msecs);
+    static QList<QList<int> > steps(int first, int second, int third = -1);
+
+    QGamepadInfo m_info;
+    QGamepadComboDetector *m_detector;
+    ComboRecorder *m_recorder;
+};
+
+tst_QGamepadComboDetector::tst_QGamepadComboDetector()
+    : m_info(0, 0)
+    , m_detector(0)
+    , m_recorder(0)
+{
+}
+
+void tst_QGamepadComboDetector::init()
+{
+    m_detector = new QGamepadComboDetector;
+    m_recorder = new ComboRecorder;
+    connect(m_detector, SIGNAL(comboDetected(int,int,quint64)), m_recorder, SLOT(comboDetected(int,int,quint64)));
+}
+
+void tst_QGamepadComboDetector::cleanup()
+{
+    delete m_detector;
+    m_detector = 0;
+    delete m_recorder;
+    m_recorder = 0;
+}
+
+QList<int> tst_QGamepadComboDetector::detected()
+{
+    QList<int> combos = m_recorder->combos;
+    m_recorder->combos.clear();
+    qSort(combos);
+    return combos;
+}
+
+void tst_QGamepadComboDetector::press(int button, int msecs)
+{
+    m_detector->processGamepadEvent(&m_info, quint64(msecs) * 1000, QGamepadHandler::Button, button, 1);
+}
+
+void tst_QGamepadComboDetector::release(int button, int msecs)
+{
+    m_detector->processGamepadEvent(&m_info, quint64(msecs) * 1000, QGamepadHandler::Button, button, 0);
+}
+
+void tst_QGamepadComboDetector::tap(int button, int msecs)
+{
+    press(button, msecs);
+    release(button, msecs + 20);
+}
+
+QList<QList<int> > tst_QGamepadComboDetector::steps(int first, int second, int third)
+{
+    QList<QList<int> > steps;
+    steps << (QList<int>() << first) << (QList<int>() << second);
+    if (third >= 0)
+        steps << (QList<int>() << third);
+    return steps;
+}
+
+void tst_QGamepadComboDetector::overlappingPatterns()
+{
+    int ab = m_detector->addSequence("ab", steps(QGamepadInputState::Gamepad_A, QGamepadInputState::Gamepad_B));
+    int bx = m_detector->addSequence("bx", steps(QGamepadInputState::Gamepad_B, QGamepadInputState::Gamepad_X));
+    int abx = m_detector->addSequence("abx", steps(QGamepadInputState::Gamepad_A, QGamepadInputState::Gamepad_B, QGamepadInputState::Gamepad_X));
+    QCOMPARE(m_detector->comboCount(), 3);
+
+    tap(QGamepadInputState::Gamepad_A, 0);
+    QCOMPARE(detected(), QList<int>());
+    tap(QGamepadInputState::Gamepad_B, 100);
+    QCOMPARE(detected(), QList<int>() << ab);
+    //Completes the long pattern and the one starting inside it
+    tap(QGamepadInputState::Gamepad_X, 200);
+    QCOMPARE(detected(), QList<int>() << bx << abx);
+}
+
+void tst_QGamepadComboDetector::stepWindow()
+{
+    int abx = m_detector->addSequence("abx", steps(QGamepadInputState::Gamepad_A, QGamepadInputState::Gamepad_B, QGamepadInputState::Gamepad_X), 250);
+
+    //Last step too late
+    tap(QGamepadInputState::Gamepad_A, 0);
+    tap(QGamepadInputState::Gamepad_B, 200);
+    tap(QGamepadInputState::Gamepad_X, 500);
+    QCOMPARE(detected(), QList<int>());
+
+    //First step too late, the last two being quick does not help
+    tap(QGamepadInputState::Gamepad_A, 1000);
+    tap(QGamepadInputState::Gamepad_B, 1300);
+    tap(QGamepadInputState::Gamepad_X, 1400);
+    QCOMPARE(detected(), QList<int>());
+
+    //A button no pattern uses breaks the sequence however quick it is
+    tap(QGamepadInputState::Gamepad_A, 2000);
+    tap(QGamepadInputState::Gamepad_Y, 2050);
+    tap(QGamepadInputState::Gamepad_B, 2100);
+    tap(QGamepadInputState::Gamepad_X, 2200);
+    QCOMPARE(detected(), QList<int>());
+
+    tap(QGamepadInputState::Gamepad_A, 3000);
+    tap(QGamepadInputState::Gamepad_B, 3250);
+    tap(QGamepadInputState::Gamepad_X, 3500);
+    QCOMPARE(detected(), QList<int>() << abx);
+}
+
+void tst_QGamepadComboDetector::sharedSuffix()
+{
+    int abx = m_detector->addSequence("abx", steps(QGamepadInputState::Gamepad_A, QGamepadInputState::Gamepad_B, QGamepadInputState::Gamepad_X));
+    int ybx = m_detector->addSequence("ybx", steps(QGamepadInputState::Gamepad_Y, QGamepadInputState::Gamepad_B, QGamepadInputState::Gamepad_X));
+    int bx = m_detector->addSequence("bx", steps(QGamepadInputState::Gamepad_B, QGamepadInputState::Gamepad_X));
+
+    tap(QGamepadInputState::Gamepad_Y, 0);
+    tap(QGamepadInputState::Gamepad_B, 100);
+    tap(QGamepadInputState::Gamepad_X, 200);
+    QCOMPARE(detected(), QList<int>() << ybx << bx);
+
+    tap(QGamepadInputState::Gamepad_A, 1000);
+    tap(QGamepadInputState::Gamepad_B, 1100);
+    tap(QGamepadInputState::Gamepad_X, 1200);
+    QCOMPARE(detected(), QList<int>() << abx << bx);
+
+    //Only the suffix was in time
+    tap(QGamepadInputState::Gamepad_A, 2000);
+    tap(QGamepadInputState::Gamepad_B, 2500);
+    tap(QGamepadInputState::Gamepad_X, 2600);
+    QCOMPARE(detected(), QList<int>() << bx);
+}
+
+void tst_QGamepadComboDetector::chordInSequence()
+{
+    QList<QList<int> > chordSteps;
+    chordSteps << (QList<int>() << QGamepadInputState::Gamepad_X)
+               << (QList<int>() << QGamepadInputState::Gamepad_A << QGamepadInputState::Gamepad_B);
+    int xab = m_detector->addSequence("x+ab", chordSteps);
+    int ab = m_detector->addChord("ab", QList<int>() << QGamepadInputState::Gamepad_A << QGamepadInputState::Gamepad_B);
+
+    //The members of the chord break the sequence until the chord replaces them
+    tap(QGamepadInputState::Gamepad_X, 0);
+    press(QGamepadInputState::Gamepad_A, 100);
+    press(QGamepadInputState::Gamepad_B, 130);
+    QCOMPARE(detected(), QList<int>() << xab << ab);
+    release(QGamepadInputState::Gamepad_A, 200);
+    release(QGamepadInputState::Gamepad_B, 200);
+
+    //Members too far apart are no chord
+    tap(QGamepadInputState::Gamepad_X, 1000);
+    press(QGamepadInputState::Gamepad_A, 1100);
+    press(QGamepadInputState::Gamepad_B, 1200);
+    QCOMPARE(detected(), QList<int>());
+    release(QGamepadInputState::Gamepad_A, 1300);
+    release(QGamepadInputState::Gamepad_B, 1300);
+}
+
+QTEST_MAIN(tst_QGamepadComboDetector)
+
+#include "tst_qgamepadcombodetector.moc"
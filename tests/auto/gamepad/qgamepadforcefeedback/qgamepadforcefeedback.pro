@@ -0,0 +1,5 @@
+CONFIG += testcase
+TARGET = tst_qgamepadforcefeedback
+QT = core gamepad testlib
+
+SOURCES += tst_qgamepadforcefeedback.cpp
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <QtTest/QtTest>
+#include <QtCore/QThread>
+#include <QtGamepad/QGamepadHandler>
+
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+//Answers the effect uploads and erases of a uinput device the way a
+//driver would, so the handler sees a real force feedback capable pad
+class UinputService : public QThread
+{
+public:
+    UinputService(int fd) : m_fd(fd), m_stop(false) {}
+
+    void stop() { m_stop = true; wait(); }
+    //Uploads answered so far, new effects and effects overwritten in place
+    int uploadCount() const { return m_uploadCount.load(); }
+
+protected:
+    void run()
+    {
+        while (!m_stop) {
+            struct pollfd pfd = { m_fd, POLLIN, 0 };
+            if (poll(&pfd, 1, 100) <= 0)
+                continue;
+
+            struct input_event event;
+            while (read(m_fd, &event, sizeof(event)) == sizeof(event)) {
+                if (event.type != EV_UINPUT)
+                    continue;
+                if (event.code == UI_FF_UPLOAD) {
+                    struct uinput_ff_upload upload;
+                    memset(&upload, 0, sizeof(upload));
+                    upload.request_id = event.value;
+                    ioctl(m_fd, UI_BEGIN_FF_UPLOAD, &upload);
+                    upload.retval = 0;
+                    m_uploadCount.ref();
+                    ioctl(m_fd, UI_END_FF_UPLOAD, &upload);
+                } else if (event.code == UI_FF_ERASE) {
+                    struct uinput_ff_erase erase;
+                    memset(&erase, 0, sizeof(erase));
+                    erase.request_id = event.value;
+                    ioctl(m_fd, UI_BEGIN_FF_ERASE, &erase);
+                    erase.retval = 0;
+                    ioctl(m_fd, UI_END_FF_ERASE, &erase);
+                }
+            }
+        }
+    }
+
+private:
+    int m_fd;
+    volatile bool m_stop;
+    QAtomicInt m_uploadCount;
+};
+
+//Checks against a uinput device that the effect cache of QGamepadHandler
+//only uploads what it has to
+class tst_QGamepadForceFeedback : public QObject
+{
+    Q_OBJECT
+
+public:
+    tst_QGamepadForceFeedback() : m_uinput(-1), m_service(0), m_handler(0) {}
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void uploads();
+
+private:
+    QString eventNode() const;
+
+    int m_uinput;
+    UinputService *m_service;
+    QGamepadHandler *m_handler;
+};
+
+QString tst_QGamepadForceFeedback::eventNode() const
+{
+    char name[64];
+    memset(name, 0, sizeof(name));
+    if (ioctl(m_uinput, UI_GET_SYSNAME(sizeof(name) - 1), name) < 0)
+        return QString();
+
+    QDir dir(QLatin1String("/sys/devices/virtual/input/") + QLatin1String(name));
+    QStringList events = dir.entryList(QStringList() << QLatin1String("event*"));
+    if (events.isEmpty())
+        return QString();
+    return QLatin1String("/dev/input/") + events.first();
+}
+
+void tst_QGamepadForceFeedback::initTestCase()
+{
+    m_uinput = open("/dev/uinput", O_RDWR | O_NONBLOCK);
+    if (m_uinput < 0)
+        QSKIP("Cannot open /dev/uinput");
+
+    ioctl(m_uinput, UI_SET_EVBIT, EV_KEY);
+    ioctl(m_uinput, UI_SET_KEYBIT, BTN_A);
+    ioctl(m_uinput, UI_SET_EVBIT, EV_FF);
+    ioctl(m_uinput, UI_SET_FFBIT, FF_RUMBLE);
+    ioctl(m_uinput, UI_SET_FFBIT, FF_PERIODIC);
+    ioctl(m_uinput, UI_SET_FFBIT, FF_SINE);
+
+    struct uinput_user_dev device;
+    memset(&device, 0, sizeof(device));
+    strcpy(device.name, "tst_qgamepadforcefeedback");
+    device.id.bustype = BUS_VIRTUAL;
+    device.ff_effects_max = 16;
+    if (write(m_uinput, &device, sizeof(device)) != sizeof(device) || ioctl(m_uinput, UI_DEV_CREATE) < 0)
+        QSKIP("Cannot create a uinput device");
+
+    m_service = new UinputService(m_uinput);
+    m_service->start();
+
+    //udev may take a moment to create the node
+    QString node;
+    for (int i = 0; i < 50 && node.isEmpty(); ++i) {
+        node = eventNode();
+        if (node.isEmpty() || access(node.toLocal8Bit().constData(), R_OK | W_OK) != 0) {
+            node.clear();
+            QTest::qWait(20);
+        }
+    }
+    if (node.isEmpty())
+        QSKIP("No writable event node for the uinput device");
+
+    m_handler = QGamepadHandler::create(node);
+    if (!m_handler || !m_handler->hasForceFeedback())
+        QSKIP("The uinput device has no usable force feedback");
+}
+
+void tst_QGamepadForceFeedback::cleanupTestCase()
+{
+    //Erasing the effects needs the service still running
+    delete m_handler;
+    if (m_service) {
+        m_service->stop();
+        delete m_service;
+    }
+    if (m_uinput >= 0) {
+        ioctl(m_uinput, UI_DEV_DESTROY);
+        close(m_uinput);
+    }
+}
+
+void tst_QGamepadForceFeedback::uploads()
+{
+    //Without a writer the upload ioctl returns once the service answered,
+    //so the count is final when rumble() returns. Effects differ by duration.
+    int uploads = m_service->uploadCount();
+
+    for (int i = 0; i < 10; ++i)
+        m_handler->rumble(1.0, 0.5, 100);
+    QCOMPARE(m_service->uploadCount(), uploads + 1);
+
+    //Fill the 16 entries of the cache
+    for (int i = 1; i < 16; ++i)
+        m_handler->rumble(1.0, 0.5, 100 + i);
+    QCOMPARE(m_service->uploadCount(), uploads + 16);
+
+    //Playing the first effect again makes the second the least recently
+    //played, which the next new effect overwrites
+    m_handler->rumble(1.0, 0.5, 100);
+    QCOMPARE(m_service->uploadCount(), uploads + 16);
+    m_handler->rumble(1.0, 0.5, 200);
+    QCOMPARE(m_service->uploadCount(), uploads + 17);
+    m_handler->rumble(1.0, 0.5, 100);
+    QCOMPARE(m_service->uploadCount(), uploads + 17);
+    m_handler->rumble(1.0, 0.5, 101);
+    QCOMPARE(m_service->uploadCount(), uploads + 18);
+
+    m_handler->stopForceFeedback();
+}
+
+QTEST_MAIN(tst_QGamepadForceFeedback)
+
+#include "tst_qgamepadforcefeedback.moc"
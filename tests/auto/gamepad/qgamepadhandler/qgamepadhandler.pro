@@ -0,0 +1,5 @@
+CONFIG += testcase
+TARGET = tst_qgamepadhandler
+QT = core gamepad testlib
+
+SOURCES += tst_qgamepadhandler.cpp
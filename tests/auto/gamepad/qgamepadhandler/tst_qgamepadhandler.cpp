@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <QtTest/QtTest>
+#include <QtGamepad/QGamepadHandler>
+#include <QtGamepad/QGamepadEventSink>
+
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//Keeps every frame a handler hands out
+class FrameCollector : public QGamepadEventSink
+{
+public:
+    QList<QGamepadHandler::GamepadFrame> frames;
+
+    void processGamepadFrame(int, const QGamepadHandler::GamepadFrame &frame) { frames.append(frame); }
+};
+
+//The handler is fed through processInputEvents(), the uinput device only
+//provides the state the kernel reports after SYN_DROPPED
+class tst_QGamepadHandler : public QObject
+{
+    Q_OBJECT
+
+public:
+    tst_QGamepadHandler() : m_uinput(-1), m_handler(0) {}
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void resyncAfterPartialFrame();
+
+private:
+    QString eventNode() const;
+    void emitDeviceEvent(int type, int code, int value);
+    void feed(int type, int code, int value);
+
+    int m_uinput;
+    QGamepadHandler *m_handler;
+};
+
+QString tst_QGamepadHandler::eventNode() const
+{
+    char name[64];
+    memset(name, 0, sizeof(name));
+    if (ioctl(m_uinput, UI_GET_SYSNAME(sizeof(name) - 1), name) < 0)
+        return QString();
+
+    QDir dir(QLatin1String("/sys/devices/virtual/input/") + QLatin1String(name));
+    QStringList events = dir.entryList(QStringList() << QLatin1String("event*"));
+    if (events.isEmpty())
+        return QString();
+    return QLatin1String("/dev/input/") + events.first();
+}
+
+void tst_QGamepadHandler::emitDeviceEvent(int type, int code, int value)
+{
+    struct input_event event;
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    QCOMPARE(int(write(m_uinput, &event, sizeof(event))), int(sizeof(event)));
+}
+
+void tst_QGamepadHandler::feed(int type, int code, int value)
+{
+    struct input_event event;
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    m_handler->processInputEvents(&event, 1);
+}
+
+void tst_QGamepadHandler::initTestCase()
+{
+    m_uinput = open("/dev/uinput", O_RDWR | O_NONBLOCK);
+    if (m_uinput < 0)
+        QSKIP("Cannot open /dev/uinput");
+
+    ioctl(m_uinput, UI_SET_EVBIT, EV_KEY);
+    ioctl(m_uinput, UI_SET_KEYBIT, BTN_A);
+    ioctl(m_uinput, UI_SET_KEYBIT, BTN_B);
+    ioctl(m_uinput, UI_SET_EVBIT, EV_ABS);
+    ioctl(m_uinput, UI_SET_ABSBIT, ABS_X);
+
+    struct uinput_user_dev device;
+    memset(&device, 0, sizeof(device));
+    strcpy(device.name, "tst_qgamepadhandler");
+    device.id.bustype = BUS_VIRTUAL;
+    device.absmin[ABS_X] = 0;
+    device.absmax[ABS_X] = 255;
+    if (write(m_uinput, &device, sizeof(device)) != sizeof(device) || ioctl(m_uinput, UI_DEV_CREATE) < 0)
+        QSKIP("Cannot create a uinput device");
+
+    //udev may take a moment to create the node
+    QString node;
+    for (int i = 0; i < 50 && node.isEmpty(); ++i) {
+        node = eventNode();
+        if (node.isEmpty() || access(node.toLocal8Bit().constData(), R_OK) != 0) {
+            node.clear();
+            QTest::qWait(20);
+        }
+    }
+    if (node.isEmpty())
+        QSKIP("No readable event node for the uinput device");
+
+    m_handler = QGamepadHandler::create(node);
+    QVERIFY(m_handler);
+}
+
+void tst_QGamepadHandler::cleanupTestCase()
+{
+    delete m_handler;
+    if (m_uinput >= 0) {
+        ioctl(m_uinput, UI_DEV_DESTROY);
+        close(m_uinput);
+    }
+}
+
+void tst_QGamepadHandler::resyncAfterPartialFrame()
+{
+    FrameCollector collector;
+    QVERIFY(m_handler->addEventSink(&collector));
+
+    //The device ends up with A released, B pressed and X at 200
+    emitDeviceEvent(EV_KEY, BTN_A, 1);
+    emitDeviceEvent(EV_ABS, ABS_X, 100);
+    emitDeviceEvent(EV_SYN, SYN_REPORT, 0);
+    emitDeviceEvent(EV_KEY, BTN_A, 0);
+    emitDeviceEvent(EV_KEY, BTN_B, 1);
+    emitDeviceEvent(EV_ABS, ABS_X, 200);
+    emitDeviceEvent(EV_SYN, SYN_REPORT, 0);
+
+    feed(EV_KEY, BTN_A, 1);
+    feed(EV_ABS, ABS_X, 100);
+    feed(EV_SYN, SYN_REPORT, 0);
+    QCOMPARE(collector.frames.count(), 1);
+    QCOMPARE(collector.frames.at(0).flags, 0);
+
+    //The kernel dropped the end of the second frame, what was decoded of
+    //it never reached the sink and must not count as sent
+    feed(EV_KEY, BTN_A, 0);
+    feed(EV_ABS, ABS_X, 200);
+    feed(EV_SYN, SYN_DROPPED, 0);
+    feed(EV_KEY, BTN_B, 1);
+    feed(EV_SYN, SYN_REPORT, 0);
+    QCOMPARE(collector.frames.count(), 2);
+
+    const QGamepadHandler::GamepadFrame &resync = collector.frames.at(1);
+    QCOMPARE(resync.flags, int(QGamepadHandler::ResyncFrame));
+    QCOMPARE(resync.count, 3);
+    QCOMPARE(int(resync.events[0].type), int(QGamepadHandler::Button));
+    QCOMPARE(resync.events[0].code, int(BTN_A));
+    QCOMPARE(resync.events[0].value, 0);
+    QCOMPARE(int(resync.events[1].type), int(QGamepadHandler::Button));
+    QCOMPARE(resync.events[1].code, int(BTN_B));
+    QCOMPARE(resync.events[1].value, 1);
+    QCOMPARE(int(resync.events[2].type), int(QGamepadHandler::Axis));
+    QCOMPARE(resync.events[2].code, int(ABS_X));
+    QCOMPARE(resync.events[2].value, 200);
+
+    //Nothing differs any more
+    feed(EV_SYN, SYN_DROPPED, 0);
+    feed(EV_SYN, SYN_REPORT, 0);
+    QCOMPARE(collector.frames.count(), 2);
+
+    m_handler->removeEventSink(&collector);
+}
+
+QTEST_MAIN(tst_QGamepadHandler)
+
+#include "tst_qgamepadhandler.moc"
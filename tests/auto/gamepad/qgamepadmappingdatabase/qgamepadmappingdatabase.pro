@@ -0,0 +1,5 @@
+CONFIG += testcase
+TARGET = tst_qgamepadmappingdatabase
+QT = core gamepad gamepad-private testlib
+
+SOURCES += tst_qgamepadmappingdatabase.cpp
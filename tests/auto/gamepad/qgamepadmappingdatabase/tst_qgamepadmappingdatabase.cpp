@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <QtTest/QtTest>
+#include <QtGamepad/QGamepadMappingDatabase>
+#include <QtGamepad/QGamepadInputState>
+#include <QtGamepad/QGamepadEventSink>
+#include <QtGamepad/private/qgamepadcapabilitycache_p.h>
+
+#include <linux/input.h>
+
+//Collects the events of every frame a handler hands out
+class FrameCollector : public QGamepadEventSink
+{
+public:
+    QList<QGamepadHandler::GamepadEvent> events;
+
+    void processGamepadFrame(int, const QGamepadHandler::GamepadFrame &frame)
+    {
+        for (int i = 0; i < frame.count; ++i)
+            events.append(frame.events[i]);
+    }
+};
+
+class tst_QGamepadMappingDatabase : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void guid_data();
+    void guid();
+    void parseLine();
+    void skippedLines();
+    void versionFallback();
+    void sdlNumbering();
+};
+
+static void setBit(ulong *bits, int bit)
+{
+    bits[bit / QGamepadDeviceCapabilities::LongBits] |= 1UL << (bit % QGamepadDeviceCapabilities::LongBits);
+}
+
+static struct input_event inputEvent(int type, int code, int value)
+{
+    struct input_event event;
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    return event;
+}
+
+void tst_QGamepadMappingDatabase::guid_data()
+{
+    QTest::addColumn<int>("bus");
+    QTest::addColumn<int>("vendor");
+    QTest::addColumn<int>("product");
+    QTest::addColumn<int>("version");
+    QTest::addColumn<QByteArray>("guid");
+
+    //As listed in SDL's GameControllerDB
+    QTest::newRow("xbox360") << int(BUS_USB) << 0x045e << 0x028e << 0x0114 << QByteArray("030000005e0400008e02000014010000");
+    QTest::newRow("dualshock4-bluetooth") << int(BUS_BLUETOOTH) << 0x054c << 0x05c4 << 0x8100 << QByteArray("050000004c050000c405000000810000");
+    QTest::newRow("no-version") << int(BUS_USB) << 0x045e << 0x028e << 0 << QByteArray("030000005e0400008e02000000000000");
+}
+
+void tst_QGamepadMappingDatabase::guid()
+{
+    QFETCH(int, bus);
+    QFETCH(int, vendor);
+    QFETCH(int, product);
+    QFETCH(int, version);
+    QFETCH(QByteArray, guid);
+
+    QCOMPARE(QGamepadMappingDatabase::guid(bus, vendor, product, version), guid);
+}
+
+void tst_QGamepadMappingDatabase::parseLine()
+{
+    QGamepadMappingDatabase database;
+    QCOMPARE(database.addMappings("030000005E0400008E02000014010000,X360 Controller,"
+                                  "a:b0,b:b1,leftx:a0,lefty:a1~,dpup:h0.1,+lefttrigger:a2,righttrigger:+a5,"
+                                  "platform:Linux,\n"), 1);
+    QCOMPARE(database.count(), 1);
+
+    //GUIDs are matched lower case
+    const QGamepadControllerMapping *mapping = database.mapping("030000005e0400008e02000014010000");
+    QVERIFY(mapping);
+    QCOMPARE(mapping->name, QString::fromLatin1("X360 Controller"));
+
+    //Half axis targets and sources are left out
+    QCOMPARE(mapping->bindings.count(), 5);
+
+    const QGamepadControllerMapping::Binding &a = mapping->bindings.at(0);
+    QCOMPARE(int(a.target), int(QGamepadControllerMapping::A));
+    QCOMPARE(int(a.sourceType), int(QGamepadControllerMapping::ButtonSource));
+    QCOMPARE(int(a.index), 0);
+
+    const QGamepadControllerMapping::Binding &lefty = mapping->bindings.at(3);
+    QCOMPARE(int(lefty.target), int(QGamepadControllerMapping::LeftY));
+    QCOMPARE(int(lefty.sourceType), int(QGamepadControllerMapping::AxisSource));
+    QCOMPARE(int(lefty.index), 1);
+    QCOMPARE(int(lefty.inverted), 1);
+
+    const QGamepadControllerMapping::Binding &dpup = mapping->bindings.at(4);
+    QCOMPARE(int(dpup.target), int(QGamepadControllerMapping::DpadUp));
+    QCOMPARE(int(dpup.sourceType), int(QGamepadControllerMapping::HatSource));
+    QCOMPARE(int(dpup.index), 0);
+    QCOMPARE(int(dpup.hatMask), 1);
+}
+
+void tst_QGamepadMappingDatabase::skippedLines()
+{
+    QGamepadMappingDatabase database;
+    QCOMPARE(database.addMappings("# comment\n"
+                                  "\n"
+                                  "030000005e0400008e02000014010000,Windows only,a:b0,platform:Windows,\n"
+                                  "0300005e0400008e020000,Short GUID,a:b0,platform:Linux,\n"), 0);
+    QCOMPARE(database.count(), 0);
+
+    //Later lines replace earlier ones
+    database.addMappings("030000005e0400008e02000014010000,First,a:b0,platform:Linux,\n"
+                         "030000005e0400008e02000014010000,Second,a:b1,platform:Linux,\n");
+    QCOMPARE(database.count(), 1);
+    QCOMPARE(database.mapping("030000005e0400008e02000014010000")->name, QString::fromLatin1("Second"));
+}
+
+void tst_QGamepadMappingDatabase::versionFallback()
+{
+    QGamepadMappingDatabase database;
+    database.addMappings("030000005e0400008e02000000000000,Any version,a:b0,platform:Linux,\n");
+
+    const QGamepadControllerMapping *mapping = database.mapping(QGamepadMappingDatabase::guid(BUS_USB, 0x045e, 0x028e, 0x0114));
+    QVERIFY(mapping);
+    QCOMPARE(mapping->name, QString::fromLatin1("Any version"));
+    QVERIFY(!database.mapping(QGamepadMappingDatabase::guid(BUS_USB, 0x045e, 0x028f, 0x0114)));
+}
+
+void tst_QGamepadMappingDatabase::sdlNumbering()
+{
+    //SDL counts buttons from BTN_JOYSTICK up and then from BTN_MISC, and
+    //axes in code order without the hats
+    QGamepadDeviceCapabilities capabilities;
+    setBit(capabilities.keyBits, BTN_0);
+    setBit(capabilities.keyBits, BTN_SOUTH);
+    setBit(capabilities.keyBits, BTN_EAST);
+    const int axes[] = { ABS_X, ABS_Y, ABS_Z, ABS_HAT0X, ABS_HAT0Y };
+    for (uint i = 0; i < sizeof(axes) / sizeof(axes[0]); ++i) {
+        setBit(capabilities.absBits, axes[i]);
+        QGamepadDeviceCapabilities::AbsInfo &info = capabilities.absInfo[axes[i]];
+        bool hat = axes[i] >= ABS_HAT0X;
+        info.minimum = hat ? -1 : 0;
+        info.maximum = hat ? 1 : 255;
+        info.value = hat ? 0 : 128;
+    }
+
+    QGamepadMappingDatabase database;
+    database.addMappings("03000000000000000000000000000000,Test pad,"
+                         "a:b0,b:b2,lefty:a1~,righttrigger:a2,dpleft:h0.8,platform:Linux,\n");
+
+    QGamepadHandler *handler = QGamepadHandler::create(QLatin1String("test"), -1, capabilities);
+    QVERIFY(handler);
+    FrameCollector collector;
+    handler->addEventSink(&collector);
+    handler->setControlMapping(database.mapping("03000000000000000000000000000000"));
+    QVERIFY(handler->hasControlMapping());
+
+    //lefty is inverted around the middle of its range
+    QCOMPARE(handler->axisState()[ABS_Y], 255 - 128);
+
+    struct input_event events[] = {
+        inputEvent(EV_KEY, BTN_SOUTH, 1),
+        inputEvent(EV_KEY, BTN_0, 1),
+        //Not mentioned by the mapping
+        inputEvent(EV_KEY, BTN_EAST, 1),
+        inputEvent(EV_ABS, ABS_Y, 0),
+        inputEvent(EV_ABS, ABS_Z, 200),
+        inputEvent(EV_ABS, ABS_HAT0X, -1),
+        inputEvent(EV_SYN, SYN_REPORT, 0)
+    };
+    handler->processInputEvents(events, sizeof(events) / sizeof(events[0]));
+
+    QCOMPARE(collector.events.count(), 5);
+    QCOMPARE(int(collector.events.at(0).type), int(QGamepadHandler::Button));
+    QCOMPARE(collector.events.at(0).code, int(QGamepadInputState::Gamepad_A));
+    QCOMPARE(int(collector.events.at(1).type), int(QGamepadHandler::Button));
+    QCOMPARE(collector.events.at(1).code, int(QGamepadInputState::Gamepad_B));
+    QCOMPARE(int(collector.events.at(2).type), int(QGamepadHandler::Axis));
+    QCOMPARE(collector.events.at(2).code, int(ABS_Y));
+    QCOMPARE(collector.events.at(2).value, 255);
+    QCOMPARE(int(collector.events.at(3).type), int(QGamepadHandler::Axis));
+    QCOMPARE(collector.events.at(3).code, int(ABS_RZ));
+    QCOMPARE(int(collector.events.at(4).type), int(QGamepadHandler::Hat));
+    QCOMPARE(collector.events.at(4).code, int(ABS_HAT0X));
+
+    //State and calibration are indexed by the same, mapped, codes
+    QCOMPARE(handler->axisState()[ABS_Y], 255);
+    QCOMPARE(handler->axisState()[ABS_RZ], 200);
+    QCOMPARE(handler->axisState()[ABS_Z], 0);
+    QVERIFY(handler->axisCalibration()[ABS_RZ].posScale > 0.0f);
+    QCOMPARE(handler->axisCalibration()[ABS_Z].posScale, 0.0f);
+
+    handler->removeEventSink(&collector);
+    delete handler;
+}
+
+QTEST_MAIN(tst_QGamepadMappingDatabase)
+
+#include "tst_qgamepadmappingdatabase.moc"
@@ -0,0 +1,9 @@
+TEMPLATE = subdirs
+SUBDIRS += \
+    qgamepadforcefeedback \
+    qgamepadhandler \
+    qgamepadinputstate \
+    qgamepadkeybindings \
+    qgamepadmultiplexer \
+    qgamepadsharedstate \
+    qgamepadstreamserver
@@ -0,0 +1,5 @@
+TARGET = tst_bench_qgamepadforcefeedback
+QT = core gamepad testlib
+CONFIG += release
+
+SOURCES += tst_bench_qgamepadforcefeedback.cpp
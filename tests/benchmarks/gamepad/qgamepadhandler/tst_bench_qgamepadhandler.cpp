@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <QtTest/QtTest>
+#include <QtGamepad/QGamepadHandler>
+#include <QtGamepad/QGamepadEventSink>
+
+#include <linux/input.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+Q_DECLARE_METATYPE(QVector<input_event>)
+
+//Counts what the handler hands out so the work cannot be optimised away
+class EventCounter : public QObject, public QGamepadEventSink
+{
+    Q_OBJECT
+public:
+    EventCounter() : events(0), frames(0) {}
+    int events;
+    int frames;
+
+    void processGamepadFrame(int, const QGamepadHandler::GamepadFrame &) { ++frames; }
+
+public slots:
+    void eventReceived() { ++events; }
+    void frameReceived() { ++frames; }
+};
+
+//Measures QGamepadHandler decoding of synthetic evdev streams, read from a
+//pipe like a real device or decoded straight from memory.
+class tst_QGamepadHandler : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void readGamepadData_data();
+    void readGamepadData();
+    void processInputEvents_data();
+    void processInputEvents();
+
+private:
+    void addStreams();
+};
+
+static void appendEvent(QVector<input_event> *events, int type, int code, int value)
+{
+    struct input_event event;
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    events->append(event);
+}
+
+//32 events per stream, the size of one handler read
+static QVector<input_event> buttonStream()
+{
+    QVector<input_event> events;
+    for (int i = 0; i < 16; ++i) {
+        appendEvent(&events, EV_KEY, BTN_A + i % 4, i % 2);
+        appendEvent(&events, EV_SYN, SYN_REPORT, 0);
+    }
+    return events;
+}
+
+static QVector<input_event> axisStream()
+{
+    QVector<input_event> events;
+    for (int i = 0; i < 8; ++i) {
+        appendEvent(&events, EV_ABS, ABS_X, i * 1000);
+        appendEvent(&events, EV_ABS, ABS_Y, -i * 1000);
+        appendEvent(&events, EV_ABS, ABS_RX, i * 500);
+        appendEvent(&events, EV_SYN, SYN_REPORT, 0);
+    }
+    return events;
+}
+
+static QVector<input_event> mixedStream()
+{
+    QVector<input_event> events;
+    for (int i = 0; i < 8; ++i) {
+        appendEvent(&events, EV_ABS, ABS_X, i * 1000);
+        appendEvent(&events, EV_ABS, ABS_HAT0X, i % 3 - 1);
+        appendEvent(&events, EV_KEY, BTN_B, i % 2);
+        appendEvent(&events, EV_SYN, SYN_REPORT, 0);
+    }
+    return events;
+}
+
+void tst_QGamepadHandler::addStreams()
+{
+    QTest::addColumn<QVector<input_event> >("stream");
+    QTest::addColumn<int>("modes");
+    QTest::addColumn<bool>("sink");
+
+    const int event = QGamepadHandler::EventDelivery;
+    const int frame = QGamepadHandler::FrameDelivery;
+
+    QTest::newRow("buttons-events") << buttonStream() << event << false;
+    QTest::newRow("buttons-frames") << buttonStream() << frame << false;
+    QTest::newRow("buttons-sink") << buttonStream() << 0 << true;
+    QTest::newRow("axes-events") << axisStream() << event << false;
+    QTest::newRow("axes-frames") << axisStream() << frame << false;
+    QTest::newRow("axes-sink") << axisStream() << 0 << true;
+    QTest::newRow("mixed-events") << mixedStream() << event << false;
+    QTest::newRow("mixed-frames") << mixedStream() << frame << false;
+    QTest::newRow("mixed-sink") << mixedStream() << 0 << true;
+}
+
+void tst_QGamepadHandler::readGamepadData_data()
+{
+    addStreams();
+}
+
+void tst_QGamepadHandler::readGamepadData()
+{
+    QFETCH(QVector<input_event>, stream);
+    QFETCH(int, modes);
+    QFETCH(bool, sink);
+
+    int fds[2];
+    QVERIFY(pipe(fds) == 0);
+    QGamepadHandler *handler = QGamepadHandler::create(QString::fromLatin1("/proc/self/fd/%1").arg(fds[0]));
+    QVERIFY(handler);
+    ::close(fds[0]);
+
+    EventCounter counter;
+    handler->setDeliveryModes(QGamepadHandler::DeliveryModes(modes));
+    connect(handler, SIGNAL(handleGamepadEvent(quint64,QGamepadHandler::GamepadEventType,int,int)), &counter, SLOT(eventReceived()));
+    connect(handler, SIGNAL(handleGamepadFrame(QGamepadHandler::GamepadFrame)), &counter, SLOT(frameReceived()));
+    if (sink)
+        handler->addEventSink(&counter);
+
+    const int size = stream.count() * sizeof(input_event);
+    QBENCHMARK {
+        QCOMPARE(int(::write(fds[1], stream.constData(), size)), size);
+        QMetaObject::invokeMethod(handler, "readGamepadData", Qt::DirectConnection);
+    }
+
+    QVERIFY(counter.events + counter.frames > 0);
+    delete handler;
+    ::close(fds[1]);
+}
+
+void tst_QGamepadHandler::processInputEvents_data()
+{
+    addStreams();
+}
+
+void tst_QGamepadHandler::processInputEvents()
+{
+    QFETCH(QVector<input_event>, stream);
+    QFETCH(int, modes);
+    QFETCH(bool, sink);
+
+    QGamepadHandler *handler = QGamepadHandler::createVirtual(QLatin1String("benchmark"), QMap<int, QGamepadHandler::AxisInfo>());
+
+    EventCounter counter;
+    handler->setDeliveryModes(QGamepadHandler::DeliveryModes(modes));
+    connect(handler, SIGNAL(handleGamepadEvent(quint64,QGamepadHandler::GamepadEventType,int,int)), &counter, SLOT(eventReceived()));
+    connect(handler, SIGNAL(handleGamepadFrame(QGamepadHandler::GamepadFrame)), &counter, SLOT(frameReceived()));
+    if (sink)
+        handler->addEventSink(&counter);
+
+    QBENCHMARK {
+        handler->processInputEvents(stream.constData(), stream.count());
+    }
+
+    QVERIFY(counter.events + counter.frames > 0);
+    delete handler;
+}
+
+QTEST_MAIN(tst_QGamepadHandler)
+
+#include "tst_bench_qgamepadhandler.moc"
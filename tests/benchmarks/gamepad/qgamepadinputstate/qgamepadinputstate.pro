@@ -0,0 +1,5 @@
+TARGET = tst_bench_qgamepadinputstate
+QT = core gui gamepad testlib
+CONFIG += release
+
+SOURCES += tst_bench_qgamepadinputstate.cpp
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <QtTest/QtTest>
+#include <QtGamepad/QGamepadManager>
+#include <QtGamepad/QGamepadInputState>
+
+typedef QVector<QGamepadHandler::GamepadEvent> EventList;
+Q_DECLARE_METATYPE(EventList)
+
+//Measures applying gamepad input to QGamepadInputState and querying it
+//back, using a virtual device with an Xbox-like calibration.
+class tst_QGamepadInputState : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void processGamepadEvent_data();
+    void processGamepadEvent();
+    void processGamepadFrame_data();
+    void processGamepadFrame();
+    void queryGamepadAxis_data();
+    void queryGamepadAxis();
+    void processSticks_data();
+    void processSticks();
+
+private:
+    QGamepadHandler *m_handler;
+    QGamepadInfo *m_info;
+};
+
+//Query results end up here so the compiler cannot drop the queries
+static volatile qreal resultSink;
+
+static QGamepadHandler::GamepadEvent gamepadEvent(QGamepadHandler::GamepadEventType type, int code, int value)
+{
+    QGamepadHandler::GamepadEvent event;
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    return event;
+}
+
+void tst_QGamepadInputState::initTestCase()
+{
+    QMap<int, QGamepadHandler::AxisInfo> axes;
+    QGamepadHandler::AxisInfo stick = { -32768, 32767, 0, 4000 };
+    QGamepadHandler::AxisInfo trigger = { 0, 255, 0, 0 };
+    axes.insert(QGamepadInputState::Axis_X1, stick);
+    axes.insert(QGamepadInputState::Axis_Y1, stick);
+    axes.insert(QGamepadInputState::Axis_Z1, trigger);
+    axes.insert(QGamepadInputState::Axis_X2, stick);
+    axes.insert(QGamepadInputState::Axis_Y2, stick);
+    axes.insert(QGamepadInputState::Axis_Z2, trigger);
+
+    m_handler = QGamepadHandler::createVirtual(QLatin1String("benchmark"), axes);
+    m_info = new QGamepadInfo(0, m_handler);
+}
+
+void tst_QGamepadInputState::cleanupTestCase()
+{
+    delete m_info;
+    delete m_handler;
+}
+
+void tst_QGamepadInputState::processGamepadEvent_data()
+{
+    QTest::addColumn<EventList>("events");
+
+    EventList buttons;
+    for (int i = 0; i < 32; ++i)
+        buttons << gamepadEvent(QGamepadHandler::Button, QGamepadInputState::Gamepad_A + i % 15, i % 2);
+
+    EventList axes;
+    for (int i = 0; i < 32; ++i)
+        axes << gamepadEvent(QGamepadHandler::Axis, QGamepadInputState::Axis_X1 + i % 6, (i - 16) * 2000);
+
+    EventList hats;
+    for (int i = 0; i < 32; ++i)
+        hats << gamepadEvent(QGamepadHandler::Hat, QGamepadInputState::Hat_X1 + i % 2, i % 3 - 1);
+
+    EventList mixed;
+    for (int i = 0; i < 32; ++i)
+        mixed << buttons.at(i) << axes.at(i) << hats.at(i);
+
+    QTest::newRow("buttons") << buttons;
+    QTest::newRow("axes") << axes;
+    QTest::newRow("hats") << hats;
+    QTest::newRow("mixed") << mixed;
+}
+
+void tst_QGamepadInputState::processGamepadEvent()
+{
+    QFETCH(EventList, events);
+
+    QGamepadInputState inputState;
+    QBENCHMARK {
+        foreach (const QGamepadHandler::GamepadEvent &event, events)
+            inputState.processGamepadEvent(m_info, 0, event.type, event.code, event.value);
+    }
+}
+
+void tst_QGamepadInputState::processGamepadFrame_data()
+{
+    processGamepadEvent_data();
+}
+
+void tst_QGamepadInputState::processGamepadFrame()
+{
+    QFETCH(EventList, events);
+
+    //Pack the events into as few frames as possible
+    QVector<QGamepadHandler::GamepadFrame> frames;
+    QGamepadHandler::GamepadFrame frame;
+    frame.time = 0;
+    frame.decodeTime = 0;
+    frame.flags = 0;
+    frame.count = 0;
+    foreach (const QGamepadHandler::GamepadEvent &event, events) {
+        frame.events[frame.count++] = event;
+        if (frame.count == QGamepadHandler::MaxFrameEvents) {
+            frames << frame;
+            frame.count = 0;
+        }
+    }
+    if (frame.count)
+        frames << frame;
+
+    QGamepadInputState inputState;
+    QBENCHMARK {
+        foreach (const QGamepadHandler::GamepadFrame &frame, frames)
+            inputState.processGamepadFrame(m_info, frame);
+    }
+}
+
+void tst_QGamepadInputState::queryGamepadAxis_data()
+{
+    QTest::addColumn<int>("axis");
+    QTest::addColumn<int>("value");
+
+    QTest::newRow("stick-deadzone") << int(QGamepadInputState::Axis_X1) << 1000;
+    QTest::newRow("stick-positive") << int(QGamepadInputState::Axis_X1) << 20000;
+    QTest::newRow("stick-negative") << int(QGamepadInputState::Axis_Y2) << -20000;
+    QTest::newRow("trigger") << int(QGamepadInputState::Axis_Z1) << 128;
+}
+
+void tst_QGamepadInputState::queryGamepadAxis()
+{
+    QFETCH(int, axis);
+    QFETCH(int, value);
+
+    QGamepadInputState inputState;
+    inputState.processGamepadEvent(m_info, 0, QGamepadHandler::Axis, axis, value);
+
+    qreal sum = 0;
+    QBENCHMARK {
+        for (int i = 0; i < 1000; ++i)
+            sum += inputState.queryGamepadAxis(QGamepadInputState::Axis(axis), 0);
+    }
+    resultSink = sum;
+}
+
+void tst_QGamepadInputState::processSticks_data()
+{
+    QTest::addColumn<int>("deadzone");
+    QTest::addColumn<int>("smoothing");
+    QTest::addColumn<bool>("curve");
+
+    QTest::newRow("kernel") << int(QGamepadInputState::KernelDeadzone) << int(QGamepadInputState::NoSmoothing) << false;
+    QTest::newRow("scaled-radial") << int(QGamepadInputState::ScaledRadialDeadzone) << int(QGamepadInputState::NoSmoothing) << false;
+    QTest::newRow("scaled-radial-curve") << int(QGamepadInputState::ScaledRadialDeadzone) << int(QGamepadInputState::NoSmoothing) << true;
+    QTest::newRow("one-euro") << int(QGamepadInputState::ScaledRadialDeadzone) << int(QGamepadInputState::OneEuroSmoothing) << true;
+}
+
+//Every stick of 16 gamepads changes once per game frame
+void tst_QGamepadInputState::processSticks()
+{
+    QFETCH(int, deadzone);
+    QFETCH(int, smoothing);
+    QFETCH(bool, curve);
+
+    QGamepadInputState::StickSettings settings;
+    settings.deadzone = QGamepadInputState::DeadzoneMode(deadzone);
+    settings.innerDeadzone = 0.2f;
+    settings.outerDeadzone = 0.95f;
+    settings.smoothing = QGamepadInputState::SmoothingMode(smoothing);
+    if (curve)
+        settings.responseCurve = QGamepadInputState::StickSettings::powerCurve(2.0f);
+
+    QList<QGamepadInfo*> infos;
+    QGamepadInputState inputState;
+    for (int id = 0; id < 16; ++id) {
+        infos << new QGamepadInfo(id, m_handler);
+        inputState.setStickSettings(QGamepadInputState::LeftStick, settings, id);
+        inputState.setStickSettings(QGamepadInputState::RightStick, settings, id);
+    }
+
+    QGamepadHandler::GamepadFrame frame;
+    frame.time = 0;
+    frame.decodeTime = 0;
+    frame.flags = 0;
+    frame.count = 4;
+    inputState.setNotificationPolicy(QGamepadInputState::PerTick);
+
+    int value = 0;
+    qreal sum = 0;
+    QBENCHMARK {
+        value = (value + 997) % 32768;
+        frame.events[0] = gamepadEvent(QGamepadHandler::Axis, QGamepadInputState::Axis_X1, value);
+        frame.events[1] = gamepadEvent(QGamepadHandler::Axis, QGamepadInputState::Axis_Y1, -value);
+        frame.events[2] = gamepadEvent(QGamepadHandler::Axis, QGamepadInputState::Axis_X2, value / 2);
+        frame.events[3] = gamepadEvent(QGamepadHandler::Axis, QGamepadInputState::Axis_Y2, -value / 2);
+        foreach (QGamepadInfo *info, infos)
+            inputState.processGamepadFrame(info, frame);
+        inputState.beginFrame();
+        for (int id = 0; id < infos.count(); ++id)
+            sum += inputState.queryGamepadAxis(QGamepadInputState::Axis_X1, id) + inputState.queryGamepadAxis(QGamepadInputState::Axis_Y2, id);
+        inputState.endFrame();
+    }
+    resultSink = sum;
+
+    qDeleteAll(infos);
+}
+
+QTEST_MAIN(tst_QGamepadInputState)
+
+#include "tst_bench_qgamepadinputstate.moc"
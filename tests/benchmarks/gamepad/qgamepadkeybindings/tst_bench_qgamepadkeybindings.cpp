@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <QtTest/QtTest>
+#include <QtGamepad/QGamepadManager>
+#include <QtGamepad/QGamepadInputState>
+#include <QtGamepad/QGamepadKeyBindings>
+
+//Measures action lookups on binding sets of growing size. Every action is
+//bound to a key, a gamepad button and an axis of one of four controllers.
+class tst_QGamepadKeyBindings : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void checkAction_data();
+    void checkAction();
+    void checkActionById_data();
+    void checkActionById();
+    void evaluateActions_data();
+    void evaluateActions();
+    void checkMonitoredActions_data();
+    void checkMonitoredActions();
+
+private:
+    void addBindings(QGamepadKeyBindings *bindings, int actions);
+
+    QGamepadHandler *m_handler;
+    QGamepadInfo *m_info;
+};
+
+void tst_QGamepadKeyBindings::initTestCase()
+{
+    m_handler = QGamepadHandler::createVirtual(QLatin1String("benchmark"), QMap<int, QGamepadHandler::AxisInfo>());
+    m_info = new QGamepadInfo(0, m_handler);
+}
+
+void tst_QGamepadKeyBindings::cleanupTestCase()
+{
+    delete m_info;
+    delete m_handler;
+}
+
+static QString actionName(int action)
+{
+    return QString::fromLatin1("action%1").arg(action);
+}
+
+void tst_QGamepadKeyBindings::addBindings(QGamepadKeyBindings *bindings, int actions)
+{
+    for (int i = 0; i < actions; ++i) {
+        QString action = actionName(i);
+        bindings->addAction(action, Qt::Key(Qt::Key_A + i % 26));
+        bindings->addAction(action, QGamepadInputState::Buttons(QGamepadInputState::Gamepad_A + i % 15), i % 4);
+    }
+}
+
+void tst_QGamepadKeyBindings::checkAction_data()
+{
+    QTest::addColumn<int>("actions");
+
+    QTest::newRow("10") << 10;
+    QTest::newRow("100") << 100;
+    QTest::newRow("500") << 500;
+}
+
+void tst_QGamepadKeyBindings::checkAction()
+{
+    QFETCH(int, actions);
+
+    QGamepadInputState inputState;
+    QGamepadKeyBindings bindings(&inputState);
+    addBindings(&bindings, actions);
+
+    QStringList names;
+    for (int i = 0; i < actions; ++i)
+        names << actionName(i);
+
+    int active = 0;
+    QBENCHMARK {
+        foreach (const QString &name, names)
+            active += bindings.checkAction(name);
+    }
+    QCOMPARE(active, 0);
+}
+
+void tst_QGamepadKeyBindings::checkActionById_data()
+{
+    checkAction_data();
+}
+
+void tst_QGamepadKeyBindings::checkActionById()
+{
+    QFETCH(int, actions);
+
+    QGamepadInputState inputState;
+    QGamepadKeyBindings bindings(&inputState);
+    addBindings(&bindings, actions);
+
+    int active = 0;
+    QBENCHMARK {
+        for (int i = 0; i < actions; ++i)
+            active += bindings.checkAction(i);
+    }
+    QCOMPARE(active, 0);
+}
+
+void tst_QGamepadKeyBindings::evaluateActions_data()
+{
+    checkAction_data();
+}
+
+void tst_QGamepadKeyBindings::evaluateActions()
+{
+    QFETCH(int, actions);
+
+    QGamepadInputState inputState;
+    QGamepadKeyBindings bindings(&inputState);
+    addBindings(&bindings, actions);
+
+    QVector<qreal> values(bindings.actionCount());
+    QBENCHMARK {
+        bindings.evaluateActions(values.data());
+    }
+    QCOMPARE(values.count(qreal(0)), actions);
+}
+
+void tst_QGamepadKeyBindings::checkMonitoredActions_data()
+{
+    checkAction_data();
+}
+
+void tst_QGamepadKeyBindings::checkMonitoredActions()
+{
+    QFETCH(int, actions);
+
+    QGamepadInputState inputState;
+    QGamepadKeyBindings bindings(&inputState);
+    addBindings(&bindings, actions);
+    for (int i = 0; i < actions; ++i)
+        bindings.registerMonitoredAction(actionName(i));
+
+    //Every state update re-evaluates the monitored actions
+    int value = 0;
+    QBENCHMARK {
+        inputState.processGamepadEvent(m_info, 0, QGamepadHandler::Button, QGamepadInputState::Gamepad_A, value);
+        value = !value;
+    }
+}
+
+QTEST_MAIN(tst_QGamepadKeyBindings)
+
+#include "tst_bench_qgamepadkeybindings.moc"
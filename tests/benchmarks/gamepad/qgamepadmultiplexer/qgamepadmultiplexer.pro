@@ -0,0 +1,5 @@
+TARGET = tst_bench_qgamepadmultiplexer
+QT = core gamepad gamepad-private testlib
+CONFIG += release
+
+SOURCES += tst_bench_qgamepadmultiplexer.cpp
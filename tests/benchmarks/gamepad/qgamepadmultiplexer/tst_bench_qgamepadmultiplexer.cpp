@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <QtTest/QtTest>
+#include <QtCore/QSocketNotifier>
+#include <QtGamepad/QGamepadHandler>
+#include <QtGamepad/private/qgamepadmultiplexer_p.h>
+
+#include <linux/input.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//Counts frames handed out by all handlers
+class FrameCounter : public QObject
+{
+    Q_OBJECT
+public:
+    FrameCounter() : frames(0), activations(0) {}
+    int frames;
+    int activations;
+
+public slots:
+    void frameReceived() { ++frames; }
+    void notifierActivated() { ++activations; }
+};
+
+//Compares one QSocketNotifier per device against a single epoll set.
+//Devices are pipes, so no hardware is needed.
+class tst_QGamepadMultiplexer : public QObject
+{
+    Q_OBJECT
+public:
+    tst_QGamepadMultiplexer() : m_multiplexer(0) {}
+
+private slots:
+    void dispatch_data();
+    void dispatch();
+    void wakeups_data();
+    void wakeups();
+
+private:
+    void openDevices(int count, bool multiplexed);
+    void closeDevices();
+    void writeFrames();
+    void processFrames();
+
+    QList<QGamepadHandler*> m_handlers;
+    QList<int> m_writeFds;
+    QGamepadMultiplexer *m_multiplexer;
+    FrameCounter m_counter;
+};
+
+void tst_QGamepadMultiplexer::openDevices(int count, bool multiplexed)
+{
+    m_multiplexer = multiplexed ? new QGamepadMultiplexer : 0;
+
+    for (int i = 0; i < count; ++i) {
+        int fds[2];
+        QVERIFY(pipe(fds) == 0);
+
+        //Handlers open device nodes, /proc/self/fd gives us one for the pipe
+        QGamepadHandler *handler = QGamepadHandler::create(QString::fromLatin1("/proc/self/fd/%1").arg(fds[0]));
+        QVERIFY(handler);
+        ::close(fds[0]);
+
+        handler->setDeliveryModes(QGamepadHandler::FrameDelivery);
+        connect(handler, SIGNAL(handleGamepadFrame(QGamepadHandler::GamepadFrame)), &m_counter, SLOT(frameReceived()));
+        //Each activation of the handler's notifier is one wakeup
+        foreach (QSocketNotifier *notifier, handler->findChildren<QSocketNotifier*>())
+            connect(notifier, SIGNAL(activated(int)), &m_counter, SLOT(notifierActivated()));
+        if (m_multiplexer)
+            m_multiplexer->addHandler(handler);
+
+        m_handlers.append(handler);
+        m_writeFds.append(fds[1]);
+    }
+}
+
+void tst_QGamepadMultiplexer::closeDevices()
+{
+    qDeleteAll(m_handlers);
+    m_handlers.clear();
+    foreach (int fd, m_writeFds)
+        ::close(fd);
+    m_writeFds.clear();
+    delete m_multiplexer;
+    m_multiplexer = 0;
+}
+
+void tst_QGamepadMultiplexer::writeFrames()
+{
+    struct input_event events[2];
+    memset(events, 0, sizeof(events));
+    events[0].type = EV_ABS;
+    events[0].code = ABS_X;
+    events[0].value = 128;
+    events[1].type = EV_SYN;
+    events[1].code = SYN_REPORT;
+
+    foreach (int fd, m_writeFds)
+        QCOMPARE(int(::write(fd, events, sizeof(events))), int(sizeof(events)));
+}
+
+void tst_QGamepadMultiplexer::processFrames()
+{
+    m_counter.frames = 0;
+    while (m_counter.frames < m_handlers.count())
+        QCoreApplication::processEvents();
+}
+
+void tst_QGamepadMultiplexer::dispatch_data()
+{
+    QTest::addColumn<int>("devices");
+    QTest::addColumn<bool>("multiplexed");
+
+    const int counts[] = { 1, 4, 16, 64 };
+    for (uint i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        QTest::newRow(qPrintable(QString::fromLatin1("notifiers-%1").arg(counts[i]))) << counts[i] << false;
+        QTest::newRow(qPrintable(QString::fromLatin1("epoll-%1").arg(counts[i]))) << counts[i] << true;
+    }
+}
+
+void tst_QGamepadMultiplexer::dispatch()
+{
+    QFETCH(int, devices);
+    QFETCH(bool, multiplexed);
+
+    openDevices(devices, multiplexed);
+
+    QBENCHMARK {
+        writeFrames();
+        processFrames();
+    }
+
+    closeDevices();
+}
+
+void tst_QGamepadMultiplexer::wakeups_data()
+{
+    dispatch_data();
+}
+
+void tst_QGamepadMultiplexer::wakeups()
+{
+    QFETCH(int, devices);
+    QFETCH(bool, multiplexed);
+
+    const int rounds = 100;
+    openDevices(devices, multiplexed);
+
+    //Notifiers of multiplexed handlers are disabled, so only one of the
+    //two counts moves
+    m_counter.activations = 0;
+    if (m_multiplexer)
+        m_multiplexer->resetCounts();
+    for (int i = 0; i < rounds; ++i) {
+        writeFrames();
+        processFrames();
+    }
+    int activations = m_counter.activations;
+    if (m_multiplexer)
+        activations += m_multiplexer->wakeupCount();
+
+    QTest::setBenchmarkResult(qreal(activations) / rounds, QTest::Events);
+    closeDevices();
+}
+
+QTEST_MAIN(tst_QGamepadMultiplexer)
+
+#include "tst_bench_qgamepadmultiplexer.moc"
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <QtTest/QtTest>
+#include <QtGamepad/QGamepadManager>
+#include <QtGamepad/QGamepadInjectionBackend>
+#include <QtGamepad/QGamepadSharedStatePublisher>
+
+#include <linux/input.h>
+
+//Measures what publishing a frame to shared memory adds on the decoding
+//thread, and what subscribers pay to read the state and the event ring.
+//Publisher and subscriber share the process, the segment is the same.
+class tst_QGamepadSharedState : public QObject
+{
+    Q_OBJECT
+public:
+    tst_QGamepadSharedState() : m_manager(0), m_publisher(0) {}
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void publishFrame_data();
+    void publishFrame();
+    void readGamepad();
+    void readEvents_data();
+    void readEvents();
+
+private:
+    QGamepadManager *m_manager;
+    QGamepadSharedStatePublisher *m_publisher;
+    QGamepadSharedStateSubscriber m_subscriber;
+};
+
+static QString segmentName()
+{
+    return QString::fromLatin1("/tst_bench_qgamepadsharedstate-%1").arg(QCoreApplication::applicationPid());
+}
+
+static QGamepadHandler::GamepadFrame axisFrame(int count)
+{
+    QGamepadHandler::GamepadFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.time = 1;
+    frame.count = count;
+    for (int i = 0; i < count; ++i) {
+        frame.events[i].type = QGamepadHandler::Axis;
+        frame.events[i].code = ABS_X + i % 6;
+        frame.events[i].value = i * 8;
+    }
+    return frame;
+}
+
+void tst_QGamepadSharedState::initTestCase()
+{
+    QGamepadInjectionBackend *backend = new QGamepadInjectionBackend;
+    m_manager = new QGamepadManager(backend);
+
+    QMap<int, QGamepadHandler::AxisInfo> axisInfo;
+    QGamepadHandler::AxisInfo info = { 0, 255, 128, 8 };
+    for (int axis = ABS_X; axis <= ABS_RZ; ++axis)
+        axisInfo.insert(axis, info);
+    backend->addDevice(axisInfo);
+
+    m_publisher = new QGamepadSharedStatePublisher(m_manager);
+    if (!m_publisher->start(segmentName()))
+        QSKIP("Cannot create the shared memory segment");
+    QVERIFY(m_subscriber.attach(segmentName()));
+    QVERIFY(m_subscriber.isPublisherRunning());
+}
+
+void tst_QGamepadSharedState::cleanupTestCase()
+{
+    m_subscriber.detach();
+    delete m_publisher;
+    delete m_manager;
+}
+
+void tst_QGamepadSharedState::publishFrame_data()
+{
+    QTest::addColumn<int>("events");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("8") << 8;
+    QTest::newRow("32") << 32;
+}
+
+void tst_QGamepadSharedState::publishFrame()
+{
+    QFETCH(int, events);
+
+    QGamepadHandler::GamepadFrame frame = axisFrame(events);
+    QBENCHMARK {
+        ++frame.time;
+        m_publisher->processGamepadFrame(0, frame);
+    }
+}
+
+void tst_QGamepadSharedState::readGamepad()
+{
+    m_publisher->processGamepadFrame(0, axisFrame(8));
+
+    QGamepadSharedState::Gamepad gamepad;
+    float sum = 0;
+    QBENCHMARK {
+        QVERIFY(m_subscriber.readGamepad(0, &gamepad));
+        sum += gamepad.axis(ABS_X);
+    }
+    Q_UNUSED(sum);
+}
+
+void tst_QGamepadSharedState::readEvents_data()
+{
+    publishFrame_data();
+}
+
+void tst_QGamepadSharedState::readEvents()
+{
+    QFETCH(int, events);
+
+    QGamepadHandler::GamepadFrame frame = axisFrame(events);
+    QGamepadSharedState::Event buffer[QGamepadHandler::MaxFrameEvents];
+    m_subscriber.readEvents(buffer, QGamepadHandler::MaxFrameEvents);
+
+    QBENCHMARK {
+        m_publisher->processGamepadFrame(0, frame);
+        QCOMPARE(m_subscriber.readEvents(buffer, QGamepadHandler::MaxFrameEvents), events);
+    }
+    QCOMPARE(m_subscriber.lostEventCount(), quint64(0));
+}
+
+QTEST_MAIN(tst_QGamepadSharedState)
+
+#include "tst_bench_qgamepadsharedstate.moc"
@@ -0,0 +1,5 @@
+TARGET = tst_bench_qgamepadstreamserver
+QT = core gamepad testlib
+CONFIG += release
+
+SOURCES += tst_bench_qgamepadstreamserver.cpp
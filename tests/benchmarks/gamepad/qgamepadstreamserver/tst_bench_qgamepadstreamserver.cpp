@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2012 Andy Nichols
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <QtTest/QtTest>
+#include <QtGamepad/QGamepadManager>
+#include <QtGamepad/QGamepadInjectionBackend>
+#include <QtGamepad/QGamepadStreamServer>
+
+#include <linux/input.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//Measures sending one frame to every connected client, with and without
+//a client that stopped reading. The stalled client must not make the
+//others any slower.
+class tst_QGamepadStreamServer : public QObject
+{
+    Q_OBJECT
+public:
+    tst_QGamepadStreamServer() : m_manager(0), m_server(0) {}
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void sendFrame_data();
+    void sendFrame();
+
+private:
+    int connectClient();
+    void disconnectClients();
+
+    QGamepadManager *m_manager;
+    QGamepadStreamServer *m_server;
+    QString m_path;
+    QList<int> m_clients;
+};
+
+void tst_QGamepadStreamServer::initTestCase()
+{
+    QGamepadInjectionBackend *backend = new QGamepadInjectionBackend;
+    m_manager = new QGamepadManager(backend);
+
+    QMap<int, QGamepadHandler::AxisInfo> axisInfo;
+    QGamepadHandler::AxisInfo info = { 0, 255, 128, 8 };
+    for (int axis = ABS_X; axis <= ABS_RZ; ++axis)
+        axisInfo.insert(axis, info);
+    backend->addDevice(axisInfo);
+
+    m_server = new QGamepadStreamServer(m_manager);
+    m_path = QDir::tempPath() + QString::fromLatin1("/tst_bench_qgamepadstreamserver-%1").arg(QCoreApplication::applicationPid());
+    if (!m_server->listen(m_path))
+        QSKIP("Cannot listen on a local socket");
+}
+
+void tst_QGamepadStreamServer::cleanupTestCase()
+{
+    disconnectClients();
+    delete m_server;
+    delete m_manager;
+}
+
+int tst_QGamepadStreamServer::connectClient()
+{
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    QByteArray path = QFile::encodeName(m_path);
+    memcpy(address.sun_path, path.constData(), path.size());
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    m_clients.append(fd);
+    return fd;
+}
+
+void tst_QGamepadStreamServer::disconnectClients()
+{
+    foreach (int fd, m_clients)
+        ::close(fd);
+    m_clients.clear();
+    //Let the server notice
+    while (m_server && m_server->clientCount())
+        QCoreApplication::processEvents();
+}
+
+void tst_QGamepadStreamServer::sendFrame_data()
+{
+    QTest::addColumn<int>("clients");
+    QTest::addColumn<bool>("stalled");
+
+    const int counts[] = { 1, 4, 16 };
+    for (uint i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        QTest::newRow(qPrintable(QString::fromLatin1("clients-%1").arg(counts[i]))) << counts[i] << false;
+        QTest::newRow(qPrintable(QString::fromLatin1("clients-%1-stalled").arg(counts[i]))) << counts[i] << true;
+    }
+}
+
+void tst_QGamepadStreamServer::sendFrame()
+{
+    QFETCH(int, clients);
+    QFETCH(bool, stalled);
+
+    QList<int> readers;
+    for (int i = 0; i < clients; ++i) {
+        int fd = connectClient();
+        QVERIFY(fd >= 0);
+        readers.append(fd);
+    }
+    //Connected last and never read from
+    if (stalled)
+        QVERIFY(connectClient() >= 0);
+
+    while (m_server->clientCount() < m_clients.count())
+        QCoreApplication::processEvents();
+
+    //Drop the snapshots sent on connect
+    QGamepadStreamRecord records[QGamepadHandler::MaxFrameEvents * 64];
+    foreach (int fd, readers) {
+        while (recv(fd, records, sizeof(records), MSG_DONTWAIT) > 0)
+            ;
+    }
+
+    QGamepadHandler::GamepadFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.count = 2;
+    frame.events[0].type = QGamepadHandler::Axis;
+    frame.events[0].code = ABS_X;
+    frame.events[1].type = QGamepadHandler::Axis;
+    frame.events[1].code = ABS_Y;
+
+    QBENCHMARK {
+        ++frame.time;
+        frame.events[0].value = frame.time % 256;
+        frame.events[1].value = 255 - frame.time % 256;
+        m_server->processGamepadFrame(0, frame);
+
+        foreach (int fd, readers)
+            QCOMPARE(int(recv(fd, records, sizeof(records), 0)), int(2 * sizeof(QGamepadStreamRecord)));
+    }
+
+    disconnectClients();
+}
+
+QTEST_MAIN(tst_QGamepadStreamServer)
+
+#include "tst_bench_qgamepadstreamserver.moc"